@@ -0,0 +1,72 @@
+/*
+Backend-Benchmark - compares the Arduino and ESP-IDF download backends
+Copyright (C) 2022-3 Mikal Hart
+All rights reserved.
+
+https://github.com/mikalhart/ESP32-OTA-Pull
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files 
+(the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify,
+merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR
+IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/*
+  Downloads the same image (as a dry run, so nothing is written to flash) with the Arduino
+  backend (HTTPClient) and the ESP-IDF backend (esp_http_client), and prints the throughput
+  and the lowest free heap seen during each download.  Compare the flash size of the two
+  backends by building Basic-OTA-Example with ESP32OTAPull and with ESP32OTAPullIDF.
+*/
+
+#include <Arduino.h>
+#include "ESP32OTAPull.h"
+
+#if __has_include("settings.h") // optionally override with values in settings.h
+#include "settings.h"
+#else
+static const char *SSID 	= "<WiFi SSID>";
+static const char *PASS     = "<WiFi Password>";
+#endif
+static const char *IMAGE_URL = "https://example.com/myimages/large.bin"; // any file of a few hundred KB or more
+static const int RUNS = 3;
+
+template <class OTA> void Measure(const char *name)
+{
+	for (int run = 0; run < RUNS; ++run)
+	{
+		OTA ota;
+		ota.SetDryRun().EnableMemoryReport();
+		ESP32OTAPull::OTAConfiguration config = {};
+		strlcpy(config.URL, IMAGE_URL, sizeof(config.URL));
+		int ret = ota.DownloadUpdate(config, ESP32OTAPull::UPDATE_BUT_NO_BOOT);
+		ESP32OTAPull::Result result = ota.GetResult();
+		ESP32OTAPull::MemoryReport memory = ota.GetMemoryReport();
+		Serial.printf("%-8s run %d: result %d, %u bytes in %u ms, %6.1f KB/s, min free heap %u\n", name, run + 1, ret,
+			(unsigned)result.DownloadBytes, (unsigned)result.DownloadMillis,
+			result.DownloadMillis == 0 ? 0.0f : result.DownloadBytes / (float)result.DownloadMillis,
+			(unsigned)memory.MinFreeHeap);
+	}
+}
+
+void setup()
+{
+	Serial.begin(115200);
+	delay(2000); // wait for ESP32 Serial to stabilize
+	WiFi.begin(SSID, PASS);
+	while (WiFi.status() != WL_CONNECTED)
+		delay(500);
+
+	Measure<ESP32OTAPull>("Arduino");
+	Measure<ESP32OTAPullIDF>("ESP-IDF");
+}
+
+void loop()
+{
+}
@@ -0,0 +1,70 @@
+/*
+Decryption-Benchmark - measures the cost of decrypting images per chunk size
+Copyright (C) 2022-3 Mikal Hart
+All rights reserved.
+
+https://github.com/mikalhart/ESP32-OTA-Pull
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files 
+(the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify,
+merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR
+IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+/*
+  Times ESP32OTAPullDecryptor on a buffer of random data for a range of chunk sizes.
+  The Arduino core builds mbedTLS with CONFIG_MBEDTLS_HARDWARE_AES, so these are the
+  hardware AES figures.  For a software comparison, run the same sketch in an ESP-IDF
+  build with that option turned off.
+*/
+
+#include <Arduino.h>
+#include "ESP32OTAPull.h"
+
+static const size_t TOTAL = 256 * 1024; // bytes decrypted per measurement
+static const size_t CHUNK_SIZES[] = { 256, 512, 1024, 1264, 2048, 4096 };
+
+void Measure(ESP32OTAPullDecryptor::Mode mode, const char *name)
+{
+	static uint8_t buffer[4096 + 16];
+	uint8_t key[32], iv[16], tag[16], tail[16];
+	esp_fill_random(key, sizeof(key));
+	esp_fill_random(iv, sizeof(iv));
+	esp_fill_random(buffer, sizeof(buffer));
+
+	for (size_t chunk : CHUNK_SIZES)
+	{
+		ESP32OTAPullDecryptor decryptor;
+		decryptor.Begin(mode, key, iv, mode == ESP32OTAPullDecryptor::AES256_GCM ? 12 : 16);
+		uint32_t start = micros();
+		for (size_t done = 0; done < TOTAL; done += chunk)
+		{
+			size_t length = chunk;
+			decryptor.Process(buffer, length);
+		}
+		size_t tailLength;
+		decryptor.Finish(tag, tail, tailLength); // the tag won't match random data; we only want the time
+		uint32_t elapsed = micros() - start;
+		Serial.printf("%s  chunk %4u: %7u us, %6.2f MB/s\n", name, (unsigned)chunk, (unsigned)elapsed, TOTAL / (float)elapsed);
+	}
+}
+
+void setup()
+{
+	Serial.begin(115200);
+	delay(2000); // wait for ESP32 Serial to stabilize
+
+	Measure(ESP32OTAPullDecryptor::AES256_CTR, "AES-256-CTR");
+	Measure(ESP32OTAPullDecryptor::AES256_GCM, "AES-256-GCM");
+}
+
+void loop()
+{
+}
@@ -89,6 +89,10 @@ const char *errtext(int code)
 			return "Invalid JSON";
 		case ESP32OTAPull::OTA_UPDATE_FAIL:
 			return "Update fail (no OTA partition?)";
+		case ESP32OTAPull::VERIFY_FAIL:
+			return "Image does not match its SHA256";
+		case ESP32OTAPull::DECRYPT_FAIL:
+			return "Decryption failed (no key or bad tag?)";
 		default:
 			if (code > 0)
 				return "Unexpected HTTP response code";
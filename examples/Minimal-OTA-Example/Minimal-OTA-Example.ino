@@ -0,0 +1,54 @@
+/*
+Minimal-OTA-Example - the smallest build of ESP32-OTA-Pull: plain HTTP, no hashing, decryption, debug output or optional features
+Copyright (C) 2022-3 Mikal Hart
+All rights reserved.
+
+https://github.com/mikalhart/ESP32-OTA-Pull
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files
+(the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify,
+merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR
+IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#define ESP32OTAPULL_MDNS 0 // ESP32OTAPullMinimal has no peers or mirrors, so leave mDNS out too
+#include <Arduino.h>
+#include "ESP32OTAPull.h"
+
+// First, edit these values appropriately
+#if __has_include("settings.h") // optionally override with values in settings.h
+#include "settings.h"
+#else
+static const char *JSON_URL = "http://example.com/myimages/Minimal-OTA-Example.json"; // must be http://
+static const char *SSID 	= "<WiFi SSID>";
+static const char *PASS     = "<WiFi Password>";
+static const char *VERSION  = "1.0.0"; // The current version of this program
+#endif
+
+// The JSON file is the same as for Basic-OTA-Example, except that entries must not have "Encryption"
+// (a "SHA256" is accepted but not checked).
+// Compile this and Basic-OTA-Example for the same board and compare the "Sketch uses ... bytes" and
+// "Global variables use ... bytes" lines to see what the optional features cost.
+
+void setup()
+{
+	Serial.begin(115200);
+	WiFi.begin(SSID, PASS);
+	while (WiFi.status() != WL_CONNECTED)
+		delay(500);
+
+	ESP32OTAPullMinimal ota;
+	int ret = ota.CheckForOTAUpdate(JSON_URL, VERSION);
+	Serial.printf("CheckForOTAUpdate returned %d\n", ret);
+}
+
+void loop()
+{
+}
@@ -0,0 +1,70 @@
+/*
+Rollback-Example - confirm a freshly installed image, or let the bootloader roll it back
+Copyright (C) 2022-3 Mikal Hart
+All rights reserved.
+
+https://github.com/mikalhart/ESP32-OTA-Pull
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files 
+(the "Software"), to deal in the Software without restriction, including without limitation the rights to use, copy, modify,
+merge, publish, distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR
+IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <Arduino.h>
+#include "ESP32OTAPull.h"
+
+// First, edit these values appropriately
+#if __has_include("settings.h") // optionally override with values in settings.h
+#include "settings.h"
+#else
+static const char *JSON_URL = "https://example.com/myimages/Rollback-Example.json"; // this is where you'll post your JSON filter file
+static const char *SSID 	= "<WiFi SSID>";
+static const char *PASS     = "<WiFi Password>";
+static const char *VERSION  = "1.0.0"; // The current version of this program
+#endif
+
+// Tell the Arduino core NOT to mark a new image as valid at startup; we decide that ourselves.
+bool verifyRollbackLater()
+{
+	return true;
+}
+
+ESP32OTAPull ota;
+
+void setup()
+{
+	Serial.begin(115200);
+	delay(2000); // wait for ESP32 Serial to stabilize
+
+	// If this is the first boot of a new image, it has 60 seconds to prove itself.  A successful
+	// CheckForOTAUpdate (i.e. the network and update server are reachable) counts as proof.
+	ota.EnableSerialDebug();
+	ota.EnableRollback(60000);
+	Serial.printf("Rollback-Example v%s, pending verification: %s\n", VERSION, ESP32OTAPull::IsPendingVerify() ? "yes" : "no");
+
+	Serial.printf("Connecting to WiFi '%s'...", SSID);
+	WiFi.begin(SSID, PASS);
+	while (!WiFi.isConnected())
+	{
+		Serial.print(".");
+		delay(250);
+	}
+	Serial.printf("\n\n");
+
+	int ret = ota.CheckForOTAUpdate(JSON_URL, VERSION);
+	Serial.printf("CheckForOTAUpdate returned %d\n", ret);
+}
+
+void loop()
+{
+	// An application could instead call ota.ConfirmUpdate() once it is satisfied that
+	// everything (sensors, cloud connection, ...) works with the new image.
+}
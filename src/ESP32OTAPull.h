@@ -26,30 +26,516 @@ SOFTWARE.
 */
 
 #pragma once
-#include <HTTPClient.h>
+#include "ESP32OTAPullPlatform.h"
 #include <ArduinoJson.h>
-#include <Update.h>
-#include <WiFi.h>
-#include <WiFiClientSecure.h>
+#include <esp_heap_caps.h>
+#include <memory>
+#include <nvs.h>
+#include <esp_ota_ops.h>
+#include <esp_timer.h>
+#include <esp_http_client.h>
+#include <esp_mac.h>
+#include <esp_netif.h>
+#if CONFIG_MBEDTLS_CERTIFICATE_BUNDLE
+#include <esp_crt_bundle.h>
+#endif
+#include <time.h>
+#include "ESP32OTAPullTrace.h"
+#include "ESP32OTAPullCrypto.h"
+#include "ESP32OTAPullSink.h"
+#include "ESP32OTAPullPolicies.h"
+#include "ESP32OTAPullDNSCache.h"
 
-class ESP32OTAPull
+// The add-ons, which stay in the global namespace
+class ESP32OTAPullMulticastReceiver;
+class ESP32OTAPullGateway;
+class ESP32OTAPullNotifier;
+
+namespace esp32otapull
+{
+
+// Everything one HTTP request needs (the HTTPClient, an optional TLS client and an optional
+// Update transaction), released on every exit path when the session goes out of scope.
+class ESP32OTAPullSession
+{
+public:
+    HTTPClient http;
+
+    ESP32OTAPullSession() {}
+    ESP32OTAPullSession(const ESP32OTAPullSession &) = delete;
+    ESP32OTAPullSession &operator=(const ESP32OTAPullSession &) = delete;
+
+    ~ESP32OTAPullSession()
+    {
+        Close();
+    }
+
+    /// @brief The TLS client for an https:// request, created on first use and owned by the session
+    WiFiClientSecure &SecureClient()
+    {
+        if (Secure == NULL)
+        {
+            Secure = new WiFiClientSecure();
+            SecureError = [](WiFiClient *client)
+            {
+                char message[8];
+                return static_cast<WiFiClientSecure *>(client)->lastError(message, sizeof(message));
+            };
+        }
+        return *static_cast<WiFiClientSecure *>(Secure);
+    }
+
+    /// @brief The client for an http:// request, created on first use and owned by the session
+    WiFiClient &PlainClient()
+    {
+        if (Plain == NULL)
+            Plain = new WiFiClient();
+        return *Plain;
+    }
+
+    /// @brief http.GET(), traced as Headers (request out, response headers in) when the connection is
+    ///        already open, e.g. by ConnectCached or kept alive from a previous request; otherwise as Connect,
+    ///        since HTTPClient then also looks the name up and connects (with any TLS handshake) inside GET()
+    int GET()
+    {
+        uint8_t phase = http.connected() ? OTA_TRACE_HEADERS : OTA_TRACE_CONNECT;
+        (void)phase; // unused unless tracing is enabled
+        ESP32OTAPULL_TRACE_BEGIN(phase);
+        int httpResponseCode = http.GET();
+        ESP32OTAPULL_TRACE_END(phase);
+        return httpResponseCode;
+    }
+
+    /// @brief The last mbedTLS error of the https connection, or 0
+    int TLSError()
+    {
+        return SecureError == NULL ? 0 : SecureError(Secure);
+    }
+
+    /// @brief Start writing an image to sink; it is aborted unless EndUpdate() succeeds
+    bool BeginUpdate(ESP32OTAPullSink &sink, size_t size)
+    {
+        if (!sink.Begin(size))
+            return false;
+        Sink = &sink;
+        return true;
+    }
+
+    /// @brief Finish writing the image, verifying it and making it live (e.g. bootable)
+    bool EndUpdate()
+    {
+        ESP32OTAPullSink *sink = Sink;
+        Sink = NULL;
+        return sink != NULL && sink->End();
+    }
+
+    /// @brief Abort any unfinished image, close the connection and free the TLS context
+    void Close()
+    {
+        if (Sink != NULL)
+        {
+            Sink->Abort();
+            Sink = NULL;
+        }
+        // A kept-alive HTTPClient would hold on to the client deleted below and stop() it when destroyed
+        http.setReuse(false);
+        http.end();
+        delete Secure;
+        Secure = NULL;
+        SecureError = NULL;
+        delete Plain;
+        Plain = NULL;
+    }
+
+private:
+    // Kept as WiFiClient so that builds without TLS don't pull in WiFiClientSecure
+    WiFiClient *Secure = NULL;
+    int (*SecureError)(WiFiClient *) = NULL;
+    WiFiClient *Plain = NULL;
+    ESP32OTAPullSink *Sink = NULL;
+};
+
+// Types shared by every BasicOTAPull configuration
+class ESP32OTAPullTypes
 {
 public:
     enum ActionType { DONT_DO_UPDATE, UPDATE_BUT_NO_BOOT, UPDATE_AND_BOOT };
 
+    // When to restart after UPDATE_AND_BOOT has installed an image (see SetRebootPolicy)
+    enum RebootPolicy { REBOOT_IMMEDIATE, REBOOT_DEFERRED, REBOOT_SCHEDULED, REBOOT_ON_IDLE };
+
     // Return codes from CheckForOTAUpdate
-    enum ErrorCode { UPDATE_AVAILABLE = -3, NO_UPDATE_PROFILE_FOUND = -2, NO_UPDATE_AVAILABLE = -1, UPDATE_OK = 0, HTTP_FAILED = 1, WRITE_ERROR = 2, JSON_PROBLEM = 3, OTA_UPDATE_FAIL = 4 };
+    enum ErrorCode { UPDATE_AVAILABLE = -3, NO_UPDATE_PROFILE_FOUND = -2, NO_UPDATE_AVAILABLE = -1, UPDATE_OK = 0, HTTP_FAILED = 1, WRITE_ERROR = 2, JSON_PROBLEM = 3, OTA_UPDATE_FAIL = 4, VERIFY_FAIL = 5, DECRYPT_FAIL = 6 };
+
+    // Lowest values seen during the last CheckForOTAUpdate (see EnableMemoryReport)
+    struct MemoryReport
+    {
+        uint32_t MinFreeHeap;           // bytes
+        uint32_t MinLargestFreeBlock;   // bytes
+        uint32_t MinStackHighWater;     // bytes of the calling task's stack never used
+    };
+
+    // The fields of one "Configurations" entry that are needed to install it
+    struct OTAConfiguration
+    {
+        char URL[256];
+        char Version[32];
+        char SHA256[65];                // "SHA256" (hex) if given, else empty
+        uint32_t Size;                  // "Size" in bytes if given, else 0
+        uint8_t Encryption;             // "Encryption": ESP32OTAPullDecryptor::NONE, AES256_CTR ("AES-256-CTR") or AES256_GCM ("AES-256-GCM")
+        uint8_t IV[16];                 // "IV" (hex): initial counter block (CTR) or nonce (GCM)
+        uint8_t IVLength;
+        uint8_t Tag[16];                // "Tag" (hex): GCM authentication tag
+        char Target[16];                // "Target": name of the sink the image is for (see AddSink), empty for this ESP32
+        char Custom[160];               // any other fields of the entry, as a JSON object (empty if too long)
+    };
+
+    // Everything known about the last CheckForOTAUpdate (see GetResult)
+    struct Result
+    {
+        ErrorCode Outcome;              // HTTP_FAILED whenever CheckForOTAUpdate returned an HTTP status
+        int HTTPStatus;                 // status of the last request made (manifest or image), 0 if none
+        int TransportError;             // negative HTTPClient error (HTTPC_ERROR_*) of the last request, 0 if none
+        int TLSError;                   // mbedTLS error of the last https request, 0 if none
+        bool Matched;                   // true if Configuration holds the entry that matched this device
+        OTAConfiguration Configuration;
+        uint32_t ManifestMillis;        // time to fetch, parse and match the manifest
+        uint32_t DownloadMillis;        // time to download and install the image
+        uint32_t DownloadBytes;
+        bool HashVerified;              // true if the image matched the SHA256 given in the JSON
+    };
+
+    // The last image installed with a verified SHA256, which ESP32OTAPullPeerServer can share with peers
+    struct SharedImage
+    {
+        char SHA256[65];
+        uint32_t Size;
+        char Partition[17];             // label of the app partition holding it
+    };
+
+    // Counters kept across reboots in NVS (see EnableStatistics)
+    struct Statistics
+    {
+        uint32_t Checks;                // calls to CheckForOTAUpdate
+        uint32_t NotModified;           // manifest requests answered 304 (unchanged since last check)
+        uint32_t ManifestsFetched;      // manifest requests answered 200
+        uint64_t BytesDownloaded;       // firmware image bytes
+        uint32_t DownloadMillis;        // time spent downloading firmware images
+        uint32_t UpdatesSucceeded;
+        uint32_t UpdatesFailed[8];      // indexed by ErrorCode; [0] counts unexpected HTTP status codes
+        uint32_t LastCheck;             // time() of the last check, or 0 if the clock was not set
+
+        /// @brief Average firmware download throughput in bytes per second
+        uint32_t AverageThroughput() const
+        {
+            return DownloadMillis == 0 ? 0 : (uint32_t)(BytesDownloaded * 1000 / DownloadMillis);
+        }
+    };
+
+    // The kind of network interface that carries the default route (see SetNetworkTuning)
+    enum NetworkType { NETWORK_WIFI, NETWORK_ETHERNET, NETWORK_CELLULAR, NETWORK_TYPE_COUNT };
+
+    struct NetworkTuning
+    {
+        uint32_t ConnectTimeoutMs;
+        uint32_t ReadTimeoutMs;         // longest wait for more data from the server
+        uint16_t BufferSize;            // bytes read from the connection at a time
+    };
+
+    // This device's base MAC address from eFuse, read once
+    struct DeviceIdentity
+    {
+        uint8_t MAC[6];
+        char Text[18];                  // "24:63:28:AD:FF:04", as matched against "Device"
+        char Hex[13];                   // "246328ADFF04"
+    };
+
+    /// @brief This device's identity, read and formatted on first use
+    static const DeviceIdentity &Identity()
+    {
+        static const DeviceIdentity identity = ReadIdentity();
+        return identity;
+    }
+
+    /// @brief This device's base MAC address from eFuse, formatted like "24:63:28:AD:FF:04".  It is the
+    ///        address matched against "Device", and the same as the WiFi station MAC, but does not need WiFi.
+    static String DeviceMAC()
+    {
+        return Identity().Text;
+    }
+
+    /// @brief The interface that currently carries the default route: WiFi, Ethernet or PPP (cellular)
+    static NetworkType ActiveNetwork()
+    {
+        esp_netif_t *netif = esp_netif_get_default_netif();
+        const char *key = netif == NULL ? NULL : esp_netif_get_ifkey(netif);
+        if (key != NULL && strncmp(key, "ETH", 3) == 0)
+            return NETWORK_ETHERNET;
+        if (key != NULL && strncmp(key, "PPP", 3) == 0)
+            return NETWORK_CELLULAR;
+        return NETWORK_WIFI;
+    }
 
+    /// @brief The IPv4 address of the interface that carries the default route, whichever it is
+    static IPAddress LocalIP()
+    {
+        esp_netif_t *netif = esp_netif_get_default_netif();
+        esp_netif_ip_info_t info = {};
+        if (netif == NULL || esp_netif_get_ip_info(netif, &info) != ESP_OK)
+            return IPAddress();
+        return IPAddress(info.ip.addr);
+    }
+
+private:
+    static DeviceIdentity ReadIdentity()
+    {
+        DeviceIdentity identity = {};
+        const uint8_t *mac = identity.MAC;
+        esp_efuse_mac_get_default(identity.MAC);
+        snprintf(identity.Text, sizeof(identity.Text), "%02X:%02X:%02X:%02X:%02X:%02X", mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+        snprintf(identity.Hex, sizeof(identity.Hex), "%02X%02X%02X%02X%02X%02X", mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+        return identity;
+    }
+};
+
+// The library's core; see ESP32OTAPullPolicies.h.  Most code uses the full ESP32OTAPull typedef below.
+template <class Transport = ESP32OTAPullDefaultTransport, class Sink = ESP32OTAPullDefaultSink,
+          class Verifier = ESP32OTAPullSHA256, class Codec = ESP32OTAPullDecryptor, class Logger = ESP32OTAPullSerialLog,
+          class Features = ESP32OTAPullAllFeatures>
+class BasicOTAPull : public ESP32OTAPullTypes
+{
 private:
+    friend class ::ESP32OTAPullMulticastReceiver;
+    friend class ::ESP32OTAPullGateway;
+    friend class ::ESP32OTAPullNotifier;
+
     void (*Callback)(int offset, int totallength) = NULL;
     ActionType Action = UPDATE_AND_BOOT;
-    String Board      = ARDUINO_BOARD;
+    String Board      = ESP32OTAPULL_BOARD;
     String Device     = "";
     String Config     = "";
     String CVersion   = "";
     bool DowngradesAllowed = false;
     bool SerialDebug = false;
-    
+
+    bool Debugging() const
+    {
+        return Logger::Enabled && SerialDebug;
+    }
+    bool MemoryReporting = false;
+    MemoryReport Memory = { 0, 0, 0 };
+    Result LastResult = {};
+    bool DryRun = false;
+    Verifier ImageHash;
+    Codec Decryptor;
+    bool PeerDownload = false;
+    NetworkTuning Tunings[NETWORK_TYPE_COUNT] =
+    {
+        { 5000, 5000, 1264 },           // WiFi: the HTTPClient defaults
+        { 5000, 5000, 1264 },           // Ethernet
+        { 20000, 30000, 4080 },         // cellular: long round trips, so fewer, larger reads
+    };
+
+    const NetworkTuning &Tuning()
+    {
+        return Tunings[ActiveNetwork()];
+    }
+    uint32_t DNSCacheTTL = 0;           // seconds; 0 if EnableDNSCache has not been called
+
+    // Where images go: this ESP32's OTA partition, or a named sink for entries with a "Target"
+    struct NamedSink
+    {
+        char Name[16];
+        ESP32OTAPullSink *Destination;
+    };
+    static constexpr int MaxSinks = 4;
+    NamedSink Sinks[MaxSinks];
+    int SinkCount = 0;
+    String Target = "";
+    Sink FirmwareSink;
+    ESP32OTAPullSink *InstallSink = &FirmwareSink;
+    uint32_t InstallSize = 0;
+
+    // Local mirror found via mDNS, remembered (found or not) for MirrorTTL ms
+    bool MirrorEnabled = false;
+    bool MirrorFound = false;
+    uint32_t MirrorTTL = 600000;
+    uint32_t MirrorChecked = 0;
+    bool MirrorCheckedOnce = false;
+    IPAddress MirrorIP;
+    uint16_t MirrorPort = 0;
+    uint8_t ParallelConnections = 1;
+    uint32_t SegmentSize = 16384;
+    uint8_t DecryptionKey[32];
+    bool HasDecryptionKey = false;
+
+    // Statistics are batched in RAM and committed every StatsCommitInterval checks
+    static constexpr uint32_t StatsVersion = 1;
+    bool StatsEnabled = false;
+    bool StatsLoaded = false;
+    uint32_t StatsCommitInterval = 10;
+    uint32_t StatsDirty = 0;
+    Statistics Stats = {};
+
+    // Outcome reports: queued in NVS so that they survive the reboot into the new image
+    struct OutcomeRecord
+    {
+        char From[24];
+        char To[24];
+        int32_t Result;
+        uint32_t Millis;
+        uint32_t Bytes;
+    };
+    static constexpr int MaxOutcomeRecords = 4;
+    struct OutcomeQueue
+    {
+        uint32_t Count;
+        OutcomeRecord Records[MaxOutcomeRecords];
+    };
+    bool ReportsEnabled = false;
+    String ReportURL = "";
+    String RunningVersion = "";
+
+    // Reboot policy
+    RebootPolicy WhenToReboot = REBOOT_IMMEDIATE;
+    uint32_t RebootDelay = 0;
+    void (*PreRebootCallback)() = NULL;
+    void (*RebootRequestCallback)() = NULL;
+    bool RebootPending = false;
+    esp_timer_handle_t RebootTimer = NULL;
+
+    // The esp_timer task must not block, and the pre-reboot callback and the NVS commit
+    // may, so the timer only hands the reboot over to a task of its own
+    static void RebootTimeout(void *arg)
+    {
+        if (xTaskCreate(RebootTask, "ota_reboot", 4096, arg, tskIDLE_PRIORITY + 1, NULL) != pdPASS)
+            static_cast<BasicOTAPull *>(arg)->Reboot();
+    }
+
+    // At tskIDLE_PRIORITY this only gets the CPU when nothing else wants it
+    static void RebootTask(void *arg)
+    {
+        static_cast<BasicOTAPull *>(arg)->Reboot();
+        vTaskDelete(NULL);
+    }
+
+    int RestartPerPolicy()
+    {
+        RebootPending = true;
+        switch (Features::RebootPolicies ? WhenToReboot : REBOOT_IMMEDIATE)
+        {
+            case REBOOT_DEFERRED:
+                if (RebootRequestCallback != NULL)
+                    RebootRequestCallback();
+                break;
+            case REBOOT_SCHEDULED:
+            {
+                esp_timer_create_args_t args = {};
+                args.callback = RebootTimeout;
+                args.arg = this;
+                args.name = "ota_reboot";
+                if (RebootTimer == NULL && esp_timer_create(&args, &RebootTimer) != ESP_OK)
+                {
+                    RebootTimer = NULL;
+                    Reboot();
+                    break;
+                }
+                esp_timer_stop(RebootTimer);
+                esp_timer_start_once(RebootTimer, (uint64_t)RebootDelay * 1000);
+                break;
+            }
+            case REBOOT_ON_IDLE:
+                if (xTaskCreate(RebootTask, "ota_reboot", 4096, this, tskIDLE_PRIORITY, NULL) != pdPASS)
+                    Reboot();
+                break;
+            default:
+                Reboot();
+        }
+        return UPDATE_OK;
+    }
+
+    // Rollback: a freshly installed image must be confirmed before RollbackTimer fires.
+    // Checks only confirm once EnableRollback() has opted in, so applications that
+    // manage verification themselves are left alone.
+    bool ConfirmOnCheck = false;
+    bool RollingBack = false;
+    esp_timer_handle_t RollbackTimer = NULL;
+
+    // As with RebootTimeout, the timer task only hands over: Reboot() does the rolling back
+    static void RollbackTimeout(void *arg)
+    {
+        static_cast<BasicOTAPull *>(arg)->RollingBack = true;
+        if (xTaskCreate(RebootTask, "ota_rollback", 4096, arg, tskIDLE_PRIORITY + 1, NULL) != pdPASS)
+            static_cast<BasicOTAPull *>(arg)->Reboot();
+    }
+
+    // A version that was rolled back, by the timer or by the bootloader, is not installed again.
+    // Each installed image is recorded in NVS with its partition; once that partition is found
+    // invalid, its version becomes the rejected one.
+    struct InstalledImage
+    {
+        char Version[32];
+        char Partition[17];             // label of the app partition it went into
+    };
+    bool RejectedLoaded = false;
+    char RejectedVersion[32] = "";
+
+    void RememberInstalled()
+    {
+        const esp_partition_t *partition = esp_ota_get_boot_partition();
+        nvs_handle_t handle;
+        if (CVersion.isEmpty() || partition == NULL || nvs_open("esp32otapull", NVS_READWRITE, &handle) != ESP_OK)
+            return;
+        InstalledImage image = {};
+        strlcpy(image.Version, CVersion.c_str(), sizeof(image.Version));
+        strlcpy(image.Partition, partition->label, sizeof(image.Partition));
+        nvs_set_blob(handle, "installed", &image, sizeof(image));
+        nvs_commit(handle);
+        nvs_close(handle);
+    }
+
+    // Once per boot: settle the last installed image as rolled back (its partition is invalid) or
+    // kept (it is running and confirmed); until then it is still to be booted or on probation
+    void LoadRejectedVersion()
+    {
+        if (RejectedLoaded)
+            return;
+        RejectedLoaded = true;
+        nvs_handle_t handle;
+        if (nvs_open("esp32otapull", NVS_READWRITE, &handle) != ESP_OK)
+            return;
+        size_t length = sizeof(RejectedVersion);
+        if (nvs_get_str(handle, "rejected", RejectedVersion, &length) != ESP_OK)
+            RejectedVersion[0] = '\0';
+
+        InstalledImage image;
+        length = sizeof(image);
+        if (nvs_get_blob(handle, "installed", &image, &length) == ESP_OK && length == sizeof(image))
+        {
+            const esp_partition_t *invalid = esp_ota_get_last_invalid_partition();
+            const esp_partition_t *running = esp_ota_get_running_partition();
+            if (invalid != NULL && strcmp(invalid->label, image.Partition) == 0)
+            {
+                strlcpy(RejectedVersion, image.Version, sizeof(RejectedVersion));
+                nvs_set_str(handle, "rejected", RejectedVersion);
+                nvs_erase_key(handle, "installed");
+                if (Debugging())
+                    Serial.printf("Rollback: version %s was rolled back and will not be installed again\n", RejectedVersion);
+            }
+            else if (running != NULL && strcmp(running->label, image.Partition) == 0 && !IsPendingVerify())
+                nvs_erase_key(handle, "installed");
+            nvs_commit(handle);
+        }
+        nvs_close(handle);
+    }
+
+    // The answer a 304 for ManifestETag stands for
+    String ManifestETag = "";
+    String ETagKey = "";
+    int ETagResult = NO_UPDATE_AVAILABLE;
+    bool ETagMatched = false;
+    OTAConfiguration ETagConfiguration;
+
     // HTTPS/SSL configuration
     const char* RootCA = NULL;
     const char* ClientCert = NULL;
@@ -57,121 +543,892 @@ private:
     bool InsecureConnection = false;
     bool UseHTTPS = false;
 
-    void ConfigureHTTPClient(HTTPClient& http, const char* url)
+    void ResetMemoryReport()
+    {
+        Memory.MinFreeHeap = Memory.MinLargestFreeBlock = Memory.MinStackHighWater = UINT32_MAX;
+        SampleMemory();
+    }
+
+    void SampleMemory()
     {
-        UseHTTPS = strncmp(url, "https://", 8) == 0;
+        if (!MemoryReporting)
+            return;
+        uint32_t freeHeap = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+        uint32_t largest  = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+        uint32_t stack    = uxTaskGetStackHighWaterMark(NULL); // ESP-IDF reports this in bytes
+        Memory.MinFreeHeap         = min(Memory.MinFreeHeap, freeHeap);
+        Memory.MinLargestFreeBlock = min(Memory.MinLargestFreeBlock, largest);
+        Memory.MinStackHighWater   = min(Memory.MinStackHighWater, stack);
+    }
+
+    void LoadStatistics()
+    {
+        if (StatsLoaded)
+            return;
+        StatsLoaded = true;
+        memset(&Stats, 0, sizeof(Stats));
+
+        nvs_handle_t handle;
+        if (nvs_open("esp32otapull", NVS_READONLY, &handle) != ESP_OK)
+            return;
+        struct { uint32_t Version; Statistics Stats; } blob;
+        size_t length = sizeof(blob);
+        if (nvs_get_blob(handle, "stats", &blob, &length) == ESP_OK && length == sizeof(blob) && blob.Version == StatsVersion)
+            Stats = blob.Stats;
+        nvs_close(handle);
+    }
+
+    void StatisticsChanged(bool commitNow = false)
+    {
+        if (++StatsDirty >= StatsCommitInterval || commitNow)
+            FlushStatistics();
+    }
+
+    void RecordCheck(int httpResponseCode)
+    {
+        if (!Features::Statistics || !StatsEnabled)
+            return;
+        LoadStatistics();
+        ++Stats.Checks;
+        if (httpResponseCode == 304)
+            ++Stats.NotModified;
+        else if (httpResponseCode == 200)
+            ++Stats.ManifestsFetched;
+        time_t now = time(NULL);
+        Stats.LastCheck = now > 1600000000 ? (uint32_t)now : 0;
+        StatisticsChanged();
+    }
+
+    void RecordUpdate(int result, uint32_t bytes, uint32_t millis)
+    {
+        if (!Features::Statistics || !StatsEnabled)
+            return;
+        LoadStatistics();
+        Stats.BytesDownloaded += bytes;
+        Stats.DownloadMillis += millis;
+        if (result == UPDATE_OK)
+            ++Stats.UpdatesSucceeded;
+        else
+            ++Stats.UpdatesFailed[result > 0 && result < 8 ? result : 0];
+        StatisticsChanged(true);
+    }
+
+    bool LoadOutcomes(OutcomeQueue &queue)
+    {
+        queue.Count = 0;
+        nvs_handle_t handle;
+        if (nvs_open("esp32otapull", NVS_READONLY, &handle) != ESP_OK)
+            return false;
+        size_t length = sizeof(queue);
+        if (nvs_get_blob(handle, "reports", &queue, &length) != ESP_OK || length != sizeof(queue) || queue.Count > MaxOutcomeRecords)
+            queue.Count = 0;
+        nvs_close(handle);
+        return queue.Count > 0;
+    }
+
+    void StoreOutcomes(const OutcomeQueue &queue)
+    {
+        nvs_handle_t handle;
+        if (nvs_open("esp32otapull", NVS_READWRITE, &handle) != ESP_OK)
+            return;
+        if (queue.Count == 0)
+            nvs_erase_key(handle, "reports");
+        else
+            nvs_set_blob(handle, "reports", &queue, sizeof(queue));
+        nvs_commit(handle);
+        nvs_close(handle);
+    }
+
+    void QueueOutcome(int result, uint32_t bytes, uint32_t millis)
+    {
+        if (!Features::Statistics || !ReportsEnabled)
+            return;
+        OutcomeQueue queue;
+        LoadOutcomes(queue);
+        if (queue.Count == MaxOutcomeRecords) // drop the oldest
+        {
+            memmove(&queue.Records[0], &queue.Records[1], sizeof(OutcomeRecord) * (MaxOutcomeRecords - 1));
+            --queue.Count;
+        }
+        OutcomeRecord &r = queue.Records[queue.Count++];
+        strlcpy(r.From, RunningVersion.c_str(), sizeof(r.From));
+        strlcpy(r.To, CVersion.c_str(), sizeof(r.To));
+        r.Result = result;
+        r.Millis = millis;
+        r.Bytes = bytes;
+        StoreOutcomes(queue);
+    }
+
+    // Compact JSON for the pending records; "Running" tells whether the device now runs the version it installed
+    String SerializeOutcomes(const OutcomeQueue &queue)
+    {
+        JsonDocument doc;
+        doc["Board"] = Board.isEmpty() ? ESP32OTAPULL_BOARD : Board.c_str();
+        doc["Device"] = Device.isEmpty() ? Identity().Text : Device.c_str();
+        JsonArray records = doc["Outcomes"].to<JsonArray>();
+        for (uint32_t i = 0; i < queue.Count; ++i)
+        {
+            const OutcomeRecord &r = queue.Records[i];
+            JsonObject o = records.add<JsonObject>();
+            o["From"] = r.From;
+            o["To"] = r.To;
+            o["Result"] = r.Result;
+            o["Millis"] = r.Millis;
+            o["Bytes"] = r.Bytes;
+            o["Running"] = r.Result == UPDATE_OK && RunningVersion == r.To;
+        }
+        std::string json;
+        serializeJson(doc, json);
+        return json.c_str();
+    }
+
+    // POST the pending records to ReportURL after a successful check, in one request
+    void SendOutcomes(const OutcomeQueue &queue)
+    {
+        ESP32OTAPullSession session;
+        ConfigureHTTPClient(session, ReportURL.c_str());
+        session.http.addHeader("Content-Type", "application/json");
+        int httpResponseCode = session.http.POST(SerializeOutcomes(queue));
+        session.Close();
+        if (Debugging()) {
+            Serial.print("Outcome report returned: ");
+            Serial.println(httpResponseCode);
+        }
+        if (httpResponseCode >= 200 && httpResponseCode < 300)
+            StoreOutcomes(OutcomeQueue {});
+    }
+
+    void ResetResult()
+    {
+        LastResult.Outcome = NO_UPDATE_PROFILE_FOUND;
+        LastResult.HTTPStatus = LastResult.TransportError = LastResult.TLSError = 0;
+        LastResult.Matched = false;
+        memset(&LastResult.Configuration, 0, sizeof(LastResult.Configuration));
+        LastResult.ManifestMillis = LastResult.DownloadMillis = LastResult.DownloadBytes = 0;
+        LastResult.HashVerified = false;
+    }
+
+    void RecordResponse(ESP32OTAPullSession &session, int httpResponseCode)
+    {
+        LastResult.HTTPStatus = httpResponseCode > 0 ? httpResponseCode : 0;
+        LastResult.TransportError = httpResponseCode < 0 ? httpResponseCode : 0;
+        LastResult.TLSError = session.TLSError();
+    }
+
+    int Finish(int ret)
+    {
+        LastResult.Outcome = ret >= 100 ? HTTP_FAILED : (ErrorCode)ret;
+        return ret;
+    }
+
+    static void ReadConfiguration(JsonVariant config, OTAConfiguration &out)
+    {
+        strlcpy(out.URL, config["URL"].isNull() ? "" : (const char *)config["URL"], sizeof(out.URL));
+        strlcpy(out.Version, config["Version"].isNull() ? "" : (const char *)config["Version"], sizeof(out.Version));
+        strlcpy(out.SHA256, config["SHA256"].isNull() ? "" : (const char *)config["SHA256"], sizeof(out.SHA256));
+        out.Size = config["Size"].as<uint32_t>();
+
+        String encryption = config["Encryption"].isNull() ? "" : (const char *)config["Encryption"];
+        out.Encryption = encryption == "AES-256-CTR" ? ESP32OTAPullDecryptor::AES256_CTR :
+                         encryption == "AES-256-GCM" ? ESP32OTAPullDecryptor::AES256_GCM : ESP32OTAPullDecryptor::NONE;
+        out.IVLength = ESP32OTAPullHexToBytes(config["IV"].isNull() ? "" : (const char *)config["IV"], out.IV, sizeof(out.IV));
+        ESP32OTAPullHexToBytes(config["Tag"].isNull() ? "" : (const char *)config["Tag"], out.Tag, sizeof(out.Tag));
+        strlcpy(out.Target, config["Target"].isNull() ? "" : (const char *)config["Target"], sizeof(out.Target));
+
+        static const char *const known[] = { "Board", "Device", "Config", "Version", "URL", "SHA256", "Size", "Encryption", "IV", "Tag", "Target" };
+        JsonDocument custom;
+        custom.to<JsonObject>();
+        for (JsonPair field : config.as<JsonObject>())
+        {
+            bool isKnown = false;
+            for (const char *name : known)
+                isKnown = isKnown || strcmp(field.key().c_str(), name) == 0;
+            if (!isKnown)
+                custom[field.key()] = field.value();
+        }
+        out.Custom[0] = '\0';
+        if (measureJson(custom) < sizeof(out.Custom))
+            serializeJson(custom, out.Custom, sizeof(out.Custom));
+    }
+
+    void ConfigureHTTPClient(ESP32OTAPullSession& session, const char* url)
+    {
+        HTTPClient &http = session.http;
+        UseHTTPS = Transport::Secure && strncmp(url, "https://", 8) == 0;
+
+        // Without a TLS transport the secure branch is discarded, so WiFiClientSecure is never compiled in
+        if constexpr (Transport::Secure)
+        {
+            if (UseHTTPS)
+                BeginSecure(session, url);
+            else
+                BeginPlain(session, url);
+        }
+        else
+            BeginPlain(session, url);
         
-        if (UseHTTPS)
+        http.useHTTP10(true);
+        const NetworkTuning &tuning = Tuning();
+        http.setConnectTimeout(tuning.ConnectTimeoutMs);
+        http.setTimeout(min(tuning.ReadTimeoutMs, (uint32_t)UINT16_MAX));
+        SampleMemory();
+    }
+
+    void BeginPlain(ESP32OTAPullSession &session, const char *url)
+    {
+        ConnectCached(session, url);
+        session.http.begin(session.PlainClient(), url);
+    }
+
+    void BeginSecure(ESP32OTAPullSession &session, const char *url)
+    {
+        WiFiClientSecure* secureClient = &session.SecureClient();
+        
+        if (InsecureConnection)
+        {
+            secureClient->setInsecure();
+            if (Debugging())
+                Serial.println("HTTPS: Using insecure connection (no certificate verification)");
+        }
+        else if (RootCA != NULL)
+        {
+            secureClient->setCACert(RootCA);
+            if (Debugging())
+                Serial.println("HTTPS: Using provided root CA certificate");
+        }
+        else
+        {
+            // Use built-in root certificates if available
+            secureClient->setInsecure(); // Fallback to insecure if no CA provided
+            if (Debugging())
+                Serial.println("HTTPS: No root CA provided, falling back to insecure connection");
+        }
+        
+        // Set client certificate if provided
+        if (ClientCert != NULL && ClientKey != NULL)
+        {
+            secureClient->setCertificate(ClientCert);
+            secureClient->setPrivateKey(ClientKey);
+            if (Debugging())
+                Serial.println("HTTPS: Using client certificate authentication");
+        }
+
+        ConnectCached(session, url);
+        session.http.begin(*secureClient, url);
+    }
+
+    // With EnableDNSCache, open the connection to the cached address of the URL's host before HTTPClient
+    // would look the name up again; HTTPClient then uses the open connection.  The name is still used for
+    // SNI, certificate checks and the Host header.  If the address no longer answers, the entry is dropped
+    // and HTTPClient connects by name as usual.
+    void ConnectCached(ESP32OTAPullSession &session, const char *url)
+    {
+#if ESP32OTAPULL_ARDUINO
+        char host[64];
+        uint16_t port;
+        IPAddress address;
+        if (!Features::DNSCache || DNSCacheTTL == 0 || !ESP32OTAPullDNSCache::ParseURL(url, host, sizeof(host), port))
+            return;
+        ESP32OTAPULL_TRACE_BEGIN(OTA_TRACE_DNS);
+        bool resolved = ESP32OTAPullDNSCache::Resolve(host, DNSCacheTTL, address);
+        ESP32OTAPULL_TRACE_END(OTA_TRACE_DNS);
+        if (!resolved)
+            return;
+
+        bool connected = false;
+        bool secure = false;
+        if constexpr (Transport::Secure)
+        {
+            if ((secure = UseHTTPS))
+            {
+                ESP32OTAPULL_TRACE_BEGIN(OTA_TRACE_TLS);
+                connected = session.SecureClient().connect(address, port, host, InsecureConnection ? NULL : RootCA, ClientCert, ClientKey) == 1;
+                ESP32OTAPULL_TRACE_END(OTA_TRACE_TLS);
+            }
+        }
+        if (!secure)
+        {
+            ESP32OTAPULL_TRACE_BEGIN(OTA_TRACE_CONNECT);
+            connected = session.PlainClient().connect(address, port, Tuning().ConnectTimeoutMs) == 1;
+            ESP32OTAPULL_TRACE_END(OTA_TRACE_CONNECT);
+        }
+        if (!connected)
+            ESP32OTAPullDNSCache::Forget(host);
+        if (Debugging())
+            Serial.printf("DNS cache: %s is %s, %s\n", host, address.toString().c_str(), connected ? "connected" : "not answering");
+#else
+        (void)session;
+        (void)url; // esp_http_client resolves names itself
+#endif
+    }
+
+    // Every downloaded chunk goes through here on its way to flash (or nowhere, in a dry run)
+    // (data must have 15 bytes to spare for the decryptor)
+    bool WriteChunk(uint8_t *data, size_t length)
+    {
+        ImageHash.Add(data, length); // the SHA256 covers the image as served, i.e. before decryption
+        if (!Decryptor.Process(data, length))
+            return false;
+        if (DryRun || length == 0)
+            return true;
+        return InstallSink == &FirmwareSink ? FirmwareSink.Write(data, length) : InstallSink->Write(data, length);
+    }
+
+    // Start writing to the sink (if not a dry run) once the first response is known to be good
+    bool BeginInstall(ESP32OTAPullSession &session)
+    {
+        ESP32OTAPULL_TRACE_BEGIN(OTA_TRACE_ERASE);
+        bool begun = DryRun || session.BeginUpdate(*InstallSink, InstallSize);
+        ESP32OTAPULL_TRACE_END(OTA_TRACE_ERASE);
+        SampleMemory();
+        return begun;
+    }
+
+    // Fetch the image over a single connection
+    int FetchStream(const OTAConfiguration &config, ESP32OTAPullSession &session)
+    {
+        HTTPClient &http = session.http;
+        ConfigureHTTPClient(session, config.URL);
+
+        // Send HTTP GET request
+        int httpResponseCode = session.GET();
+        RecordResponse(session, httpResponseCode);
+        SampleMemory();
+
+        if (httpResponseCode != 200)
+            return httpResponseCode > 0 ? httpResponseCode : HTTP_FAILED;
+
+        int totalLength = http.getSize();
+
+        // this is required to start firmware update process
+        if (!BeginInstall(session))
+            return OTA_UPDATE_FAIL;
+
+        // create buffer for read
+        // 16 bytes to spare for the decryptor
+        size_t buffSize = Tuning().BufferSize + 16;
+        std::unique_ptr<uint8_t[]> buffer(new (std::nothrow) uint8_t[buffSize]);
+        uint8_t *buff = buffer.get();
+        if (buff == NULL)
+            return WRITE_ERROR;
+
+        // get tcp stream
+        WiFiClient* stream = http.getStreamPtr();
+
+        // read all data from server
+        ESP32OTAPULL_TRACE_BEGIN(OTA_TRACE_WRITE);
+        int offset = 0;
+        uint32_t lastData = millis();
+        while (http.connected() && offset < totalLength)
+        {
+            size_t sizeAvail = stream->available();
+            if (sizeAvail > 0)
+            {
+                size_t bytes_to_read = min(sizeAvail, buffSize - 16);
+                size_t bytes_read = stream->readBytes(buff, bytes_to_read);
+                if (!WriteChunk(buff, bytes_read))
+                    break;
+                offset += bytes_read;
+                lastData = millis();
+                LastResult.DownloadBytes = offset;
+                SampleMemory();
+                if (Callback != NULL)
+                    Callback(offset, totalLength);
+            }
+            else if (millis() - lastData > Tuning().ReadTimeoutMs)
+            {
+                // The connection is open but the server has stopped sending
+                LastResult.TransportError = HTTPC_ERROR_READ_TIMEOUT;
+                break;
+            }
+        }
+        ESP32OTAPULL_TRACE_END(OTA_TRACE_WRITE);
+
+        return offset == totalLength ? UPDATE_OK : WRITE_ERROR;
+    }
+
+    // State of a FetchNative() download, shared with its event handler
+    struct NativeDownload
+    {
+        BasicOTAPull *Self;
+        ESP32OTAPullSession *Session;
+        bool Begun;
+        bool Failed;
+        bool Copy;
+        uint32_t Offset;
+        int Total;
+        uint8_t Phase;                  // trace phase in progress
+
+        void NextPhase(uint8_t phase)
+        {
+            ESP32OTAPULL_TRACE_END(Phase);
+            ESP32OTAPULL_TRACE_BEGIN(phase);
+            Phase = phase;
+        }
+    };
+
+    // perform() reports each step, so its connect, request/headers and body are traced as separate phases
+    static esp_err_t NativeEvent(esp_http_client_event_t *event)
+    {
+        NativeDownload *state = static_cast<NativeDownload *>(event->user_data);
+        if (event->event_id == HTTP_EVENT_ON_CONNECTED && state->Phase == OTA_TRACE_CONNECT)
+            state->NextPhase(OTA_TRACE_HEADERS);
+        if (event->event_id == HTTP_EVENT_ON_DATA && state->Phase != OTA_TRACE_WRITE)
+            state->NextPhase(OTA_TRACE_WRITE);
+        if (event->event_id == HTTP_EVENT_ON_DATA && !state->Failed)
+            state->Failed = !state->Self->NativeData(*state, event->client, (uint8_t *)event->data, event->data_len);
+        return ESP_OK;
+    }
+
+    // Data arrives straight from esp_http_client's receive buffer; only encrypted images are copied,
+    // because they are decrypted in place and need room to spare
+    bool NativeData(NativeDownload &state, esp_http_client_handle_t client, uint8_t *data, int length)
+    {
+        if (esp_http_client_get_status_code(client) != 200)
+            return true; // the status is reported once perform() returns
+        if (!state.Begun)
+        {
+            state.Total = (int)esp_http_client_get_content_length(client);
+            if (!BeginInstall(*state.Session))
+                return false;
+            state.Begun = true;
+        }
+
+        uint8_t buff[1280];
+        while (length > 0)
+        {
+            int n = length;
+            uint8_t *chunk = data;
+            if (state.Copy)
+            {
+                n = min(length, (int)sizeof(buff) - 16);
+                memcpy(buff, data, n);
+                chunk = buff;
+            }
+            if (!WriteChunk(chunk, n))
+                return false;
+            data += n;
+            length -= n;
+            state.Offset += n;
+            LastResult.DownloadBytes = state.Offset;
+            if (Callback != NULL)
+                Callback(state.Offset, state.Total);
+        }
+        SampleMemory();
+        return true;
+    }
+
+    // An esp_http_client error on the HTTPClient scale that Result::TransportError uses
+    static int TransportErrorOf(esp_err_t err)
+    {
+        switch (err)
+        {
+            case ESP_OK:
+                return 0;
+            case ESP_ERR_HTTP_CONNECT:
+                return HTTPC_ERROR_CONNECTION_REFUSED;
+            case ESP_ERR_HTTP_WRITE_DATA:
+                return HTTPC_ERROR_SEND_PAYLOAD_FAILED;
+            case ESP_ERR_HTTP_FETCH_HEADER:
+            case ESP_ERR_HTTP_EAGAIN:
+            case ESP_ERR_TIMEOUT:
+                return HTTPC_ERROR_READ_TIMEOUT;
+            case ESP_ERR_NO_MEM:
+                return HTTPC_ERROR_TOO_LESS_RAM;
+            default:
+                return HTTPC_ERROR_CONNECTION_LOST;
+        }
+    }
+
+    // Fetch the image over a single connection with esp_http_client (see ESP32OTAPullIDFTransport)
+    int FetchNative(const OTAConfiguration &config, ESP32OTAPullSession &session)
+    {
+        NativeDownload state = { this, &session, false, false, config.Encryption != ESP32OTAPullDecryptor::NONE, 0, -1, OTA_TRACE_CONNECT };
+        esp_http_client_config_t cfg = {};
+        cfg.url = config.URL;
+        cfg.event_handler = NativeEvent;
+        cfg.user_data = &state;
+        const NetworkTuning &tuning = Tuning();
+        cfg.buffer_size = max((int)tuning.BufferSize, 4096);
+        cfg.timeout_ms = tuning.ReadTimeoutMs;
+        if (RootCA != NULL && !InsecureConnection)
+            cfg.cert_pem = RootCA;
+#if CONFIG_MBEDTLS_CERTIFICATE_BUNDLE && !CONFIG_ESP_TLS_SKIP_SERVER_CERT_VERIFY
+        else
+            cfg.crt_bundle_attach = esp_crt_bundle_attach; // this build cannot skip verification, so use the bundle
+#endif
+        if (ClientCert != NULL && ClientKey != NULL)
+        {
+            cfg.client_cert_pem = ClientCert;
+            cfg.client_key_pem = ClientKey;
+        }
+
+        esp_http_client_handle_t client = esp_http_client_init(&cfg);
+        if (client == NULL)
+            return HTTP_FAILED;
+        ESP32OTAPULL_TRACE_BEGIN(OTA_TRACE_CONNECT);
+        esp_err_t err = esp_http_client_perform(client);
+        ESP32OTAPULL_TRACE_END(state.Phase);
+        int status = esp_http_client_get_status_code(client);
+        esp_http_client_cleanup(client);
+        SampleMemory();
+
+        LastResult.HTTPStatus = err == ESP_OK ? status : 0;
+        LastResult.TransportError = TransportErrorOf(err);
+        if (err != ESP_OK)
+            return HTTP_FAILED;
+        if (status != 200)
+            return status > 0 ? status : HTTP_FAILED;
+        if (state.Failed)
+            return state.Begun ? WRITE_ERROR : OTA_UPDATE_FAIL;
+        if (!state.Begun)
+            return WRITE_ERROR; // empty body
+        return state.Total < 0 || (int)state.Offset == state.Total ? UPDATE_OK : WRITE_ERROR;
+    }
+
+    // GET bytes [start, start + length) of url.  A session that has served a segment before asks again over
+    // the same HTTP/1.1 keep-alive connection, so only its first segment pays for the TCP and TLS handshakes;
+    // if the server has closed that connection, a new one is opened.
+    int RequestRange(ESP32OTAPullSession &session, const char *url, uint32_t start, uint32_t length, bool reuse)
+    {
+        char range[32];
+        snprintf(range, sizeof(range), "bytes=%u-%u", (unsigned)start, (unsigned)(start + length - 1));
+        HTTPClient &http = session.http;
+        int httpResponseCode = 0;
+        for (int attempt = reuse ? 0 : 1; attempt < 2 && httpResponseCode <= 0; ++attempt)
         {
-            WiFiClientSecure* secureClient = new WiFiClientSecure();
-            
-            if (InsecureConnection)
+            if (attempt == 0)
             {
-                secureClient->setInsecure();
-                if (SerialDebug)
-                    Serial.println("HTTPS: Using insecure connection (no certificate verification)");
-            }
-            else if (RootCA != NULL)
-            {
-                secureClient->setCACert(RootCA);
-                if (SerialDebug)
-                    Serial.println("HTTPS: Using provided root CA certificate");
+                // The same connection as last time (see ConfigureHTTPClient), so that HTTPClient reuses it
+                bool secure = false;
+                if constexpr (Transport::Secure)
+                    if ((secure = strncmp(url, "https://", 8) == 0))
+                        http.begin(session.SecureClient(), url);
+                if (!secure)
+                    http.begin(session.PlainClient(), url);
             }
             else
             {
-                // Use built-in root certificates if available
-                secureClient->setInsecure(); // Fallback to insecure if no CA provided
-                if (SerialDebug)
-                    Serial.println("HTTPS: No root CA provided, falling back to insecure connection");
-            }
-            
-            // Set client certificate if provided
-            if (ClientCert != NULL && ClientKey != NULL)
-            {
-                secureClient->setCertificate(ClientCert);
-                secureClient->setPrivateKey(ClientKey);
-                if (SerialDebug)
-                    Serial.println("HTTPS: Using client certificate authentication");
+                session.Close();
+                ConfigureHTTPClient(session, url);
+                http.useHTTP10(false);
+                http.setReuse(true);
             }
-            
-            http.begin(*secureClient, url);
-            
-            // Note: WiFiClientSecure object will be managed by HTTPClient
-            // and cleaned up when http.end() is called
+            http.addHeader("Range", range);
+            httpResponseCode = session.GET();
         }
-        else
-        {
-            http.begin(url);
-        }
-        
-        http.useHTTP10(true);
+        RecordResponse(session, httpResponseCode);
+        return httpResponseCode;
     }
 
-    int DoOTAUpdate(const char* URL, ActionType Action)
+    // Fetch the image as consecutive Range requests spread over several connections.  Each connection
+    // buffers one segment; the one holding the next segment in order is drained into WriteChunk, so the
+    // image is still written strictly in order and memory stays at ParallelConnections * SegmentSize.
+    // Connections are kept open from one segment to the next; each further segment still costs a round
+    // trip, during which the other connections are not read, so larger segments suit slower links.
+    int FetchRanges(const OTAConfiguration &config, ESP32OTAPullSession &session)
     {
-        HTTPClient http;
-        ConfigureHTTPClient(http, URL);
-
-        // Send HTTP GET request
-        int httpResponseCode = http.GET();
-
-        if (httpResponseCode == 200)
+        struct Slot
         {
-            int totalLength = http.getSize();
-
-            // this is required to start firmware update process
-            if (!Update.begin(UPDATE_SIZE_UNKNOWN))
-                return OTA_UPDATE_FAIL;
+            ESP32OTAPullSession Session;
+            uint8_t *Buffer;
+            uint32_t Start, Length, Received, Written;
+            bool Active;
+            bool Used;                  // Session has served a segment and may still be connected
+        };
+        const uint32_t total = config.Size;
+        std::unique_ptr<Slot[]> slots(new (std::nothrow) Slot[ParallelConnections]);
+        std::unique_ptr<uint8_t[]> buffers(new (std::nothrow) uint8_t[ParallelConnections * SegmentSize]);
+        if (!slots || !buffers)
+            return OTA_UPDATE_FAIL;
+        for (uint8_t i = 0; i < ParallelConnections; ++i)
+        {
+            slots[i].Buffer = &buffers[i * SegmentSize];
+            slots[i].Active = slots[i].Used = false;
+        }
 
-            // create buffer for read
-            uint8_t buff[1280] = { 0 };
+        uint8_t chunk[1280];
+        uint32_t requested = 0, written = 0, lastProgress = millis();
+        bool begun = false;
+        ESP32OTAPULL_TRACE_BEGIN(OTA_TRACE_WRITE);
+        while (written < total)
+        {
+            for (uint8_t i = 0; i < ParallelConnections; ++i)
+            {
+                Slot &slot = slots[i];
 
-            // get tcp stream
-            WiFiClient* stream = http.getStreamPtr();
+                // Put idle connections to work on the next segment
+                if (!slot.Active && requested < total)
+                {
+                    slot.Start = requested;
+                    slot.Length = min(SegmentSize, total - requested);
+                    slot.Received = slot.Written = 0;
+                    int httpResponseCode = RequestRange(slot.Session, config.URL, slot.Start, slot.Length, slot.Used);
+                    if (httpResponseCode == 200 && requested == 0)
+                    {
+                        // The server ignores Range and sends the whole image: fetch it over one connection
+                        ESP32OTAPULL_TRACE_END(OTA_TRACE_WRITE);
+                        slot.Session.Close();
+                        if (Debugging())
+                            Serial.printf("Range not supported, downloading over one connection\n");
+                        return Transport::Native ? FetchNative(config, session) : FetchStream(config, session);
+                    }
+                    if (httpResponseCode != 206)
+                    {
+                        // A 200 now means the server stopped honouring Range part way through
+                        ESP32OTAPULL_TRACE_END(OTA_TRACE_WRITE);
+                        return httpResponseCode > 0 && httpResponseCode != 200 ? httpResponseCode : HTTP_FAILED;
+                    }
+                    if (!begun && !(begun = BeginInstall(session)))
+                    {
+                        ESP32OTAPULL_TRACE_END(OTA_TRACE_WRITE);
+                        return OTA_UPDATE_FAIL;
+                    }
+                    slot.Active = slot.Used = true;
+                    requested += slot.Length;
+                    lastProgress = millis(); // the wait for data starts now, not before the (re)connect
+                }
+                if (!slot.Active)
+                    continue;
 
-            // read all data from server
-            int offset = 0;
-            while (http.connected() && offset < totalLength)
-            {
+                // Buffer whatever has arrived
+                WiFiClient *stream = slot.Session.http.getStreamPtr();
                 size_t sizeAvail = stream->available();
-                if (sizeAvail > 0)
+                if (sizeAvail > 0 && slot.Received < slot.Length)
                 {
-                    size_t bytes_to_read = min(sizeAvail, sizeof(buff));
-                    size_t bytes_read = stream->readBytes(buff, bytes_to_read);
-                    size_t bytes_written = Update.write(buff, bytes_read);
-                    if (bytes_read != bytes_written)
+                    size_t bytes_read = stream->readBytes(slot.Buffer + slot.Received, min(sizeAvail, (size_t)(slot.Length - slot.Received)));
+                    slot.Received += bytes_read;
+                    lastProgress = millis();
+                }
+
+                // Drain the segment that is next in order
+                while (slot.Start + slot.Written == written && slot.Written < slot.Received)
+                {
+                    size_t length = min((size_t)(slot.Received - slot.Written), sizeof(chunk) - 16);
+                    memcpy(chunk, slot.Buffer + slot.Written, length);
+                    if (!WriteChunk(chunk, length))
                     {
-                        // Serial.printf("Unexpected error in OTA: %d %d %d\n", bytes_to_read, bytes_read, bytes_written);
-                        break;
+                        ESP32OTAPULL_TRACE_END(OTA_TRACE_WRITE);
+                        return WRITE_ERROR;
                     }
-                    offset += bytes_written;
+                    slot.Written += length;
+                    written += length;
+                    LastResult.DownloadBytes = written;
+                    SampleMemory();
                     if (Callback != NULL)
-                        Callback(offset, totalLength);
+                        Callback(written, total);
+                }
+                if (slot.Written == slot.Length)
+                    slot.Active = false;
+                else if (slot.Received < slot.Length && !slot.Session.http.connected())
+                {
+                    ESP32OTAPULL_TRACE_END(OTA_TRACE_WRITE);
+                    return WRITE_ERROR;
                 }
             }
-
-            if (offset == totalLength)
+            if (millis() - lastProgress > Tuning().ReadTimeoutMs)
             {
-                Update.end(true);
-                delay(1000);
-
-                // Restart ESP32 to see changes
-                if (Action == UPDATE_BUT_NO_BOOT)
-                    return UPDATE_OK;
-                ESP.restart();
+                LastResult.TransportError = HTTPC_ERROR_READ_TIMEOUT;
+                break;
             }
-            return WRITE_ERROR;
         }
+        ESP32OTAPULL_TRACE_END(OTA_TRACE_WRITE);
+        return written == total ? UPDATE_OK : WRITE_ERROR;
+    }
 
-        http.end();
-        return httpResponseCode;
+    int InstallImage(const OTAConfiguration &config)
+    {
+        ESP32OTAPullDecryptor::Mode cipher = (ESP32OTAPullDecryptor::Mode)config.Encryption;
+        if ((cipher != ESP32OTAPullDecryptor::NONE && !HasDecryptionKey) ||
+            !Decryptor.Begin(cipher, DecryptionKey, config.IV, config.IVLength))
+            return DECRYPT_FAIL;
+
+        InstallSink = FindSink(config.Target);
+        InstallSize = config.Size;
+        if (InstallSink == NULL)
+            return OTA_UPDATE_FAIL;
+
+        ESP32OTAPullSession session;
+        ImageHash.Begin();
+        int ret = Features::ParallelDownload && ParallelConnections > 1 && config.Size > SegmentSize ? FetchRanges(config, session) :
+                  Transport::Native ? FetchNative(config, session) : FetchStream(config, session);
+        if (ret != UPDATE_OK)
+            return ret;
+
+        // A mismatch returns before EndUpdate, so the session aborts the update
+        ESP32OTAPULL_TRACE_BEGIN(OTA_TRACE_VERIFY);
+        uint8_t tail[16];
+        size_t tailLength;
+        bool authentic = Decryptor.Finish(config.Tag, tail, tailLength) &&
+            (DryRun || tailLength == 0 || InstallSink->Write(tail, tailLength));
+        bool hashOK = config.SHA256[0] == '\0' || ImageHash.Matches(config.SHA256);
+        LastResult.HashVerified = Verifier::Checks && hashOK && config.SHA256[0] != '\0';
+        ret = !hashOK ? VERIFY_FAIL : !authentic ? DECRYPT_FAIL :
+              DryRun || session.EndUpdate() ? UPDATE_OK : OTA_UPDATE_FAIL;
+        ESP32OTAPULL_TRACE_END(OTA_TRACE_VERIFY);
+        SampleMemory();
+        if (Debugging() && ret != UPDATE_OK)
+            Serial.printf("Image rejected: %s\n", !hashOK ? "SHA256 mismatch" : !authentic ? "decryption failed" : "invalid image");
+        return ret;
+    }
+
+    // Look on the local network for a peer sharing exactly this image (verified against the JSON's SHA256)
+    bool FindPeer(const OTAConfiguration &config, OTAConfiguration &peer)
+    {
+        if (!Verifier::Checks || config.SHA256[0] == '\0' || config.Encryption != ESP32OTAPullDecryptor::NONE || config.Target[0] != '\0')
+            return false; // peers share the decrypted image, which can't be checked against the hash
+#if ESP32OTAPULL_MDNS
+        int found = MDNS.queryService("esp32otapeer", "tcp");
+        for (int i = 0; i < found; ++i)
+        {
+            if (!MDNS.txt(i, "sha256").equalsIgnoreCase(config.SHA256))
+                continue;
+            peer = config;
+            snprintf(peer.URL, sizeof(peer.URL), "http://%s:%u/ota/%s", MDNS.IP(i).toString().c_str(), MDNS.port(i), config.SHA256);
+            return true;
+        }
+#else
+        (void)peer;
+#endif
+        return false;
+    }
+
+    ESP32OTAPullSink *FindSink(const char *name)
+    {
+        if (name[0] == '\0')
+            return &FirmwareSink;
+        for (int i = 0; i < SinkCount; ++i)
+            if (strcmp(Sinks[i].Name, name) == 0)
+                return Sinks[i].Destination;
+        if (Debugging())
+            Serial.printf("No sink for target '%s'\n", name);
+        return NULL;
+    }
+
+    bool FindMirror()
+    {
+        if (!MirrorEnabled)
+            return false;
+        if (MirrorCheckedOnce && millis() - MirrorChecked < MirrorTTL)
+            return MirrorFound;
+#if ESP32OTAPULL_MDNS
+        MirrorFound = MDNS.queryService("esp32ota", "tcp") > 0;
+        if (MirrorFound)
+        {
+            MirrorIP = MDNS.IP(0);
+            MirrorPort = MDNS.port(0);
+        }
+#endif
+        MirrorChecked = millis();
+        MirrorCheckedOnce = true;
+        if (Debugging())
+            Serial.printf(MirrorFound ? "Local mirror at %s:%u\n" : "No local mirror\n", MirrorIP.toString().c_str(), MirrorPort);
+        return MirrorFound;
+    }
+
+    // Don't try a mirror that just failed again until the TTL runs out
+    void ForgetMirror()
+    {
+        MirrorFound = false;
+        MirrorChecked = millis();
+        MirrorCheckedOnce = true;
+    }
+
+    // The mirror's copy of an image is addressed by its SHA256, like a peer's: "http://<mirror>:<port>/ota/<sha256>".
+    // The mirror is reached over plain HTTP and is not authenticated, so only images the origin's JSON gives a hash
+    // for, and that can be checked against it, are fetched from it.
+    bool MirrorImage(const OTAConfiguration &config, OTAConfiguration &mirror)
+    {
+        if (!Verifier::Checks || config.SHA256[0] == '\0' || config.Encryption != ESP32OTAPullDecryptor::NONE || !FindMirror())
+            return false;
+        mirror = config;
+        int length = snprintf(mirror.URL, sizeof(mirror.URL), "http://%s:%u/ota/%s", MirrorIP.toString().c_str(), MirrorPort, config.SHA256);
+        return length > 0 && (size_t)length < sizeof(mirror.URL);
+    }
+
+    void RememberSharedImage(const OTAConfiguration &config)
+    {
+        const esp_partition_t *partition = esp_ota_get_boot_partition();
+        nvs_handle_t handle;
+        if (partition == NULL || nvs_open("esp32otapull", NVS_READWRITE, &handle) != ESP_OK)
+            return;
+        SharedImage image = {};
+        strlcpy(image.SHA256, config.SHA256, sizeof(image.SHA256));
+        image.Size = LastResult.DownloadBytes;
+        strlcpy(image.Partition, partition->label, sizeof(image.Partition));
+        nvs_set_blob(handle, "shared", &image, sizeof(image));
+        nvs_commit(handle);
+        nvs_close(handle);
+    }
+
+    int DownloadImage(const OTAConfiguration &config)
+    {
+        OTAConfiguration peer;
+        if (Features::LocalNetwork && PeerDownload && FindPeer(config, peer))
+        {
+            if (Debugging())
+                Serial.printf("Trying peer %s\n", peer.URL);
+            int ret = InstallImage(peer);
+            if (ret == UPDATE_OK)
+                return Installed(config);
+            if (Debugging())
+                Serial.printf("Peer download failed (%d), using %s\n", ret, config.URL);
+        }
+        OTAConfiguration mirror;
+        if (Features::LocalNetwork && MirrorImage(config, mirror))
+        {
+            if (Debugging())
+                Serial.printf("Trying mirror %s\n", mirror.URL);
+            int ret = InstallImage(mirror);
+            if (ret == UPDATE_OK)
+                return Installed(config);
+            ForgetMirror();
+            if (Debugging())
+                Serial.printf("Mirror download failed (%d), using %s\n", ret, config.URL);
+        }
+        int ret = InstallImage(config);
+        return ret == UPDATE_OK ? Installed(config) : ret;
+    }
+
+    // Wherever a verified image came from (origin, peer or mirror), offer it to peers in turn
+    int Installed(const OTAConfiguration &config)
+    {
+        if (Features::LocalNetwork && !DryRun && LastResult.HashVerified && config.Encryption == ESP32OTAPullDecryptor::NONE &&
+            config.Target[0] == '\0')
+            RememberSharedImage(config);
+        return UPDATE_OK;
+    }
+
+    // Book-keeping common to every way of installing an image, then reboot if asked to
+    int CompleteUpdate(int ret, ActionType Action)
+    {
+        RecordUpdate(ret, LastResult.DownloadBytes, LastResult.DownloadMillis);
+        QueueOutcome(ret, LastResult.DownloadBytes, LastResult.DownloadMillis);
+        if (Features::Rollback && ret == UPDATE_OK && LastResult.Configuration.Target[0] == '\0')
+            RememberInstalled();
+        if (ret != UPDATE_OK || Action == UPDATE_BUT_NO_BOOT || LastResult.Configuration.Target[0] != '\0')
+            return Finish(ret);
+
+        // Restart ESP32 to see changes
+        return Finish(RestartPerPolicy());
+    }
+
+    int DoOTAUpdate(const OTAConfiguration &config, ActionType Action)
+    {
+        uint32_t started = millis();
+        LastResult.DownloadBytes = 0;
+        int ret = DownloadImage(config);
+        LastResult.DownloadMillis = millis() - started;
+        if (DryRun)
+            return Finish(ret);
+        return CompleteUpdate(ret, Action);
     }
 
 public:
     /// @brief Set the root CA certificate for HTTPS connections
     /// @param rootCA PEM-formatted root CA certificate string
     /// @return The current ESP32OTAPull object for chaining
-    ESP32OTAPull &SetRootCA(const char *rootCA)
+    BasicOTAPull &SetRootCA(const char *rootCA)
     {
         RootCA = rootCA;
         InsecureConnection = false;
@@ -182,7 +1439,7 @@ public:
     /// @param clientCert PEM-formatted client certificate string
     /// @param clientKey PEM-formatted private key string
     /// @return The current ESP32OTAPull object for chaining
-    ESP32OTAPull &SetClientCertificate(const char *clientCert, const char *clientKey)
+    BasicOTAPull &SetClientCertificate(const char *clientCert, const char *clientKey)
     {
         ClientCert = clientCert;
         ClientKey = clientKey;
@@ -192,7 +1449,7 @@ public:
     /// @brief Enable insecure HTTPS connections (skip certificate verification)
     /// @param insecure true to skip certificate verification (NOT RECOMMENDED for production)
     /// @return The current ESP32OTAPull object for chaining
-    ESP32OTAPull &SetInsecure(bool insecure = true)
+    BasicOTAPull &SetInsecure(bool insecure = true)
     {
         InsecureConnection = insecure;
         if (insecure) {
@@ -201,64 +1458,515 @@ public:
         return *this;
     }
 
-    /// @brief Return the version string of the binary, as reported by the JSON
-    /// @return The firmware version
+    /// @brief Return the version string of the binary, as reported by the JSON entry that matched this device
+    /// @return The firmware version, or an empty string if no entry matched
     String GetVersion()
     {
         return CVersion;
     }
 
+    /// @brief Return the details of the last CheckForOTAUpdate: outcome, HTTP/transport/TLS errors,
+    ///        the matched configuration and timings
+    /// @return The result
+    const Result &GetResult()
+    {
+        return LastResult;
+    }
+
     /// @brief Override the default "Device" id (MAC Address)
     /// @param device A string identifying the particular device (instance) (typically e.g., a MAC address)
     /// @return The current ESP32OTAPull object for chaining
-    ESP32OTAPull &OverrideDevice(const char *device)
+    BasicOTAPull &OverrideDevice(const char *device)
     {
         Device = device;
+        ETagKey = "";
         return *this;
     }
 
-    /// @brief Override the default "Board" value of ARDUINO_BOARD
+    /// @brief Override the default "Board" value of ARDUINO_BOARD (the chip name on plain ESP-IDF)
     /// @param board A string identifying the board (class) being targeted
     /// @return The current ESP32OTAPull object for chaining
-    ESP32OTAPull &OverrideBoard(const char *board)
+    BasicOTAPull &OverrideBoard(const char *board)
     {
         Board = board;
+        ETagKey = "";
         return *this;
     }
 
     /// @brief Specify a configuration string that must match any "Config" in JSON
     /// @param config An arbitrary string showing the current configuration
     /// @return The current ESP32OTAPull object for chaining
-    ESP32OTAPull &SetConfig(const char *config)
+    BasicOTAPull &SetConfig(const char *config)
     {
         Config = config;
+        ETagKey = "";
         return *this;
     }
 
     /// @brief Specify whether downgrades (posted version is lower) are allowed
     /// @param allow_downgrades true if downgrades are allowed
     /// @return The current ESP32OTAPull object for chaining
-    ESP32OTAPull &AllowDowngrades(bool allow_downgrades)
+    BasicOTAPull &AllowDowngrades(bool allow_downgrades)
     {
         DowngradesAllowed = allow_downgrades;
+        ETagKey = "";
         return *this;
     }
 
     /// @brief Specify a callback function to monitor update progress
     /// @param callback Pointer to a function that is called repeatedly during update
     /// @return The current ESP32OTAPull object for chaining
-    ESP32OTAPull &SetCallback(void (*callback)(int offset, int totallength))
+    BasicOTAPull &SetCallback(void (*callback)(int offset, int totallength))
     {
         Callback = callback;
         return *this;
     }
 
+    /// @brief Sample free heap, largest free block and stack high-water mark at each phase of an update
+    /// @param enable true to collect the samples (a few microseconds per chunk written)
+    /// @return The current ESP32OTAPull object for chaining
+    BasicOTAPull &EnableMemoryReport(bool enable = true)
+    {
+        MemoryReporting = enable;
+        return *this;
+    }
+
+    /// @brief Return the lowest memory figures seen during the last CheckForOTAUpdate
+    /// @return The report; all fields are zero if EnableMemoryReport was not called
+    MemoryReport GetMemoryReport()
+    {
+        return MemoryReporting ? Memory : MemoryReport { 0, 0, 0 };
+    }
+
+    /// @brief Keep persistent counters (checks, downloads, outcomes) in NVS
+    /// @param enable true to collect statistics
+    /// @param commitInterval Number of checks batched in RAM between NVS commits (updates always commit)
+    /// @return The current ESP32OTAPull object for chaining
+    BasicOTAPull &EnableStatistics(bool enable = true, uint32_t commitInterval = 10)
+    {
+        static_assert(Features::Statistics, "statistics are not part of this build (see Features)");
+        StatsEnabled = enable;
+        StatsCommitInterval = commitInterval == 0 ? 1 : commitInterval;
+        return *this;
+    }
+
+    /// @brief Return the statistics accumulated so far, including those not yet committed
+    /// @return The statistics
+    Statistics GetStatistics()
+    {
+        LoadStatistics();
+        return Stats;
+    }
+
+    /// @brief Commit any batched statistics to NVS now (e.g. before deep sleep)
+    void FlushStatistics()
+    {
+        if (!StatsLoaded || StatsDirty == 0)
+            return;
+        nvs_handle_t handle;
+        if (nvs_open("esp32otapull", NVS_READWRITE, &handle) != ESP_OK)
+            return;
+        struct { uint32_t Version; Statistics Stats; } blob = { StatsVersion, Stats };
+        if (nvs_set_blob(handle, "stats", &blob, sizeof(blob)) == ESP_OK && nvs_commit(handle) == ESP_OK)
+            StatsDirty = 0;
+        nvs_close(handle);
+    }
+
+    /// @brief Erase the statistics, both in RAM and NVS
+    void ResetStatistics()
+    {
+        memset(&Stats, 0, sizeof(Stats));
+        StatsLoaded = true;
+        StatsDirty = 0;
+        nvs_handle_t handle;
+        if (nvs_open("esp32otapull", NVS_READWRITE, &handle) == ESP_OK)
+        {
+            nvs_erase_key(handle, "stats");
+            nvs_commit(handle);
+            nvs_close(handle);
+        }
+    }
+
+    /// @brief Report the outcome of each update attempt back to the server on the next successful check
+    /// @param reportURL Where to POST the pending records as JSON.  If NULL, they are sent in an
+    ///                  "X-OTA-Report" header of the manifest request instead, costing no extra connection
+    /// @return The current ESP32OTAPull object for chaining
+    BasicOTAPull &EnableOutcomeReports(const char *reportURL = NULL)
+    {
+        static_assert(Features::Statistics, "outcome reports are not part of this build (see Features)");
+        ReportsEnabled = true;
+        ReportURL = reportURL == NULL ? "" : reportURL;
+        return *this;
+    }
+
+    /// @brief Choose when the device restarts after UPDATE_AND_BOOT has installed a new image
+    /// @param policy REBOOT_IMMEDIATE (default); REBOOT_DEFERRED: the application calls Reboot() itself, after
+    ///               an optional SetRebootRequestCallback notification; REBOOT_SCHEDULED: after delayMs;
+    ///               REBOOT_ON_IDLE: as soon as no other task wants the CPU.  Except for REBOOT_IMMEDIATE,
+    ///               CheckForOTAUpdate returns UPDATE_OK and this object must outlive the pending reboot.
+    /// @param delayMs Delay for REBOOT_SCHEDULED
+    /// @return The current ESP32OTAPull object for chaining
+    BasicOTAPull &SetRebootPolicy(RebootPolicy policy, uint32_t delayMs = 0)
+    {
+        static_assert(Features::RebootPolicies, "reboot policies are not part of this build (see Features)");
+        WhenToReboot = policy;
+        RebootDelay = delayMs;
+        return *this;
+    }
+
+    /// @brief Specify a function called just before any reboot, e.g. to flush data or close files.
+    ///        Under REBOOT_SCHEDULED and REBOOT_ON_IDLE it runs in a short-lived task of its own.
+    /// @param callback Pointer to the function
+    /// @return The current ESP32OTAPull object for chaining
+    BasicOTAPull &SetPreRebootCallback(void (*callback)())
+    {
+        PreRebootCallback = callback;
+        return *this;
+    }
+
+    /// @brief Specify a function called when a REBOOT_DEFERRED update is installed and waiting for Reboot()
+    /// @param callback Pointer to the function
+    /// @return The current ESP32OTAPull object for chaining
+    BasicOTAPull &SetRebootRequestCallback(void (*callback)())
+    {
+        RebootRequestCallback = callback;
+        return *this;
+    }
+
+    /// @brief Has a new image been installed that is waiting for a reboot?
+    bool IsRebootPending()
+    {
+        return RebootPending;
+    }
+
+    /// @brief Run the pre-reboot callback, save statistics and restart now
+    void Reboot()
+    {
+        if (PreRebootCallback != NULL)
+            PreRebootCallback();
+        if (Features::Statistics)
+            FlushStatistics();
+        ESP32OTAPULL_TRACE_BEGIN(OTA_TRACE_REBOOT);
+        // Restarting with the image still unconfirmed also makes the bootloader roll back
+        if (Features::Rollback && RollingBack)
+            esp_ota_mark_app_invalid_rollback_and_reboot();
+        ESP.restart();
+    }
+
+    /// @brief Is the running image a freshly installed one that has not yet been confirmed?
+    /// @return true if the bootloader will roll back to the previous image unless ConfirmUpdate is called
+    static bool IsPendingVerify()
+    {
+        esp_ota_img_states_t state;
+        return esp_ota_get_state_partition(esp_ota_get_running_partition(), &state) == ESP_OK &&
+            state == ESP_OTA_IMG_PENDING_VERIFY;
+    }
+
+    /// @brief Require a freshly installed image to be confirmed within a timeout, else roll back.
+    ///        Call early in setup().  Has no effect unless the sketch defines
+    ///        bool verifyRollbackLater() { return true; } so that the core leaves the image unconfirmed.
+    ///        A version that is rolled back (by this timeout or by the bootloader) is remembered in NVS and
+    ///        skipped by later checks, so the device doesn't keep installing it; publish a fix as a new version.
+    /// @param timeoutMs Time allowed for confirmation before rolling back and rebooting
+    /// @param confirmOnCheck true if a successful CheckForOTAUpdate counts as confirmation
+    /// @return The current ESP32OTAPull object for chaining
+    BasicOTAPull &EnableRollback(uint32_t timeoutMs, bool confirmOnCheck = true)
+    {
+        static_assert(Features::Rollback, "rollback is not part of this build (see Features)");
+        ConfirmOnCheck = confirmOnCheck;
+        if (!IsPendingVerify() || RollbackTimer != NULL)
+            return *this;
+
+        esp_timer_create_args_t args = {};
+        args.callback = RollbackTimeout;
+        args.arg = this;
+        args.name = "ota_rollback";
+        if (esp_timer_create(&args, &RollbackTimer) == ESP_OK)
+            esp_timer_start_once(RollbackTimer, (uint64_t)timeoutMs * 1000);
+        if (Debugging())
+            Serial.printf("Rollback: new image must be confirmed within %u ms\n", (unsigned)timeoutMs);
+        return *this;
+    }
+
+    /// @brief Mark the running image as good, cancelling any pending rollback
+    /// @return true if the image is now marked valid
+    bool ConfirmUpdate()
+    {
+        if (RollbackTimer != NULL)
+        {
+            esp_timer_stop(RollbackTimer);
+            esp_timer_delete(RollbackTimer);
+            RollbackTimer = NULL;
+        }
+        if (!IsPendingVerify())
+            return true;
+        if (Debugging())
+            Serial.println("Rollback: new image confirmed");
+        return esp_ota_mark_app_valid_cancel_rollback() == ESP_OK;
+    }
+
     /// @brief Enable extra debugging output on Serial if required.
     void EnableSerialDebug()
     {
         SerialDebug = true;
     }
 
+    /// @brief Provide the key for images whose JSON entry specifies "Encryption"
+    /// @param key 32-byte AES-256 key (copied)
+    /// @return The current ESP32OTAPull object for chaining
+    BasicOTAPull &SetDecryptionKey(const uint8_t *key)
+    {
+        memcpy(DecryptionKey, key, sizeof(DecryptionKey));
+        HasDecryptionKey = true;
+        return *this;
+    }
+
+    /// @brief Download images over several connections at once, each fetching a segment with a Range request.
+    ///        Helps fill high-latency links.  Needs a "Size" in the JSON entry and a server that honours Range.
+    ///        Uses connections * segmentSize bytes of heap, plus a TLS context per connection for https.
+    /// @param connections Number of concurrent connections (1 disables)
+    /// @param segmentSize Bytes fetched per Range request
+    /// @return The current ESP32OTAPull object for chaining
+    BasicOTAPull &SetParallelDownload(uint8_t connections, uint32_t segmentSize = 16384)
+    {
+        static_assert(Features::ParallelDownload, "parallel downloads are not part of this build (see Features)");
+        ParallelConnections = connections == 0 ? 1 : connections;
+        SegmentSize = segmentSize < 1024 ? 1024 : segmentSize;
+        return *this;
+    }
+
+    /// @brief Adjust timeouts and read size for one kind of network.  The settings for the interface that
+    ///        carries the default route at the time of each request are used.
+    /// @param type NETWORK_WIFI, NETWORK_ETHERNET or NETWORK_CELLULAR (PPP)
+    /// @param tuning Connect and read timeouts in ms (HTTPClient limits the read timeout to 65535 ms) and read size
+    /// @return The current ESP32OTAPull object for chaining
+    BasicOTAPull &SetNetworkTuning(NetworkType type, const NetworkTuning &tuning)
+    {
+        if (type < NETWORK_TYPE_COUNT)
+        {
+            Tunings[type] = tuning;
+            if (Tunings[type].BufferSize < 256)
+                Tunings[type].BufferSize = 256;
+        }
+        return *this;
+    }
+
+    /// @brief Remember the addresses of the update servers, in RTC memory so that they survive deep sleep,
+    ///        instead of looking them up for every check.  Connections are opened to the remembered address
+    ///        (only with the Arduino core; esp_http_client looks names up itself).
+    /// @param ttlSeconds How long an address is used before it is looked up again
+    /// @return The current ESP32OTAPull object for chaining
+    BasicOTAPull &EnableDNSCache(uint32_t ttlSeconds = 3600)
+    {
+        static_assert(Features::DNSCache, "the DNS cache is not part of this build (see Features)");
+        DNSCacheTTL = ttlSeconds;
+        return *this;
+    }
+
+    /// @brief Start looking up the host of url in the background, e.g. while the application reads its sensors,
+    ///        so that the next check finds the address ready.  Requires EnableDNSCache().
+    /// @return true if the address is cached or being looked up
+    bool PreResolve(const char *url)
+    {
+        char host[64];
+        uint16_t port;
+        return DNSCacheTTL > 0 && ESP32OTAPullDNSCache::ParseURL(url, host, sizeof(host), port) &&
+            ESP32OTAPullDNSCache::ResolveInBackground(host, DNSCacheTTL);
+    }
+
+    /// @brief Before downloading an image from its URL, look for a peer on the local network that is sharing
+    ///        the same image (see ESP32OTAPullPeerServer) and download from it instead.  Only applies to
+    ///        entries with a "SHA256"; the origin is used if no peer is found or the peer's copy fails.
+    ///        Requires MDNS.begin() to have been called.
+    /// @param enable true to try peers first
+    /// @return The current ESP32OTAPull object for chaining
+    BasicOTAPull &EnablePeerDownload(bool enable = true)
+    {
+        static_assert(Features::LocalNetwork && ESP32OTAPULL_MDNS, "peer downloads need Features::LocalNetwork and ESP32OTAPULL_MDNS");
+        PeerDownload = enable;
+        return *this;
+    }
+
+    /// @brief Look on the local network for a mirror advertising _esp32ota._tcp and, if there is one, fetch
+    ///        images from it first, as http://<mirror>/ota/<SHA256>.  The JSON always comes from JSON_URL,
+    ///        and only unencrypted entries with a "SHA256" are taken from the mirror, so that what it serves
+    ///        is checked against the origin.  The entry's URL remains the fallback.  Requires MDNS.begin().
+    /// @param enable true to prefer a local mirror
+    /// @param cacheSeconds How long the result of a discovery (mirror or no mirror) is remembered
+    /// @return The current ESP32OTAPull object for chaining
+    BasicOTAPull &EnableLocalMirror(bool enable = true, uint32_t cacheSeconds = 600)
+    {
+        static_assert(Features::LocalNetwork && ESP32OTAPULL_MDNS, "local mirrors need Features::LocalNetwork and ESP32OTAPULL_MDNS");
+        MirrorEnabled = enable;
+        MirrorFound = false;
+        MirrorCheckedOnce = false;
+        MirrorTTL = cacheSeconds * 1000;
+        return *this;
+    }
+
+    /// @brief Register a destination for images of JSON entries whose "Target" is name, e.g. a companion MCU
+    /// @param name The "Target" value (up to 15 characters)
+    /// @param sink Receives the image; must outlive this object
+    /// @return The current ESP32OTAPull object for chaining
+    BasicOTAPull &AddSink(const char *name, ESP32OTAPullSink &sink)
+    {
+        for (int i = 0; i < SinkCount; ++i)
+            if (strcmp(Sinks[i].Name, name) == 0)
+            {
+                Sinks[i].Destination = &sink;
+                return *this;
+            }
+        if (SinkCount < MaxSinks)
+        {
+            strlcpy(Sinks[SinkCount].Name, name, sizeof(Sinks[SinkCount].Name));
+            Sinks[SinkCount++].Destination = &sink;
+        }
+        return *this;
+    }
+
+    /// @brief Choose what the following checks are for: entries match only if their "Target" equals target.
+    ///        The default, an empty target, is this ESP32 itself, and only it reboots after an update.
+    /// @param target A name given to AddSink, or NULL/"" for this ESP32
+    /// @return The current ESP32OTAPull object for chaining
+    BasicOTAPull &SetTarget(const char *target = NULL)
+    {
+        Target = target == NULL ? "" : target;
+        return *this;
+    }
+
+    /// @brief Return the last image installed with a verified SHA256, as recorded in NVS
+    /// @param image Receives the record
+    /// @return false if there is none
+    static bool GetSharedImage(SharedImage &image)
+    {
+        nvs_handle_t handle;
+        if (nvs_open("esp32otapull", NVS_READONLY, &handle) != ESP_OK)
+            return false;
+        size_t length = sizeof(image);
+        bool found = nvs_get_blob(handle, "shared", &image, &length) == ESP_OK && length == sizeof(image);
+        nvs_close(handle);
+        return found;
+    }
+
+    /// @brief Locate the shared image (see GetSharedImage) and check that its partition still holds it intact.
+    ///        Hashes the whole image, which takes a moment.
+    /// @param image Receives the record
+    /// @return The partition holding the image, or NULL
+    static const esp_partition_t *OpenSharedImage(SharedImage &image)
+    {
+        if (!GetSharedImage(image))
+            return NULL;
+        const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_ANY, image.Partition);
+        if (partition == NULL || image.Size == 0 || image.Size > partition->size)
+            return NULL;
+
+        uint8_t buffer[1024];
+        ESP32OTAPullSHA256 hash;
+        hash.Begin();
+        for (uint32_t offset = 0; offset < image.Size; offset += sizeof(buffer))
+        {
+            size_t length = min((uint32_t)sizeof(buffer), image.Size - offset);
+            if (esp_partition_read(partition, offset, buffer, length) != ESP_OK)
+                return NULL;
+            hash.Add(buffer, length);
+        }
+        return hash.Matches(image.SHA256) ? partition : NULL;
+    }
+
+    /// @brief Make updates download and verify the image without writing it to flash, e.g. to benchmark
+    ///        a network or pre-validate a release.  UPDATE_OK then means the image arrived intact;
+    ///        see GetResult() for DownloadBytes, DownloadMillis and HashVerified.
+    /// @param dryRun true to discard the image instead of installing it
+    /// @return The current ESP32OTAPull object for chaining
+    BasicOTAPull &SetDryRun(bool dryRun = true)
+    {
+        DryRun = dryRun;
+        return *this;
+    }
+
+    /// @brief Check for an update without installing it, keeping the matched entry for a later DownloadUpdate
+    /// @param JSON_URL The URL for the JSON filter file
+    /// @param CurrentVersion The version # of the current (i.e. to be replaced) sketch
+    /// @param match Receives the matching entry (URL, Version, Size, SHA256 and any custom fields)
+    /// @return UPDATE_AVAILABLE if match holds an installable update, else as for CheckForOTAUpdate
+    int CheckForOTAUpdate(const char* JSON_URL, const char *CurrentVersion, OTAConfiguration &match)
+    {
+        int ret = CheckForOTAUpdate(JSON_URL, CurrentVersion, DONT_DO_UPDATE);
+        match = LastResult.Configuration;
+        return ret;
+    }
+
+    /// @brief Install an entry returned earlier by CheckForOTAUpdate, without fetching the JSON again
+    /// @param config The entry to install
+    /// @param Action UPDATE_BUT_NO_BOOT or UPDATE_AND_BOOT (default)
+    /// @return UPDATE_OK or ErrorCode or HTTP failure code (see enum above)
+    int DownloadUpdate(const OTAConfiguration &config, ActionType Action = UPDATE_AND_BOOT)
+    {
+        OTAConfiguration entry = config; // config may be LastResult.Configuration itself
+        ResetResult();
+        ResetMemoryReport();
+        LastResult.Configuration = entry;
+        LastResult.Matched = true;
+        CVersion = entry.Version;
+        if (Action == DONT_DO_UPDATE)
+            return Finish(UPDATE_AVAILABLE);
+        return DoOTAUpdate(LastResult.Configuration, Action);
+    }
+
+    /// @brief The MQTT topic on which this device expects update messages (see ApplyUpdateMessage)
+    /// @param prefix The first topic level, e.g. "ota"
+    /// @param perDevice false for "<prefix>/<Board>", true for "<prefix>/<Board>/<MAC without colons>"
+    /// @return The topic
+    String UpdateTopic(const char *prefix = "ota", bool perDevice = false)
+    {
+        String topic = String(prefix) + "/" + (Board.isEmpty() ? ESP32OTAPULL_BOARD : Board);
+        if (perDevice)
+        {
+            String mac = Device.isEmpty() ? Identity().Hex : Device;
+            mac.replace(":", "");
+            topic += "/" + mac;
+        }
+        return topic;
+    }
+
+    /// @brief Act on an update message pushed to the device (e.g. a retained MQTT message on UpdateTopic()),
+    ///        skipping the JSON request.  The message is one entry as in the JSON file, e.g.
+    ///        {"Version":"1.0.1","URL":"https://...","Size":1234567,"SHA256":"..."}, or a whole JSON file.
+    ///        Board, Device, Config and Version are checked as for CheckForOTAUpdate.
+    /// @param payload The message
+    /// @param length Its length; an empty (cleared) message means no update
+    /// @param CurrentVersion The version # of the current (i.e. to be replaced) sketch
+    /// @param Action The action to be performed.  May be any of DONT_DO_UPDATE, UPDATE_BUT_NO_BOOT, UPDATE_AND_BOOT (default)
+    /// @return ErrorCode or HTTP failure code, as for CheckForOTAUpdate
+    int ApplyUpdateMessage(const uint8_t *payload, size_t length, const char *CurrentVersion, ActionType Action = UPDATE_AND_BOOT)
+    {
+        CurrentVersion = CurrentVersion == NULL ? "" : CurrentVersion;
+        ResetResult();
+        ResetMemoryReport();
+        RunningVersion = CurrentVersion;
+        CVersion = "";
+        if (length == 0)
+            return Finish(NO_UPDATE_PROFILE_FOUND);
+
+        ESP32OTAPULL_TRACE_BEGIN(OTA_TRACE_PARSE);
+        JsonDocument doc;
+        DeserializationError error = deserializeJson(doc, payload, length);
+        ESP32OTAPULL_TRACE_END(OTA_TRACE_PARSE);
+        if (error || !doc.is<JsonObject>())
+            return Finish(JSON_PROBLEM);
+        if (!doc["Configurations"].is<JsonArray>())
+        {
+            JsonDocument entry = doc;
+            doc.clear();
+            doc["Configurations"].add(entry);
+        }
+
+        int ret = SelectConfiguration(doc["Configurations"].as<JsonArray>(), CurrentVersion);
+        if (ret != UPDATE_AVAILABLE)
+            return Finish(ret);
+        return Action == DONT_DO_UPDATE ? Finish(UPDATE_AVAILABLE) : DoOTAUpdate(LastResult.Configuration, Action);
+    }
+
     /// @brief The main entry point for OTA Update
     /// @param JSON_URL The URL for the JSON filter file
     /// @param CurrentVersion The version # of the current (i.e. to be replaced) sketch
@@ -267,20 +1975,66 @@ public:
     int CheckForOTAUpdate(const char* JSON_URL, const char *CurrentVersion, ActionType Action = UPDATE_AND_BOOT)
     {
         CurrentVersion = CurrentVersion == NULL ? "" : CurrentVersion;
+        uint32_t started = millis();
+        ResetResult();
+        ResetMemoryReport();
+        RunningVersion = CurrentVersion;
+        CVersion = "";
+
+        ESP32OTAPullSession session;
+        HTTPClient &http = session.http;
+        ConfigureHTTPClient(session, JSON_URL);
+
+        // If the manifest is unchanged since it last told us there was nothing to do, the answer is the same
+        String etagKey = String(JSON_URL) + "|" + CurrentVersion + "|" + Target;
+        if (!ManifestETag.isEmpty() && ETagKey == etagKey)
+            http.addHeader("If-None-Match", ManifestETag);
+        const char *collect[] = { "ETag" };
+        http.collectHeaders(collect, 1);
+
+        // Pending outcome records either ride along with the manifest request, or are POSTed after it
+        OutcomeQueue outcomes;
+        bool reportPending = Features::Statistics && ReportsEnabled && LoadOutcomes(outcomes);
+        if (reportPending && ReportURL.isEmpty())
+            http.addHeader("X-OTA-Report", SerializeOutcomes(outcomes));
 
-		HTTPClient http;
-		ConfigureHTTPClient(http, JSON_URL);
-		
         // Send HTTP GET request
-        int httpResponseCode = http.GET();
+        int httpResponseCode = session.GET();
+        RecordCheck(httpResponseCode);
+        RecordResponse(session, httpResponseCode);
+
+        // Reaching the update server is proof enough that a new image is healthy
+        if (Features::Rollback && ConfirmOnCheck && (httpResponseCode == 200 || httpResponseCode == 304) && IsPendingVerify())
+            ConfirmUpdate();
+
+        bool postReport = false;
+        if (reportPending && (httpResponseCode == 200 || httpResponseCode == 304))
+        {
+            if (ReportURL.isEmpty())
+                StoreOutcomes(OutcomeQueue {});
+            else
+                postReport = true; // once the manifest connection is closed, to avoid two TLS contexts at once
+        }
+        SampleMemory();
 		
-        if (SerialDebug) {
+        if (Debugging()) {
             Serial.print("Got HTTP Response: ");
-            Serial.println(httpResponseCode, DEC);
+            Serial.println(httpResponseCode);
+        }
+
+        if (httpResponseCode == 304 && ETagKey == etagKey) {
+            LastResult.Matched = ETagMatched;
+            LastResult.Configuration = ETagConfiguration;
+            CVersion = ETagMatched ? ETagConfiguration.Version : "";
+            session.Close();
+            if (postReport)
+                SendOutcomes(outcomes);
+            LastResult.ManifestMillis = millis() - started;
+            return Finish(ETagResult);
         }
 
         if (httpResponseCode != 200) {
-		   return httpResponseCode > 0 ? httpResponseCode : HTTP_FAILED;
+		   return Finish(httpResponseCode > 0 ? httpResponseCode : HTTP_FAILED);
 		}
 
 		// Get the raw and the decoded stream
@@ -294,25 +2048,49 @@ public:
 		//DeserializationError error = deserializeJson(doc, loggingStream);
 		
 		// Parse JSON object
+		ESP32OTAPULL_TRACE_BEGIN(OTA_TRACE_PARSE);
 		DeserializationError error = deserializeJson(doc, rawStream);
+		ESP32OTAPULL_TRACE_END(OTA_TRACE_PARSE);
+		SampleMemory();
 
 		// Disconnect
-		http.end();		
+		String etag = http.header("ETag");
+		session.Close();
+		if (postReport)
+		    SendOutcomes(outcomes);
+		ETagKey = "";
 
 		if (error) {
-            if (SerialDebug)  {
-                Serial.print(F("deserializeJson() failed: "));
+            if (Debugging())  {
+                Serial.print("deserializeJson() failed: ");
                 Serial.println(error.f_str());
             }
-			return JSON_PROBLEM;
+			return Finish(JSON_PROBLEM);
 		}
 
-        String _Board    = Board.isEmpty() ? ARDUINO_BOARD : Board;
-		String _Device   = Device.isEmpty() ? WiFi.macAddress() : Device;
-        String _Config   = Config.isEmpty() ? "" : Config;
+        int ret = SelectConfiguration(doc["Configurations"].as<JsonArray>(), CurrentVersion);
+        LastResult.ManifestMillis = millis() - started;
+        if (ret == UPDATE_AVAILABLE)
+            return Action == DONT_DO_UPDATE ? Finish(UPDATE_AVAILABLE) : DoOTAUpdate(LastResult.Configuration, Action);
+        ManifestETag = etag;
+        ETagKey = etag.isEmpty() ? "" : etagKey;
+        ETagResult = ret;
+        ETagMatched = LastResult.Matched;
+        ETagConfiguration = LastResult.Configuration;
+        return Finish(ETagResult);
+    }
+
+private:
+    // Step through the configurations for the first that fits this device; fills in LastResult and CVersion
+    // Returns UPDATE_AVAILABLE, NO_UPDATE_AVAILABLE or NO_UPDATE_PROFILE_FOUND
+    int SelectConfiguration(JsonArray configurations, const char *CurrentVersion)
+    {
+        const char *_Board  = Board.isEmpty() ? ESP32OTAPULL_BOARD : Board.c_str();
+        const char *_Device = Device.isEmpty() ? Identity().Text : Device.c_str();
+        const char *_Config = Config.c_str();
         bool foundProfile = false;
 
-        if (SerialDebug) {
+        if (Debugging()) {
 
             Serial.println("Looking for a configuration that matches:");
             Serial.print("Board: ");    Serial.println(_Board);
@@ -320,25 +2098,57 @@ public:
             Serial.print("Device: ");   Serial.println(_Device);
         }
 
-        // Step through the configurations looking for a match
-        for (auto config : doc["Configurations"].as<JsonArray>())
+        if (Features::Rollback)
+            LoadRejectedVersion();
+
+        ESP32OTAPULL_TRACE_BEGIN(OTA_TRACE_MATCH);
+        for (auto config : configurations)
         {
             String CBoard   = config["Board"].isNull() ? "" : (const char *)config["Board"];
             String CDevice  = config["Device"].isNull() ? "" : (const char *)config["Device"];
-            CVersion        = config["Version"].isNull() ? "" : (const char *)config["Version"];
+            String Version  = config["Version"].isNull() ? "" : (const char *)config["Version"];
             String CConfig  = config["Config"].isNull() ? "" : (const char *)config["Config"];
+            String CTarget  = config["Target"].isNull() ? "" : (const char *)config["Target"];
 
-            if ((CBoard.isEmpty() || CBoard == _Board) &&
+            if (CTarget == Target &&
+                (CBoard.isEmpty() || CBoard == _Board) &&
                 (CDevice.isEmpty() || CDevice == _Device) &&
                 (CConfig.isEmpty() || CConfig == _Config))
             {
-                if (CVersion.isEmpty() || CVersion > String(CurrentVersion) ||
-                    (DowngradesAllowed && CVersion != String(CurrentVersion))) {
-                    return Action == DONT_DO_UPDATE ? UPDATE_AVAILABLE : DoOTAUpdate(config["URL"], Action);
+                CVersion = Version;
+                LastResult.Matched = true;
+                ReadConfiguration(config, LastResult.Configuration);
+                bool rejected = Features::Rollback && CTarget.isEmpty() && !Version.isEmpty() && Version == RejectedVersion;
+                if (rejected && Debugging())
+                    Serial.printf("Skipping version %s, which was rolled back\n", Version.c_str());
+                if (!rejected && (Version.isEmpty() || Version > String(CurrentVersion) ||
+                    (DowngradesAllowed && Version != String(CurrentVersion)))) {
+                    ESP32OTAPULL_TRACE_END(OTA_TRACE_MATCH);
+                    return UPDATE_AVAILABLE;
                 }
                 foundProfile = true;
             }
         }
+        ESP32OTAPULL_TRACE_END(OTA_TRACE_MATCH);
         return foundProfile ? NO_UPDATE_AVAILABLE : NO_UPDATE_PROFILE_FOUND;
     }
 };
+
+// Everything included
+typedef BasicOTAPull<> ESP32OTAPull;
+
+// Images downloaded with esp_http_client and written with esp_ota_* rather than HTTPClient and Update
+typedef BasicOTAPull<ESP32OTAPullIDFTransport, ESP32OTAPullIDFSink> ESP32OTAPullIDF;
+
+// Plain HTTP into this ESP32's OTA partition, without hashing, decryption, debug output or the optional features
+typedef BasicOTAPull<ESP32OTAPullHTTPTransport, ESP32OTAPullDefaultSink, ESP32OTAPullNoVerify,
+                     ESP32OTAPullNoDecryption, ESP32OTAPullNoLog, ESP32OTAPullNoExtras> ESP32OTAPullMinimal;
+
+} // namespace esp32otapull
+
+using esp32otapull::ESP32OTAPullSession;
+using esp32otapull::ESP32OTAPullTypes;
+using esp32otapull::BasicOTAPull;
+using esp32otapull::ESP32OTAPull;
+using esp32otapull::ESP32OTAPullIDF;
+using esp32otapull::ESP32OTAPullMinimal;
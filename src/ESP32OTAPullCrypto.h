@@ -0,0 +1,247 @@
+/*
+ESP32-OTA-Pull - image hashing and decryption
+
+MIT License
+
+Copyright (c) 2022-3 Mikal Hart
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#pragma once
+#include "ESP32OTAPullPlatform.h"
+#include <ctype.h>
+#include <mbedtls/version.h>
+#include <mbedtls/sha256.h>
+#include <mbedtls/aes.h>
+#include <mbedtls/gcm.h>
+
+namespace esp32otapull
+{
+
+/// @brief Convert a hex string into bytes
+/// @return The number of bytes converted, or 0 if hex is empty, longer than 2 * maxBytes or malformed
+inline size_t ESP32OTAPullHexToBytes(const char *hex, uint8_t *bytes, size_t maxBytes)
+{
+    size_t length = strlen(hex);
+    if (length == 0 || length % 2 != 0 || length / 2 > maxBytes)
+        return 0;
+    for (size_t i = 0; i < length; ++i)
+        if (!isxdigit((unsigned char)hex[i]))
+            return 0; // strtoul() alone would take a sign or leading space
+    for (size_t i = 0; i < length / 2; ++i)
+    {
+        char pair[3] = { hex[2 * i], hex[2 * i + 1], '\0' };
+        bytes[i] = (uint8_t)strtoul(pair, NULL, 16);
+    }
+    return length / 2;
+}
+
+// Incremental SHA-256 of a downloaded image, compared against the hex digest from the JSON
+class ESP32OTAPullSHA256
+{
+public:
+    static constexpr bool Checks = true;
+
+    ESP32OTAPullSHA256()
+    {
+        mbedtls_sha256_init(&Context);
+    }
+
+    ~ESP32OTAPullSHA256()
+    {
+        mbedtls_sha256_free(&Context);
+    }
+
+    void Begin()
+    {
+#if MBEDTLS_VERSION_NUMBER < 0x03000000
+        mbedtls_sha256_starts_ret(&Context, 0);
+#else
+        mbedtls_sha256_starts(&Context, 0);
+#endif
+    }
+
+    void Add(const uint8_t *data, size_t length)
+    {
+#if MBEDTLS_VERSION_NUMBER < 0x03000000
+        mbedtls_sha256_update_ret(&Context, data, length);
+#else
+        mbedtls_sha256_update(&Context, data, length);
+#endif
+    }
+
+    /// @brief Finish the digest
+    /// @param digest Receives the 32-byte hash
+    void Finish(uint8_t digest[32])
+    {
+#if MBEDTLS_VERSION_NUMBER < 0x03000000
+        mbedtls_sha256_finish_ret(&Context, digest);
+#else
+        mbedtls_sha256_finish(&Context, digest);
+#endif
+    }
+
+    /// @brief Finish the digest as a lower-case hex string
+    /// @param hex Receives 64 characters and a terminating NUL
+    void Finish(char hex[65])
+    {
+        uint8_t digest[32];
+        Finish(digest);
+        for (int i = 0; i < 32; ++i)
+            snprintf(hex + 2 * i, 3, "%02x", digest[i]);
+    }
+
+    /// @brief Finish the digest and compare it (case-insensitively) with a 64-character hex string
+    bool Matches(const char *expectedHex)
+    {
+        uint8_t digest[32];
+        Finish(digest);
+        uint8_t expected[32];
+        if (strlen(expectedHex) != 64 || ESP32OTAPullHexToBytes(expectedHex, expected, sizeof(expected)) != 32)
+            return false;
+        return memcmp(digest, expected, sizeof(digest)) == 0;
+    }
+
+private:
+    mbedtls_sha256_context Context;
+};
+
+// Streaming AES-256 decryption of an image (CTR, or GCM with an authentication tag).
+// mbedTLS uses the ESP32's AES peripheral when CONFIG_MBEDTLS_HARDWARE_AES is set, as it is in the Arduino core.
+class ESP32OTAPullDecryptor
+{
+public:
+    enum Mode { NONE, AES256_CTR, AES256_GCM };
+
+    ESP32OTAPullDecryptor()
+    {
+        mbedtls_aes_init(&Aes);
+        mbedtls_gcm_init(&Gcm);
+    }
+
+    ~ESP32OTAPullDecryptor()
+    {
+        mbedtls_aes_free(&Aes);
+        mbedtls_gcm_free(&Gcm);
+    }
+
+    ESP32OTAPullDecryptor(const ESP32OTAPullDecryptor &) = delete;
+    ESP32OTAPullDecryptor &operator=(const ESP32OTAPullDecryptor &) = delete;
+
+    /// @brief Start decrypting an image
+    /// @param mode The cipher; NONE passes data through unchanged
+    /// @param key 32-byte key
+    /// @param iv 16-byte initial counter block (CTR) or nonce (GCM)
+    /// @param ivLength Length of iv; 12 is usual for GCM
+    bool Begin(Mode mode, const uint8_t *key, const uint8_t *iv, size_t ivLength)
+    {
+        Cipher = mode;
+        Held = 0;
+        if (mode == AES256_CTR)
+        {
+            if (ivLength != 16)
+                return false;
+            memcpy(Counter, iv, 16);
+            CounterOffset = 0;
+            return mbedtls_aes_setkey_enc(&Aes, key, 256) == 0;
+        }
+        if (mode == AES256_GCM)
+        {
+            if (mbedtls_gcm_setkey(&Gcm, MBEDTLS_CIPHER_ID_AES, key, 256) != 0)
+                return false;
+#if MBEDTLS_VERSION_NUMBER < 0x03000000
+            return mbedtls_gcm_starts(&Gcm, MBEDTLS_GCM_DECRYPT, iv, ivLength, NULL, 0) == 0;
+#else
+            return mbedtls_gcm_starts(&Gcm, MBEDTLS_GCM_DECRYPT, iv, ivLength) == 0;
+#endif
+        }
+        return true;
+    }
+
+    /// @brief Decrypt in place.  With GCM on mbedTLS 2.x, up to 15 bytes may be held back until the
+    ///        next call or Finish(), so data must have room for length + 15 bytes.
+    /// @param length On entry the number of ciphertext bytes, on return the number of plaintext bytes now at the start of data
+    /// @return false on a cipher error
+    bool Process(uint8_t *data, size_t &length)
+    {
+        if (Cipher == AES256_CTR)
+            return mbedtls_aes_crypt_ctr(&Aes, length, &CounterOffset, Counter, StreamBlock, data, data) == 0;
+        if (Cipher != AES256_GCM)
+            return true;
+#if MBEDTLS_VERSION_NUMBER < 0x03000000
+        // mbedtls_gcm_update() only accepts whole blocks until the final call
+        memmove(data + Held, data, length);
+        memcpy(data, HeldBytes, Held);
+        length += Held;
+        Held = length % 16;
+        length -= Held;
+        memcpy(HeldBytes, data + length, Held);
+        return mbedtls_gcm_update(&Gcm, length, data, data) == 0;
+#else
+        size_t produced = 0;
+        bool ok = mbedtls_gcm_update(&Gcm, data, length, data, length + 15, &produced) == 0;
+        length = produced;
+        return ok;
+#endif
+    }
+
+    /// @brief Flush any held-back plaintext and, for GCM, check the authentication tag
+    /// @param tag The expected 16-byte tag (GCM only)
+    /// @param out Receives up to 15 final plaintext bytes
+    /// @param outLength Receives the number of bytes in out
+    /// @return true if the image is authentic (always true for CTR and NONE)
+    bool Finish(const uint8_t *tag, uint8_t *out, size_t &outLength)
+    {
+        outLength = 0;
+        if (Cipher != AES256_GCM)
+            return true;
+        uint8_t computed[16];
+#if MBEDTLS_VERSION_NUMBER < 0x03000000
+        if (Held > 0 && mbedtls_gcm_update(&Gcm, Held, HeldBytes, out) != 0)
+            return false;
+        outLength = Held;
+        if (mbedtls_gcm_finish(&Gcm, computed, sizeof(computed)) != 0)
+            return false;
+#else
+        if (mbedtls_gcm_finish(&Gcm, out, 15, &outLength, computed, sizeof(computed)) != 0)
+            return false;
+#endif
+        uint8_t diff = 0; // constant time
+        for (size_t i = 0; i < sizeof(computed); ++i)
+            diff |= computed[i] ^ tag[i];
+        return diff == 0;
+    }
+
+private:
+    Mode Cipher = NONE;
+    mbedtls_aes_context Aes;
+    mbedtls_gcm_context Gcm;
+    uint8_t Counter[16];
+    uint8_t StreamBlock[16];
+    size_t CounterOffset = 0;
+    uint8_t HeldBytes[16];
+    size_t Held = 0;
+};
+
+} // namespace esp32otapull
+
+using esp32otapull::ESP32OTAPullHexToBytes;
+using esp32otapull::ESP32OTAPullSHA256;
+using esp32otapull::ESP32OTAPullDecryptor;
@@ -0,0 +1,220 @@
+/*
+ESP32-OTA-Pull - DNS answers kept across checks and deep sleep
+
+MIT License
+
+Copyright (c) 2022-3 Mikal Hart
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+lwIP forgets its DNS answers in deep sleep, so a device that wakes, checks and sleeps
+again looks up the update server on every wake.  ESP32OTAPullDNSCache keeps IPv4
+answers in RTC memory, which survives deep sleep, each for a time to live measured
+on the system clock (which keeps running in deep sleep).  BasicOTAPull uses it once
+EnableDNSCache() has been called:
+
+    ota.EnableDNSCache(3600);
+    ota.PreResolve(JSON_URL);    // looked up in the background ...
+    ... read sensors ...
+    ota.CheckForOTAUpdate(JSON_URL, VERSION);  // ... and ready here
+*/
+
+#pragma once
+#include "ESP32OTAPullPlatform.h"
+#include <new>
+#include <sys/time.h>
+#include <lwip/netdb.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#ifndef ESP32OTAPULL_DNS_CACHE_SIZE
+#define ESP32OTAPULL_DNS_CACHE_SIZE 4
+#endif
+
+namespace esp32otapull
+{
+
+class ESP32OTAPullDNSCache
+{
+public:
+    /// @brief The cached address of host, if it has not expired
+    static bool Lookup(const char *host, IPAddress &address)
+    {
+        uint32_t now = Now();
+        bool found = false;
+        taskENTER_CRITICAL(&Lock());
+        Entry *e = Find(host);
+        if (e != NULL && now >= e->Resolved && now < e->Expires)
+        {
+            address = IPAddress(e->Address);
+            found = true;
+        }
+        taskEXIT_CRITICAL(&Lock());
+        return found;
+    }
+
+    /// @brief The cached address of host, or else look it up (blocking) and cache the answer
+    /// @param ttlSeconds How long a new answer is kept
+    static bool Resolve(const char *host, uint32_t ttlSeconds, IPAddress &address)
+    {
+        if (Lookup(host, address))
+            return true;
+        struct addrinfo hints = {};
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_STREAM;
+        struct addrinfo *result = NULL;
+        if (getaddrinfo(host, NULL, &hints, &result) != 0 || result == NULL)
+            return false;
+        uint32_t ip = ((struct sockaddr_in *)result->ai_addr)->sin_addr.s_addr;
+        freeaddrinfo(result);
+        Store(host, ip, ttlSeconds);
+        address = IPAddress(ip);
+        return true;
+    }
+
+    /// @brief Look host up in a background task, unless a fresh answer is already cached
+    /// @return false if the task could not be started
+    static bool ResolveInBackground(const char *host, uint32_t ttlSeconds)
+    {
+        IPAddress address;
+        if (Lookup(host, address))
+            return true;
+        Job *job = new (std::nothrow) Job;
+        if (job == NULL)
+            return false;
+        strlcpy(job->Host, host, sizeof(job->Host));
+        job->TTL = ttlSeconds;
+        if (xTaskCreate(ResolveTask, "ota_dns", 3072, job, tskIDLE_PRIORITY + 1, NULL) != pdPASS)
+        {
+            delete job;
+            return false;
+        }
+        return true;
+    }
+
+    /// @brief Drop the answer for host, e.g. because the address no longer accepts connections
+    static void Forget(const char *host)
+    {
+        taskENTER_CRITICAL(&Lock());
+        Entry *e = Find(host);
+        if (e != NULL)
+            e->Host[0] = '\0';
+        taskEXIT_CRITICAL(&Lock());
+    }
+
+    /// @brief The host name and port of an http:// or https:// URL
+    static bool ParseURL(const char *url, char *host, size_t size, uint16_t &port)
+    {
+        bool https = strncmp(url, "https://", 8) == 0;
+        if (!https && strncmp(url, "http://", 7) != 0)
+            return false;
+        const char *start = url + (https ? 8 : 7);
+        const char *at = strpbrk(start, "@/");
+        if (at != NULL && *at == '@')
+            start = at + 1; // skip user:password@
+        size_t length = strcspn(start, ":/?#");
+        if (length == 0 || length >= size)
+            return false;
+        memcpy(host, start, length);
+        host[length] = '\0';
+        port = start[length] == ':' ? (uint16_t)atoi(start + length + 1) : (https ? 443 : 80);
+        return port != 0;
+    }
+
+private:
+    struct Entry
+    {
+        char Host[64];
+        uint32_t Address;               // IPv4, network byte order
+        uint32_t Resolved;              // system clock, seconds
+        uint32_t Expires;
+    };
+
+    struct Job
+    {
+        char Host[64];
+        uint32_t TTL;
+    };
+
+    static Entry *Entries()
+    {
+        static RTC_DATA_ATTR Entry entries[ESP32OTAPULL_DNS_CACHE_SIZE];
+        return entries;
+    }
+
+    static portMUX_TYPE &Lock()
+    {
+        static portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+        return lock;
+    }
+
+    static uint32_t Now()
+    {
+        struct timeval tv;
+        gettimeofday(&tv, NULL);
+        return (uint32_t)tv.tv_sec;
+    }
+
+    static Entry *Find(const char *host)
+    {
+        Entry *entries = Entries();
+        for (int i = 0; i < ESP32OTAPULL_DNS_CACHE_SIZE; ++i)
+            if (entries[i].Host[0] != '\0' && strcasecmp(entries[i].Host, host) == 0)
+                return &entries[i];
+        return NULL;
+    }
+
+    // Replaces the entry for host, or else the one that expires first
+    static void Store(const char *host, uint32_t address, uint32_t ttlSeconds)
+    {
+        if (strlen(host) >= sizeof(Entry::Host))
+            return;
+        uint32_t now = Now();
+        taskENTER_CRITICAL(&Lock());
+        Entry *e = Find(host);
+        if (e == NULL)
+        {
+            Entry *entries = Entries();
+            e = &entries[0];
+            for (int i = 1; i < ESP32OTAPULL_DNS_CACHE_SIZE && e->Host[0] != '\0'; ++i)
+                if (entries[i].Host[0] == '\0' || entries[i].Expires < e->Expires)
+                    e = &entries[i];
+            strlcpy(e->Host, host, sizeof(e->Host));
+        }
+        e->Address = address;
+        e->Resolved = now;
+        e->Expires = now + ttlSeconds;
+        taskEXIT_CRITICAL(&Lock());
+    }
+
+    static void ResolveTask(void *arg)
+    {
+        Job *job = static_cast<Job *>(arg);
+        IPAddress address;
+        Resolve(job->Host, job->TTL, address);
+        delete job;
+        vTaskDelete(NULL);
+    }
+};
+
+} // namespace esp32otapull
+
+using esp32otapull::ESP32OTAPullDNSCache;
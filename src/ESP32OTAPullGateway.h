@@ -0,0 +1,365 @@
+/*
+ESP32-OTA-Pull - a site gateway that caches updates for other devices
+
+MIT License
+
+Copyright (c) 2022-3 Mikal Hart
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+/*
+One device with an SD card (or a large flash filesystem) fetches the JSON and its
+images from the cloud once, stores the images under their SHA256 and serves both
+over plain HTTP, with ETag and Range support.  The JSON it serves has every "URL"
+pointing at the gateway and every entry's "SHA256" and "Size" filled in, so devices
+verify what they get from it.
+
+The gateway serves the JSON at the same path as the cloud URL and advertises itself
+as _esp32ota._tcp, so devices with EnableLocalMirror() find it on their own; others
+can use http://<gateway>/ota/manifest.json as their JSON_URL.
+
+    ESP32OTAPull ota;
+    ESP32OTAPullGateway gateway(ota, SD);
+
+    void setup()
+    {
+        ... connect to WiFi, SD.begin() ...
+        MDNS.begin("ota-gateway");
+        gateway.Begin("https://example.com/myimages/firmware.json");
+    }
+
+    void loop()
+    {
+        static uint32_t lastSync = 0;
+        if (lastSync == 0 || millis() - lastSync > 3600000)
+        {
+            gateway.Sync();
+            lastSync = millis();
+        }
+        gateway.Loop();
+    }
+*/
+
+#pragma once
+#include <FS.h>
+#include <WebServer.h>
+#include "ESP32OTAPull.h"
+#include "ESP32OTAPullRange.h"
+#include "ESP32OTAPullStorageSink.h"
+
+class ESP32OTAPullGateway
+{
+public:
+    /// @param ota Supplies the TLS settings and debug output used for the upstream requests
+    /// @param fs Where manifests and images are stored, e.g. SD or LittleFS
+    /// @param port HTTP port to serve on
+    ESP32OTAPullGateway(ESP32OTAPull &ota, fs::FS &fs, uint16_t port = 80) : OTA(ota), Files(fs), Server(port), Port(port)
+    {
+    }
+
+    /// @brief Start serving whatever an earlier Sync() stored.  Call after MDNS.begin().
+    /// @param JSON_URL The upstream JSON that Sync() mirrors
+    void Begin(const char *JSON_URL)
+    {
+        ManifestURL = JSON_URL;
+        const char *host = strstr(JSON_URL, "://");
+        const char *path = host == NULL ? NULL : strchr(host + 3, '/');
+        ManifestPath = path == NULL ? "/" : path;
+        int query = ManifestPath.indexOf('?'), fragment = ManifestPath.indexOf('#');
+        int end = query < 0 ? fragment : fragment < 0 ? query : min(query, fragment);
+        if (end >= 0)
+            ManifestPath = ManifestPath.substring(0, end); // WebServer::uri() has neither
+        if (ManifestPath.isEmpty())
+            ManifestPath = "/";
+        Files.mkdir("/ota");
+        ESP32OTAPullRestoreFile(Files, "/ota/manifest.json");
+        File manifest = Files.open("/ota/manifest.json", FILE_READ);
+        if (manifest)
+        {
+            ManifestETag = HashFile(manifest).substring(0, 16);
+            manifest.close();
+        }
+
+        const char *collect[] = { "Range", "If-None-Match" };
+        Server.collectHeaders(collect, 2);
+        Server.onNotFound([this]() { HandleRequest(); });
+        Server.begin();
+        MDNS.addService("esp32ota", "tcp", Port);
+        Serving = true;
+    }
+
+    /// @brief Fetch the upstream JSON and any images not yet stored, then publish the new JSON.
+    ///        Blocks while downloading.  If anything fails, the previous JSON and images stay in service.
+    /// @return UPDATE_OK if a new JSON was published, NO_UPDATE_AVAILABLE if the upstream JSON is unchanged,
+    ///         else ErrorCode or HTTP failure code
+    int Sync()
+    {
+        ESP32OTAPullRestoreFile(Files, "/ota/manifest.json");
+        JsonDocument doc;
+        String etag;
+        {
+            ESP32OTAPullSession session;
+            OTA.ConfigureHTTPClient(session, ManifestURL.c_str());
+            String self = ESP32OTAPull::LocalIP().toString();
+            if (!UpstreamETag.isEmpty() && self == PublishedIP)
+                session.http.addHeader("If-None-Match", UpstreamETag);
+            const char *collect[] = { "ETag" };
+            session.http.collectHeaders(collect, 1);
+            int httpResponseCode = session.GET();
+            if (OTA.Debugging())
+                Serial.printf("Gateway: JSON response %d\n", httpResponseCode);
+            if (httpResponseCode == 304)
+                return ESP32OTAPull::NO_UPDATE_AVAILABLE;
+            if (httpResponseCode != 200)
+                return httpResponseCode > 0 ? httpResponseCode : ESP32OTAPull::HTTP_FAILED;
+            if (deserializeJson(doc, session.http.getStream()))
+                return ESP32OTAPull::JSON_PROBLEM;
+            etag = session.http.header("ETag");
+        }
+
+        String base = String("http://") + ESP32OTAPull::LocalIP().toString() + ":" + String(Port) + "/ota/";
+        String stored = "";
+        for (JsonObject config : doc["Configurations"].as<JsonArray>())
+        {
+            const char *url = config["URL"];
+            if (url == NULL || *url == '\0')
+                continue;
+            char sha256[65];
+            strlcpy(sha256, config["SHA256"].isNull() ? "" : (const char *)config["SHA256"], sizeof(sha256));
+            for (char *c = sha256; *c; ++c)
+                *c = tolower(*c);
+            uint32_t size = 0;
+            int ret = Store(url, sha256, size);
+            if (ret != ESP32OTAPull::UPDATE_OK)
+                return ret;
+            config["URL"] = base + sha256;
+            config["SHA256"] = sha256;
+            config["Size"] = size;
+            stored += sha256;
+            stored += ' ';
+        }
+
+        File manifest = Files.open("/ota/manifest.tmp", FILE_WRITE);
+        if (!manifest)
+            return ESP32OTAPull::WRITE_ERROR;
+        bool written = serializeJson(doc, manifest) == measureJson(doc);
+        manifest.close();
+        if (!written)
+            return ESP32OTAPull::WRITE_ERROR;
+        if (!ESP32OTAPullReplaceFile(Files, "/ota/manifest.tmp", "/ota/manifest.json"))
+            return ESP32OTAPull::WRITE_ERROR;
+        manifest = Files.open("/ota/manifest.json", FILE_READ);
+        ManifestETag = HashFile(manifest).substring(0, 16);
+        manifest.close();
+        UpstreamETag = etag;
+        PublishedIP = ESP32OTAPull::LocalIP().toString();
+        Prune(stored);
+        return ESP32OTAPull::UPDATE_OK;
+    }
+
+    /// @brief Serve pending requests; call regularly from loop()
+    void Loop()
+    {
+        if (Serving)
+            Server.handleClient();
+    }
+
+    void End()
+    {
+        if (!Serving)
+            return;
+        MDNS.removeService("esp32ota", "tcp");
+        Server.stop();
+        Serving = false;
+    }
+
+private:
+    ESP32OTAPull &OTA;
+    fs::FS &Files;
+    WebServer Server;
+    uint16_t Port;
+    bool Serving = false;
+    String ManifestURL = "";
+    String ManifestPath = "";
+    String ManifestETag = "";
+    String UpstreamETag = "";
+    String PublishedIP = "";
+
+    static String HashFile(File &file)
+    {
+        uint8_t buffer[1024];
+        ESP32OTAPullSHA256 hash;
+        hash.Begin();
+        for (size_t n; (n = file.read(buffer, sizeof(buffer))) > 0; )
+            hash.Add(buffer, n);
+        char hex[65];
+        hash.Finish(hex);
+        return hex;
+    }
+
+    // Make sure /ota/<sha256> holds the image at url; fills in sha256 (if empty) and size
+    int Store(const char *url, char *sha256, uint32_t &size)
+    {
+        String path = String("/ota/") + sha256;
+        if (sha256[0] != '\0' && Files.exists(path))
+        {
+            File existing = Files.open(path, FILE_READ);
+            size = existing.size();
+            existing.close();
+            return ESP32OTAPull::UPDATE_OK;
+        }
+
+        ESP32OTAPullSession session;
+        OTA.ConfigureHTTPClient(session, url);
+        int httpResponseCode = session.GET();
+        if (httpResponseCode != 200)
+            return httpResponseCode > 0 ? httpResponseCode : ESP32OTAPull::HTTP_FAILED;
+        int totalLength = session.http.getSize();
+        File image = Files.open("/ota/image.tmp", FILE_WRITE);
+        if (!image)
+            return ESP32OTAPull::WRITE_ERROR;
+
+        if (OTA.Debugging())
+            Serial.printf("Gateway: caching %s\n", url);
+        ESP32OTAPullSHA256 hash;
+        hash.Begin();
+        uint8_t buff[1280];
+        WiFiClient *stream = session.http.getStreamPtr();
+        int offset = 0;
+        bool failed = false;
+        uint32_t lastData = millis();
+        while (session.http.connected() && (totalLength < 0 || offset < totalLength))
+        {
+            size_t sizeAvail = stream->available();
+            if (sizeAvail == 0)
+            {
+                // A stalled upstream would otherwise keep the gateway from serving anything
+                if ((failed = millis() - lastData > OTA.Tuning().ReadTimeoutMs))
+                    break;
+                delay(1);
+                continue;
+            }
+            size_t bytes_read = stream->readBytes(buff, min(sizeAvail, sizeof(buff)));
+            if ((failed = image.write(buff, bytes_read) != bytes_read))
+                break;
+            hash.Add(buff, bytes_read);
+            offset += bytes_read;
+            lastData = millis();
+            if (OTA.Callback != NULL)
+                OTA.Callback(offset, totalLength);
+        }
+        image.close();
+        session.Close();
+
+        char computed[65];
+        hash.Finish(computed);
+        int ret = failed || (totalLength >= 0 && offset != totalLength) ? ESP32OTAPull::WRITE_ERROR :
+                  sha256[0] != '\0' && strcmp(computed, sha256) != 0 ? ESP32OTAPull::VERIFY_FAIL : ESP32OTAPull::UPDATE_OK;
+        if (ret != ESP32OTAPull::UPDATE_OK)
+        {
+            Files.remove("/ota/image.tmp");
+            return ret;
+        }
+        strcpy(sha256, computed);
+        size = offset;
+        path = String("/ota/") + sha256;
+        return ESP32OTAPullReplaceFile(Files, "/ota/image.tmp", path) ? ESP32OTAPull::UPDATE_OK : ESP32OTAPull::WRITE_ERROR;
+    }
+
+    // Remove images that the current JSON no longer refers to
+    void Prune(const String &stored)
+    {
+        File dir = Files.open("/ota");
+        if (!dir || !dir.isDirectory())
+            return;
+        String remove = "";
+        for (File file = dir.openNextFile(); file; file = dir.openNextFile())
+        {
+            String name = file.name();
+            name = name.substring(name.lastIndexOf('/') + 1);
+            if (name.length() == 64 && stored.indexOf(name) < 0)
+                remove += String("/ota/") + name + " ";
+            file.close();
+        }
+        dir.close();
+        for (int start = 0, end; (end = remove.indexOf(' ', start)) >= 0; start = end + 1)
+            Files.remove(remove.substring(start, end));
+    }
+
+    void HandleRequest()
+    {
+        String uri = Server.uri();
+        if (Server.method() != HTTP_GET && Server.method() != HTTP_HEAD)
+            Server.send(405, "text/plain", "Method not allowed");
+        else if ((uri == ManifestPath || uri == "/ota/manifest.json") && !ManifestETag.isEmpty())
+            SendFile("/ota/manifest.json", ManifestETag, "application/json");
+        else if (uri.startsWith("/ota/") && uri.length() == 5 + 64 && uri.indexOf('.') < 0)
+            SendFile(uri, uri.substring(5), "application/octet-stream");
+        else
+            Server.send(404, "text/plain", "Not found");
+    }
+
+    void SendFile(const String &path, const String &etag, const char *contentType)
+    {
+        File file = Files.open(path, FILE_READ);
+        if (!file || file.isDirectory())
+        {
+            Server.send(404, "text/plain", "Not found");
+            return;
+        }
+        String quoted = String("\"") + etag + "\"";
+        if (Server.header("If-None-Match") == quoted)
+        {
+            Server.sendHeader("ETag", quoted);
+            Server.send(304, contentType, "");
+            return;
+        }
+
+        uint32_t size = file.size(), first, last;
+        int status = ESP32OTAPullParseRange(Server.hasHeader("Range") ? Server.header("Range").c_str() : NULL, size, first, last);
+        if (status == 416)
+        {
+            Server.sendHeader("Content-Range", String("bytes */") + String(size));
+            Server.send(416, "text/plain", "");
+            return;
+        }
+        bool partial = status == 206;
+
+        Server.sendHeader("ETag", quoted);
+        Server.sendHeader("Accept-Ranges", "bytes");
+        if (partial)
+            Server.sendHeader("Content-Range", String("bytes ") + String(first) + "-" + String(last) + "/" + String(size));
+        Server.setContentLength(size == 0 ? 0 : last - first + 1);
+        Server.send(partial ? 206 : 200, contentType, "");
+        if (Server.method() == HTTP_HEAD || size == 0)
+            return;
+
+        uint8_t buffer[1024];
+        file.seek(first);
+        for (uint32_t offset = first; offset <= last; offset += sizeof(buffer))
+        {
+            size_t length = min((uint32_t)sizeof(buffer), last + 1 - offset);
+            if (file.read(buffer, length) != length || Server.client().write(buffer, length) != length)
+                break;
+        }
+        file.close();
+    }
+};
@@ -0,0 +1,622 @@
+/*
+ESP32-OTA-Pull - the Arduino facilities the library uses, on plain ESP-IDF
+
+MIT License
+
+Copyright (c) 2022-3 Mikal Hart
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+Included by ESP32OTAPullPlatform.h when the library is built as an ESP-IDF component
+without the Arduino core.  The library itself talks to esp_http_client, esp_ota_*,
+NVS and esp_netif directly; what remains of the Arduino API in it (String, Serial,
+millis(), HTTPClient for the JSON, MDNS for peers and mirrors) is provided here, just
+as far as the library needs it, on top of the IDF equivalents and inside namespace
+esp32otapull, so that the application sees none of it unless it asks (esp32otapull::Serial):
+
+    String          std::string
+    Serial          stdout (the IDF console)
+    millis/delay    esp_timer_get_time() / vTaskDelay()
+    ESP.restart     esp_restart()
+    HTTPClient      esp_http_client_open/fetch_headers/read
+    MDNS            the espressif/mdns component (unless ESP32OTAPULL_MDNS is 0)
+
+Only the core (ESP32OTAPull.h with its crypto, tracing and the IDF and partition sinks)
+builds this way.  ESP32OTAPullUpdateSink, the file sink and the add-ons (peer server,
+multicast, gateway, notifier, UART sink) use Update, fs::FS, WebServer, WiFiUDP or Stream
+from the Arduino core and remain Arduino-only.
+*/
+
+#pragma once
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <algorithm>
+#include <string>
+#include <utility>
+#include <vector>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <esp_attr.h>
+#include <esp_system.h>
+#include <esp_timer.h>
+#include <esp_http_client.h>
+#if ESP32OTAPULL_MDNS
+#include <mdns.h>
+#endif
+#if CONFIG_MBEDTLS_CERTIFICATE_BUNDLE
+#include <esp_crt_bundle.h>
+#endif
+
+// The library's namespace, in which the core finds these under their Arduino names
+namespace esp32otapull
+{
+
+// Negative HTTPClient results, as returned by GET() and POST()
+const int HTTPC_ERROR_CONNECTION_REFUSED  = -1;
+const int HTTPC_ERROR_SEND_PAYLOAD_FAILED = -3;
+const int HTTPC_ERROR_NOT_CONNECTED       = -4;
+const int HTTPC_ERROR_CONNECTION_LOST     = -5;
+const int HTTPC_ERROR_TOO_LESS_RAM        = -8;
+const int HTTPC_ERROR_READ_TIMEOUT        = -11;
+
+using std::min;
+using std::max;
+
+inline unsigned long millis()
+{
+    return (unsigned long)(esp_timer_get_time() / 1000);
+}
+
+inline unsigned long micros()
+{
+    return (unsigned long)esp_timer_get_time();
+}
+
+inline void delay(uint32_t ms)
+{
+    vTaskDelay(pdMS_TO_TICKS(ms));
+}
+
+class String
+{
+public:
+    String(const char *text = "") : Text(text == NULL ? "" : text) {}
+    String(const std::string &text) : Text(text) {}
+    explicit String(int value) : Text(std::to_string(value)) {}
+    explicit String(unsigned int value) : Text(std::to_string(value)) {}
+    explicit String(long value) : Text(std::to_string(value)) {}
+    explicit String(unsigned long value) : Text(std::to_string(value)) {}
+
+    const char *c_str() const { return Text.c_str(); }
+    unsigned int length() const { return Text.length(); }
+    bool isEmpty() const { return Text.empty(); }
+    char operator[](unsigned int index) const { return index < Text.length() ? Text[index] : '\0'; }
+
+    String &operator+=(const String &other) { Text += other.Text; return *this; }
+    String &operator+=(const char *other) { Text += other; return *this; }
+    String &operator+=(char c) { Text += c; return *this; }
+    friend String operator+(String a, const String &b) { return a += b; }
+
+    friend bool operator==(const String &a, const String &b) { return a.Text == b.Text; }
+    friend bool operator!=(const String &a, const String &b) { return a.Text != b.Text; }
+    friend bool operator<(const String &a, const String &b) { return a.Text < b.Text; }
+    friend bool operator>(const String &a, const String &b) { return a.Text > b.Text; }
+
+    bool equalsIgnoreCase(const String &other) const { return strcasecmp(c_str(), other.c_str()) == 0; }
+    bool startsWith(const String &prefix) const { return Text.compare(0, prefix.Text.length(), prefix.Text) == 0; }
+
+    int indexOf(char c, unsigned int from = 0) const { return Find(Text.find(c, from)); }
+    int indexOf(const String &s, unsigned int from = 0) const { return Find(Text.find(s.Text, from)); }
+    int lastIndexOf(char c) const { return Find(Text.rfind(c)); }
+
+    String substring(unsigned int from, unsigned int to = (unsigned int)-1) const
+    {
+        if (from >= Text.length() || to <= from)
+            return String();
+        return String(Text.substr(from, to - from));
+    }
+
+    void replace(const String &find, const String &with)
+    {
+        if (find.isEmpty())
+            return;
+        for (size_t at = Text.find(find.Text); at != std::string::npos; at = Text.find(find.Text, at + with.Text.length()))
+            Text.replace(at, find.Text.length(), with.Text);
+    }
+
+    void toLowerCase()
+    {
+        for (char &c : Text)
+            c = tolower((unsigned char)c);
+    }
+
+private:
+    std::string Text;
+
+    static int Find(size_t at)
+    {
+        return at == std::string::npos ? -1 : (int)at;
+    }
+};
+
+// Formatted text output; Serial writes to the IDF console
+class Print
+{
+public:
+    virtual ~Print() {}
+    virtual size_t write(const uint8_t *data, size_t length) = 0;
+
+    size_t print(const char *text) { return write((const uint8_t *)text, strlen(text)); }
+    size_t print(const String &text) { return print(text.c_str()); }
+    size_t print(char c) { return write((const uint8_t *)&c, 1); }
+    size_t print(long value, int base = 10) { return printf(base == 16 ? "%lx" : "%ld", value); }
+    size_t print(int value, int base = 10) { return print((long)value, base); }
+    size_t print(unsigned long value, int base = 10) { return printf(base == 16 ? "%lx" : "%lu", value); }
+    size_t print(unsigned int value, int base = 10) { return print((unsigned long)value, base); }
+
+    size_t println() { return print("\n"); }
+    template <typename T> size_t println(const T &value) { return print(value) + println(); }
+    template <typename T> size_t println(const T &value, int base) { return print(value, base) + println(); }
+
+    __attribute__((format(printf, 2, 3))) size_t printf(const char *format, ...)
+    {
+        char small[128];
+        va_list args;
+        va_start(args, format);
+        int length = vsnprintf(small, sizeof(small), format, args);
+        va_end(args);
+        if (length < 0)
+            return 0;
+        if ((size_t)length < sizeof(small))
+            return write((const uint8_t *)small, length);
+        std::vector<char> large(length + 1);
+        va_start(args, format);
+        vsnprintf(large.data(), large.size(), format, args);
+        va_end(args);
+        return write((const uint8_t *)large.data(), length);
+    }
+};
+
+class ESP32OTAPullConsole : public Print
+{
+public:
+    size_t write(const uint8_t *data, size_t length) override
+    {
+        return fwrite(data, 1, length, stdout);
+    }
+};
+
+inline ESP32OTAPullConsole Serial;
+
+struct ESP32OTAPullSystem
+{
+    void restart() { esp_restart(); }
+    uint32_t getFreeHeap() { return esp_get_free_heap_size(); }
+};
+
+inline ESP32OTAPullSystem ESP;
+
+// An IPv4 address in lwIP (network) byte order
+class IPAddress
+{
+public:
+    IPAddress(uint32_t address = 0) : Address(address) {}
+    operator uint32_t() const { return Address; }
+
+    String toString() const
+    {
+        char text[16];
+        snprintf(text, sizeof(text), "%u.%u.%u.%u", (unsigned)(Address & 0xff), (unsigned)((Address >> 8) & 0xff),
+                 (unsigned)((Address >> 16) & 0xff), (unsigned)(Address >> 24));
+        return text;
+    }
+
+private:
+    uint32_t Address;
+};
+
+// The connection an HTTPClient request goes over: carries the TLS settings for https:// and,
+// once the headers are in, reads the body (it is the "stream" of getStream())
+class WiFiClient
+{
+public:
+    virtual ~WiFiClient() {}
+
+    int available()
+    {
+        if (Head == Tail)
+            Fill();
+        return Tail - Head;
+    }
+
+    int read()
+    {
+        uint8_t c;
+        return readBytes(&c, 1) == 1 ? c : -1;
+    }
+
+    /// @brief Read up to length bytes, waiting for them as long as the request's timeout allows
+    size_t readBytes(uint8_t *buffer, size_t length)
+    {
+        size_t done = 0;
+        while (done < length)
+        {
+            if (Head < Tail)
+            {
+                size_t n = min(length - done, (size_t)(Tail - Head));
+                memcpy(buffer + done, Buffer + Head, n);
+                Head += n;
+                done += n;
+            }
+            else if (!Receive(buffer + done, length - done, done))
+                break;
+        }
+        return done;
+    }
+
+    size_t readBytes(char *buffer, size_t length)
+    {
+        return readBytes((uint8_t *)buffer, length);
+    }
+
+protected:
+    friend class HTTPClient;
+    bool Secure = false;
+    bool Insecure = false;
+    const char *CACert = NULL;
+    const char *Certificate = NULL;
+    const char *PrivateKey = NULL;
+    int TLSError = 0;
+
+private:
+    esp_http_client_handle_t Client = NULL;
+    bool Ended = false;
+    uint8_t Buffer[1024];
+    int Head = 0, Tail = 0;
+
+    void Attach(esp_http_client_handle_t client)
+    {
+        Client = client;
+        Ended = client == NULL;
+        Head = Tail = 0;
+    }
+
+    void Fill()
+    {
+        Head = Tail = 0;
+        size_t got = 0;
+        Receive(Buffer, sizeof(Buffer), got);
+        Tail = got;
+    }
+
+    // Read straight into buffer; adds the bytes read to count, false at the end of the body or on error
+    bool Receive(uint8_t *buffer, size_t length, size_t &count)
+    {
+        if (Client == NULL || Ended)
+            return false;
+        int n = esp_http_client_read(Client, (char *)buffer, length);
+        if (n <= 0)
+        {
+            if (n != -ESP_ERR_HTTP_EAGAIN)
+                Ended = true;
+            return false;
+        }
+        count += n;
+        return true;
+    }
+};
+
+typedef WiFiClient Stream;
+
+class WiFiClientSecure : public WiFiClient
+{
+public:
+    WiFiClientSecure()
+    {
+        Secure = true;
+    }
+
+    void setInsecure() { Insecure = true; CACert = NULL; }
+    void setCACert(const char *rootCA) { CACert = rootCA; Insecure = false; }
+    void setCertificate(const char *cert) { Certificate = cert; }
+    void setPrivateKey(const char *key) { PrivateKey = key; }
+
+    /// @return The mbedTLS error of the last failed connection, or 0
+    int lastError(char *message, size_t size)
+    {
+        if (size > 0)
+            snprintf(message, size, "%d", TLSError);
+        return TLSError;
+    }
+};
+
+// One request over esp_http_client, with HTTPClient's begin/addHeader/GET/getStream sequence
+class HTTPClient
+{
+public:
+    HTTPClient() {}
+    HTTPClient(const HTTPClient &) = delete;
+    HTTPClient &operator=(const HTTPClient &) = delete;
+
+    ~HTTPClient()
+    {
+        end();
+    }
+
+    bool begin(WiFiClient &client, const String &url)
+    {
+        // With setReuse, a request over the same connection keeps the esp_http_client handle, and with
+        // it the open socket; esp_http_client reconnects by itself if the host differs
+        if (Reuse && Client != NULL && Connection == &client)
+        {
+            for (const std::pair<String, String> &h : Headers)
+                esp_http_client_delete_header(Client, h.first.c_str());
+            Headers.clear();
+            Size = -1;
+            URL = url;
+            return esp_http_client_set_url(Client, URL.c_str()) == ESP_OK;
+        }
+        end();
+        Connection = &client;
+        URL = url;
+        return true;
+    }
+
+    // esp_http_client speaks HTTP/1.1 and reads the body to its Content-Length either way
+    void useHTTP10(bool) {}
+
+    void setReuse(bool reuse) { Reuse = reuse; }
+
+    // esp_http_client has a single timeout for connecting and for each read; the longer of the two is used
+    void setConnectTimeout(int32_t ms) { ConnectTimeout = ms; }
+    void setTimeout(uint16_t ms) { ReadTimeout = ms; }
+
+    void addHeader(const String &name, const String &value)
+    {
+        Headers.push_back(std::make_pair(name, value));
+    }
+
+    void collectHeaders(const char *names[], size_t count)
+    {
+        Collected.clear();
+        for (size_t i = 0; i < count; ++i)
+            Collected.push_back(std::make_pair(String(names[i]), String()));
+    }
+
+    String header(const char *name)
+    {
+        for (const std::pair<String, String> &h : Collected)
+            if (h.first.equalsIgnoreCase(name))
+                return h.second;
+        return String();
+    }
+
+    int GET()
+    {
+        return Send(HTTP_METHOD_GET, NULL, 0);
+    }
+
+    int POST(const String &body)
+    {
+        return Send(HTTP_METHOD_POST, body.c_str(), body.length());
+    }
+
+    /// @return The Content-Length, or -1 if not given (e.g. a chunked response)
+    int getSize()
+    {
+        return Size;
+    }
+
+    WiFiClient &getStream()
+    {
+        return *Connection;
+    }
+
+    WiFiClient *getStreamPtr()
+    {
+        return Connection;
+    }
+
+    bool connected()
+    {
+        return Connection != NULL && Connection->Client != NULL && !Connection->Ended;
+    }
+
+    void end()
+    {
+        if (Connection != NULL)
+            Connection->Attach(NULL);
+        Connection = NULL;
+        if (Client != NULL)
+        {
+            esp_http_client_close(Client);
+            esp_http_client_cleanup(Client);
+            Client = NULL;
+        }
+        Headers.clear();
+        Size = -1;
+    }
+
+private:
+    WiFiClient *Connection = NULL;
+    esp_http_client_handle_t Client = NULL;
+    bool Reuse = false;
+    String URL;
+    int32_t ConnectTimeout = 5000;
+    uint16_t ReadTimeout = 5000;
+    std::vector<std::pair<String, String>> Headers;
+    std::vector<std::pair<String, String>> Collected;
+    int Size = -1;
+
+    static esp_err_t Event(esp_http_client_event_t *event)
+    {
+        HTTPClient *self = static_cast<HTTPClient *>(event->user_data);
+        if (event->event_id == HTTP_EVENT_ON_HEADER)
+            for (std::pair<String, String> &h : self->Collected)
+                if (h.first.equalsIgnoreCase(event->header_key))
+                    h.second = event->header_value;
+        return ESP_OK;
+    }
+
+    int Send(esp_http_client_method_t method, const char *body, int length)
+    {
+        if (Connection == NULL)
+            return HTTPC_ERROR_NOT_CONNECTED;
+        if (Client != NULL && Reuse)
+            return Open(method, body, length);
+        if (Client != NULL)
+        {
+            esp_http_client_close(Client);
+            esp_http_client_cleanup(Client);
+        }
+
+        esp_http_client_config_t cfg = {};
+        cfg.url = URL.c_str();
+        cfg.method = method;
+        cfg.timeout_ms = max(ConnectTimeout, (int32_t)ReadTimeout);
+        cfg.event_handler = Event;
+        cfg.user_data = this;
+        cfg.disable_auto_redirect = true; // as HTTPClient, which doesn't follow redirects unless asked
+        if (Connection->Secure)
+        {
+            if (Connection->CACert != NULL)
+                cfg.cert_pem = Connection->CACert;
+#if CONFIG_MBEDTLS_CERTIFICATE_BUNDLE && !CONFIG_ESP_TLS_SKIP_SERVER_CERT_VERIFY
+            else
+                cfg.crt_bundle_attach = esp_crt_bundle_attach; // this build cannot skip verification, so use the bundle
+#endif
+            cfg.client_cert_pem = Connection->Certificate;
+            cfg.client_key_pem = Connection->PrivateKey;
+        }
+
+        Client = esp_http_client_init(&cfg);
+        if (Client == NULL)
+            return HTTPC_ERROR_CONNECTION_REFUSED;
+        return Open(method, body, length);
+    }
+
+    // Send the request on Client, connecting first unless it is still connected from the last one
+    int Open(esp_http_client_method_t method, const char *body, int length)
+    {
+        esp_http_client_set_method(Client, method);
+        for (const std::pair<String, String> &h : Headers)
+            esp_http_client_set_header(Client, h.first.c_str(), h.second.c_str());
+        for (std::pair<String, String> &h : Collected)
+            h.second = String();
+
+        Connection->TLSError = 0;
+        if (esp_http_client_open(Client, length) != ESP_OK)
+        {
+            int flags = 0;
+            esp_http_client_get_and_clear_last_tls_error(Client, &Connection->TLSError, &flags);
+            return HTTPC_ERROR_CONNECTION_REFUSED;
+        }
+        if (length > 0 && esp_http_client_write(Client, body, length) != length)
+            return HTTPC_ERROR_SEND_PAYLOAD_FAILED;
+        int64_t size = esp_http_client_fetch_headers(Client);
+        if (size < 0)
+            return HTTPC_ERROR_READ_TIMEOUT;
+        Size = esp_http_client_is_chunked_response(Client) ? -1 : (int)size;
+        Connection->Attach(Client);
+        return esp_http_client_get_status_code(Client);
+    }
+};
+
+#if ESP32OTAPULL_MDNS
+// mDNS service discovery (the part of ESPmDNS that finds peers and mirrors), on the espressif/mdns component
+class ESP32OTAPullMDNS
+{
+public:
+    ~ESP32OTAPullMDNS()
+    {
+        Clear();
+    }
+
+    bool begin(const char *hostname)
+    {
+        return mdns_init() == ESP_OK && mdns_hostname_set(hostname) == ESP_OK;
+    }
+
+    /// @return The number of instances found of _service._proto
+    int queryService(const char *service, const char *proto)
+    {
+        Clear();
+        char type[32], protocol[8];
+        snprintf(type, sizeof(type), "_%s", service);
+        snprintf(protocol, sizeof(protocol), "_%s", proto);
+        if (mdns_query_ptr(type, protocol, 3000, 20, &Results) != ESP_OK)
+            return 0;
+        int count = 0;
+        for (mdns_result_t *r = Results; r != NULL; r = r->next)
+            ++count;
+        return count;
+    }
+
+    IPAddress IP(int index)
+    {
+        mdns_result_t *r = Result(index);
+        for (mdns_ip_addr_t *a = r == NULL ? NULL : r->addr; a != NULL; a = a->next)
+            if (a->addr.type == ESP_IPADDR_TYPE_V4)
+                return IPAddress(a->addr.u_addr.ip4.addr);
+        return IPAddress();
+    }
+
+    uint16_t port(int index)
+    {
+        mdns_result_t *r = Result(index);
+        return r == NULL ? 0 : r->port;
+    }
+
+    String txt(int index, const char *key)
+    {
+        mdns_result_t *r = Result(index);
+        for (size_t i = 0; r != NULL && i < r->txt_count; ++i)
+            if (strcmp(r->txt[i].key, key) == 0)
+                return r->txt[i].value == NULL ? "" : r->txt[i].value;
+        return String();
+    }
+
+private:
+    mdns_result_t *Results = NULL;
+
+    mdns_result_t *Result(int index)
+    {
+        mdns_result_t *r = Results;
+        while (r != NULL && index-- > 0)
+            r = r->next;
+        return r;
+    }
+
+    void Clear()
+    {
+        if (Results != NULL)
+            mdns_query_results_free(Results);
+        Results = NULL;
+    }
+};
+
+inline ESP32OTAPullMDNS MDNS;
+#endif
+
+} // namespace esp32otapull
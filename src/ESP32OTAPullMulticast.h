@@ -0,0 +1,410 @@
+/*
+ESP32-OTA-Pull - UDP multicast image distribution with forward error correction
+
+MIT License
+
+Copyright (c) 2022-3 Mikal Hart
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+One sender multicasts an image to any number of receivers on the same LAN, so the
+time to update a fleet does not grow with its size.
+
+The image is sent as fixed-size blocks in groups of GroupSize, each group followed
+by a parity block (the XOR of the group's blocks, zero-padded).  A receiver that
+misses one block of a group rebuilds it from the parity block and the others, which
+it reads back from flash, so no reassembly memory is needed.  The sender repeats the
+whole image a few times ("rounds"); whatever a receiver still lacks afterwards is
+fetched with HTTP Range requests from the URL in the JSON.  Blocks are written
+straight to their place in the OTA partition, then the image is checked against the
+JSON's SHA256 before it is made bootable.
+
+Sender (a device that has installed and verified the image, see GetSharedImage):
+
+    ESP32OTAPullMulticastSender sender;
+    sender.Begin(IPAddress(239, 0, 79, 84), 5007);
+    while (sender.Loop())
+        ;
+
+Receivers:
+
+    ESP32OTAPull::OTAConfiguration match;
+    if (ota.CheckForOTAUpdate(JSON_URL, VERSION, match) == ESP32OTAPull::UPDATE_AVAILABLE)
+    {
+        ESP32OTAPullMulticastReceiver receiver(ota);
+        receiver.Receive(match, IPAddress(239, 0, 79, 84), 5007, 120000);
+    }
+*/
+
+#pragma once
+#include <WiFiUdp.h>
+#include "ESP32OTAPull.h"
+
+struct ESP32OTAPullMulticastHeader
+{
+    static constexpr uint32_t MAGIC = 0x4d41544f; // "OTAM"
+    static constexpr uint16_t BLOCK_SIZE = 1024;
+
+    uint32_t Magic;
+    uint32_t Session;       // first four bytes of the image's SHA256
+    uint32_t Size;          // image size in bytes
+    uint32_t Index;         // block index, or group index for a parity block
+    uint16_t Length;        // payload length
+    uint8_t GroupSize;      // data blocks per parity block
+    uint8_t Parity;         // 1 if the payload is the XOR of the group's data blocks
+};
+
+inline uint32_t ESP32OTAPullMulticastSession(const char *sha256)
+{
+    char first[9];
+    strlcpy(first, sha256, sizeof(first));
+    return (uint32_t)strtoul(first, NULL, 16);
+}
+
+class ESP32OTAPullMulticastSender
+{
+public:
+    /// @brief Start multicasting the shared image (see ESP32OTAPull::GetSharedImage)
+    /// @param group Multicast group address, e.g. 239.0.79.84
+    /// @param port UDP port
+    /// @param rounds How many times the whole image is sent
+    /// @param groupSize Data blocks per parity block; smaller groups survive more loss at more overhead
+    /// @param packetsPerSecond Sending rate (each packet carries up to 1 KB)
+    /// @return false if there is no intact shared image
+    bool Begin(IPAddress group, uint16_t port, uint8_t rounds = 3, uint8_t groupSize = 8, uint32_t packetsPerSecond = 250)
+    {
+        Partition = ESP32OTAPull::OpenSharedImage(Image);
+        if (Partition == NULL || groupSize == 0 || packetsPerSecond == 0)
+            return false;
+        Group = group;
+        Port = port;
+        Rounds = rounds;
+        GroupSize = groupSize;
+        Rate = packetsPerSecond;
+        Blocks = (Image.Size + ESP32OTAPullMulticastHeader::BLOCK_SIZE - 1) / ESP32OTAPullMulticastHeader::BLOCK_SIZE;
+        Round = NextBlock = 0;
+        SendParity = false;
+        Sent = 0;
+        Started = millis();
+        return Udp.begin(port) == 1;
+    }
+
+    /// @brief Send the packets that are due at the configured rate; call continually
+    /// @return false once every round has been sent
+    bool Loop()
+    {
+        if (Partition == NULL)
+            return false;
+        uint32_t due = (uint64_t)(millis() - Started) * Rate / 1000;
+        while (Sent < due)
+        {
+            if (Round >= Rounds)
+            {
+                End();
+                return false;
+            }
+            if (!SendNext())
+            {
+                End();
+                return false;
+            }
+            ++Sent;
+        }
+        return true;
+    }
+
+    void End()
+    {
+        Udp.stop();
+        Partition = NULL;
+    }
+
+private:
+    WiFiUDP Udp;
+    IPAddress Group;
+    uint16_t Port = 0;
+    uint8_t Rounds = 0, Round = 0, GroupSize = 1;
+    uint32_t Rate = 1, Blocks = 0, NextBlock = 0, Sent = 0, Started = 0;
+    bool SendParity = false;
+    ESP32OTAPull::SharedImage Image;
+    const esp_partition_t *Partition = NULL;
+    uint8_t Packet[sizeof(ESP32OTAPullMulticastHeader) + ESP32OTAPullMulticastHeader::BLOCK_SIZE];
+    uint8_t ParityBlock[ESP32OTAPullMulticastHeader::BLOCK_SIZE];
+
+    bool SendNext()
+    {
+        ESP32OTAPullMulticastHeader header;
+        header.Magic = ESP32OTAPullMulticastHeader::MAGIC;
+        header.Session = ESP32OTAPullMulticastSession(Image.SHA256);
+        header.Size = Image.Size;
+        header.GroupSize = GroupSize;
+        uint8_t *payload = Packet + sizeof(header);
+
+        if (SendParity)
+        {
+            header.Index = (NextBlock - 1) / GroupSize;
+            header.Length = ESP32OTAPullMulticastHeader::BLOCK_SIZE;
+            header.Parity = 1;
+            memcpy(payload, ParityBlock, sizeof(ParityBlock));
+            SendParity = false;
+            if (NextBlock == Blocks)
+            {
+                NextBlock = 0;
+                ++Round;
+            }
+        }
+        else
+        {
+            uint32_t offset = NextBlock * ESP32OTAPullMulticastHeader::BLOCK_SIZE;
+            header.Index = NextBlock;
+            header.Length = min((uint32_t)ESP32OTAPullMulticastHeader::BLOCK_SIZE, Image.Size - offset);
+            header.Parity = 0;
+            if (esp_partition_read(Partition, offset, payload, header.Length) != ESP_OK)
+                return false;
+            if (NextBlock % GroupSize == 0)
+                memset(ParityBlock, 0, sizeof(ParityBlock));
+            for (uint16_t i = 0; i < header.Length; ++i)
+                ParityBlock[i] ^= payload[i];
+            ++NextBlock;
+            SendParity = NextBlock % GroupSize == 0 || NextBlock == Blocks;
+        }
+
+        memcpy(Packet, &header, sizeof(header));
+        Udp.beginPacket(Group, Port);
+        Udp.write(Packet, sizeof(header) + header.Length);
+        Udp.endPacket();
+        return true;
+    }
+};
+
+class ESP32OTAPullMulticastReceiver
+{
+public:
+    ESP32OTAPullMulticastReceiver(ESP32OTAPull &ota) : OTA(ota)
+    {
+    }
+
+    /// @brief Install an image from a multicast sender, falling back to HTTP Range requests for missing blocks
+    /// @param config The entry from CheckForOTAUpdate; must have "Size" and "SHA256", and no encryption or "Target"
+    /// @param group Multicast group address
+    /// @param port UDP port
+    /// @param timeoutMs How long to listen at most; listening also stops 5 s after the last packet
+    /// @param Action UPDATE_BUT_NO_BOOT or UPDATE_AND_BOOT (default)
+    /// @return UPDATE_OK or ErrorCode or HTTP failure code, as for ESP32OTAPull::DownloadUpdate.  Under SetDryRun
+    ///         nothing is written to flash, so UPDATE_OK only means every block arrived or could be rebuilt;
+    ///         the SHA256 can't be checked against blocks that arrive out of order and are not kept.
+    int Receive(const ESP32OTAPull::OTAConfiguration &config, IPAddress group, uint16_t port, uint32_t timeoutMs,
+        ESP32OTAPull::ActionType Action = ESP32OTAPull::UPDATE_AND_BOOT)
+    {
+        ESP32OTAPull::OTAConfiguration entry = config; // config may be OTA.LastResult.Configuration itself
+        OTA.ResetResult();
+        OTA.ResetMemoryReport();
+        OTA.LastResult.Matched = true;
+        OTA.LastResult.Configuration = entry;
+        OTA.CVersion = config.Version;
+        if (config.SHA256[0] == '\0' || config.Size == 0 || config.Encryption != ESP32OTAPullDecryptor::NONE ||
+            config.Target[0] != '\0')
+            return OTA.Finish(ESP32OTAPull::OTA_UPDATE_FAIL);
+
+        uint32_t started = millis();
+        Size = config.Size;
+        Session = ESP32OTAPullMulticastSession(config.SHA256);
+        Blocks = (Size + ESP32OTAPullMulticastHeader::BLOCK_SIZE - 1) / ESP32OTAPullMulticastHeader::BLOCK_SIZE;
+        Partition = esp_ota_get_next_update_partition(NULL);
+        std::unique_ptr<uint8_t[]> have(new (std::nothrow) uint8_t[(Blocks + 7) / 8]());
+        Have = have.get();
+        Received = 0;
+        DryRun = OTA.DryRun;
+        if (Partition == NULL || Size > Partition->size || Have == NULL)
+            return OTA.Finish(ESP32OTAPull::OTA_UPDATE_FAIL);
+
+        ESP32OTAPULL_TRACE_BEGIN(OTA_TRACE_ERASE);
+        bool erased = DryRun || esp_partition_erase_range(Partition, 0, (Size + 4095) & ~4095) == ESP_OK;
+        ESP32OTAPULL_TRACE_END(OTA_TRACE_ERASE);
+        if (!erased)
+            return OTA.Finish(ESP32OTAPull::OTA_UPDATE_FAIL);
+
+        ESP32OTAPULL_TRACE_BEGIN(OTA_TRACE_WRITE);
+        Listen(group, port, timeoutMs);
+        if (OTA.Debugging())
+            Serial.printf("Multicast: %u of %u blocks received\n", (unsigned)Received, (unsigned)Blocks);
+        int ret = FetchMissing(config.URL);
+        ESP32OTAPULL_TRACE_END(OTA_TRACE_WRITE);
+
+        if (ret == ESP32OTAPull::UPDATE_OK && !DryRun)
+        {
+            ESP32OTAPULL_TRACE_BEGIN(OTA_TRACE_VERIFY);
+            OTA.LastResult.HashVerified = Verify(config.SHA256);
+            ret = !OTA.LastResult.HashVerified ? ESP32OTAPull::VERIFY_FAIL :
+                  esp_ota_set_boot_partition(Partition) == ESP_OK ? ESP32OTAPull::UPDATE_OK : ESP32OTAPull::OTA_UPDATE_FAIL;
+            ESP32OTAPULL_TRACE_END(OTA_TRACE_VERIFY);
+        }
+        OTA.LastResult.DownloadBytes = Size;
+        OTA.LastResult.DownloadMillis = millis() - started;
+        if (DryRun)
+            return OTA.Finish(ret);
+        return OTA.CompleteUpdate(ret, Action);
+    }
+
+private:
+    ESP32OTAPull &OTA;
+    const esp_partition_t *Partition = NULL;
+    uint32_t Size = 0, Session = 0, Blocks = 0, Received = 0;
+    uint8_t *Have = NULL;
+    bool DryRun = false;                // only keep track of which blocks arrived (see SetDryRun)
+    uint8_t Packet[sizeof(ESP32OTAPullMulticastHeader) + ESP32OTAPullMulticastHeader::BLOCK_SIZE];
+    uint8_t Block[ESP32OTAPullMulticastHeader::BLOCK_SIZE];
+
+    bool Has(uint32_t block) { return Have[block / 8] & (1 << (block % 8)); }
+
+    uint16_t BlockLength(uint32_t block)
+    {
+        return min((uint32_t)ESP32OTAPullMulticastHeader::BLOCK_SIZE, Size - block * ESP32OTAPullMulticastHeader::BLOCK_SIZE);
+    }
+
+    bool Store(uint32_t block, const uint8_t *data)
+    {
+        if (!DryRun && esp_partition_write(Partition, block * ESP32OTAPullMulticastHeader::BLOCK_SIZE, data, BlockLength(block)) != ESP_OK)
+            return false;
+        Have[block / 8] |= 1 << (block % 8);
+        ++Received;
+        OTA.SampleMemory();
+        if (OTA.Callback != NULL)
+            OTA.Callback(min(Received * ESP32OTAPullMulticastHeader::BLOCK_SIZE, Size), Size);
+        return true;
+    }
+
+    // Rebuild the one missing block of a group from its parity block and the blocks already in flash
+    void Repair(uint32_t groupIndex, uint8_t groupSize, const uint8_t *parity)
+    {
+        uint32_t first = groupIndex * groupSize, last = min(first + groupSize, Blocks), missing = Blocks;
+        for (uint32_t b = first; b < last; ++b)
+        {
+            if (Has(b))
+                continue;
+            if (missing != Blocks)
+                return; // more than one missing: needs a later round or HTTP
+            missing = b;
+        }
+        if (missing == Blocks)
+            return;
+        if (DryRun)
+        {
+            Store(missing, parity); // the other blocks aren't in flash to rebuild it from, but it could be
+            return;
+        }
+
+        memcpy(Block, parity, sizeof(Block));
+        uint8_t other[64];
+        for (uint32_t b = first; b < last; ++b)
+        {
+            if (b == missing)
+                continue;
+            for (uint16_t done = 0; done < BlockLength(b); done += sizeof(other))
+            {
+                uint16_t length = min((uint16_t)sizeof(other), (uint16_t)(BlockLength(b) - done));
+                if (esp_partition_read(Partition, b * ESP32OTAPullMulticastHeader::BLOCK_SIZE + done, other, length) != ESP_OK)
+                    return;
+                for (uint16_t i = 0; i < length; ++i)
+                    Block[done + i] ^= other[i];
+            }
+        }
+        Store(missing, Block);
+    }
+
+    void Listen(IPAddress group, uint16_t port, uint32_t timeoutMs)
+    {
+        WiFiUDP udp;
+        if (udp.beginMulticast(group, port) != 1)
+            return;
+        uint32_t started = millis(), lastPacket = started;
+        while (Received < Blocks && millis() - started < timeoutMs && !(Received > 0 && millis() - lastPacket > 5000))
+        {
+            int length = udp.parsePacket();
+            if (length < (int)sizeof(ESP32OTAPullMulticastHeader))
+            {
+                delay(1);
+                continue;
+            }
+            length = udp.read(Packet, min((size_t)length, sizeof(Packet)));
+            ESP32OTAPullMulticastHeader header;
+            memcpy(&header, Packet, sizeof(header));
+            if (header.Magic != ESP32OTAPullMulticastHeader::MAGIC || header.Session != Session || header.Size != Size ||
+                header.GroupSize == 0 || length != (int)(sizeof(header) + header.Length))
+                continue;
+            lastPacket = millis();
+            const uint8_t *payload = Packet + sizeof(header);
+            if (header.Parity)
+                Repair(header.Index, header.GroupSize, payload);
+            else if (header.Index < Blocks && header.Length == BlockLength(header.Index) && !Has(header.Index))
+                Store(header.Index, payload);
+        }
+        udp.stop();
+    }
+
+    // Fetch each run of missing blocks with one Range request
+    int FetchMissing(const char *url)
+    {
+        for (uint32_t first = 0; first < Blocks; ++first)
+        {
+            if (Has(first))
+                continue;
+            uint32_t last = first;
+            while (last + 1 < Blocks && !Has(last + 1))
+                ++last;
+
+            ESP32OTAPullSession session;
+            OTA.ConfigureHTTPClient(session, url);
+            uint32_t from = first * ESP32OTAPullMulticastHeader::BLOCK_SIZE;
+            uint32_t to = last * ESP32OTAPullMulticastHeader::BLOCK_SIZE + BlockLength(last) - 1;
+            char range[32];
+            snprintf(range, sizeof(range), "bytes=%u-%u", (unsigned)from, (unsigned)to);
+            session.http.addHeader("Range", range);
+            int httpResponseCode = session.GET();
+            OTA.RecordResponse(session, httpResponseCode);
+            if (httpResponseCode != 206)
+                return httpResponseCode > 0 ? httpResponseCode : ESP32OTAPull::HTTP_FAILED;
+
+            WiFiClient *stream = session.http.getStreamPtr();
+            for (uint32_t b = first; b <= last; ++b)
+            {
+                uint16_t length = BlockLength(b);
+                if (stream->readBytes(Block, length) != length || !Store(b, Block))
+                    return ESP32OTAPull::WRITE_ERROR;
+            }
+            first = last;
+        }
+        return ESP32OTAPull::UPDATE_OK;
+    }
+
+    bool Verify(const char *sha256)
+    {
+        ESP32OTAPullSHA256 hash;
+        hash.Begin();
+        for (uint32_t b = 0; b < Blocks; ++b)
+        {
+            if (esp_partition_read(Partition, b * ESP32OTAPullMulticastHeader::BLOCK_SIZE, Block, BlockLength(b)) != ESP_OK)
+                return false;
+            hash.Add(Block, BlockLength(b));
+        }
+        return hash.Matches(sha256);
+    }
+};
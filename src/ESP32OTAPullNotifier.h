@@ -0,0 +1,344 @@
+/*
+ESP32-OTA-Pull - push notification of new releases over server-sent events or long polling
+
+MIT License
+
+Copyright (c) 2022-3 Mikal Hart
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+/*
+Instead of polling the JSON every few minutes, a device can hold one idle connection
+to a notification URL and check the JSON only when the server says it has changed.
+
+The server may answer in either of two ways:
+
+  - Server-sent events (Content-Type: text/event-stream): the connection stays open
+    and every event named "manifest" (or unnamed) is a notification.  Comment lines
+    (": ping") keep the connection alive through proxies.  The last event's "id" is
+    sent back as Last-Event-ID on reconnection.
+
+  - Long polling (any other response): the server holds the request until the JSON
+    changes and then answers 200, or answers 204 or 304 when its own timeout expires.
+    The device reconnects at once after a 204 or 304 the server held for at least 10 s;
+    after a 200, or an answer that came straight back, it waits as after an error.
+
+Errors and dropped connections are retried with exponential backoff and jitter.
+Loop() never blocks except for the TCP/TLS connect itself.
+
+    ESP32OTAPullNotifier notifier(ota);
+
+    void setup()
+    {
+        ... connect to WiFi ...
+        notifier.Begin("https://example.com/myimages/events");
+        ota.CheckForOTAUpdate(JSON_URL, VERSION);  // catch up on anything missed while offline
+    }
+
+    void loop()
+    {
+        if (notifier.Loop())
+            ota.CheckForOTAUpdate(JSON_URL, VERSION);
+    }
+*/
+
+#pragma once
+#include <memory>
+#include "ESP32OTAPull.h"
+
+class ESP32OTAPullNotifier
+{
+public:
+    ESP32OTAPullNotifier(ESP32OTAPull &ota) : OTA(ota)
+    {
+    }
+
+    /// @brief Start listening for notifications.  The TLS settings of the ESP32OTAPull object apply.
+    /// @param eventsURL The server-sent events or long-poll URL
+    /// @return false if the URL cannot be parsed
+    bool Begin(const char *eventsURL)
+    {
+        URL = eventsURL;
+        Secure = URL.startsWith("https://");
+        int hostStart = URL.indexOf("://");
+        if (hostStart < 0)
+            return false;
+        hostStart += 3;
+        int pathStart = URL.indexOf('/', hostStart);
+        String authority = pathStart < 0 ? URL.substring(hostStart) : URL.substring(hostStart, pathStart);
+        Path = pathStart < 0 ? "/" : URL.substring(pathStart);
+        int colon = authority.indexOf(':');
+        Host = colon < 0 ? authority : authority.substring(0, colon);
+        Port = colon < 0 ? (Secure ? 443 : 80) : authority.substring(colon + 1).toInt();
+        Backoff = 0;
+        NextAttempt = millis();
+        State = WAITING;
+        return !Host.isEmpty() && Port != 0;
+    }
+
+    /// @brief Keep the connection going; call regularly from loop()
+    /// @return true once for every notification, i.e. when the JSON should be checked now
+    bool Loop()
+    {
+        switch (State)
+        {
+            case STOPPED:
+                return false;
+
+            case WAITING:
+                if ((int32_t)(millis() - NextAttempt) >= 0)
+                    Connect();
+                return false;
+
+            case HEADERS:
+            case EVENTS:
+                return Receive();
+        }
+        return false;
+    }
+
+    /// @brief Close the connection and stop listening
+    void End()
+    {
+        Disconnect();
+        State = STOPPED;
+    }
+
+    /// @brief Set the reconnection delays (defaults 1 s and 5 minutes); the delay doubles after each failure
+    /// @return The current ESP32OTAPullNotifier object for chaining
+    ESP32OTAPullNotifier &SetBackoff(uint32_t minimumMs, uint32_t maximumMs)
+    {
+        MinBackoff = minimumMs == 0 ? 1 : minimumMs;
+        MaxBackoff = maximumMs < MinBackoff ? MinBackoff : maximumMs;
+        return *this;
+    }
+
+    /// @brief Reconnect if nothing, not even a keep-alive comment, arrives for this long (default 2 minutes).
+    ///        A long-poll server must answer within this time.
+    /// @return The current ESP32OTAPullNotifier object for chaining
+    ESP32OTAPullNotifier &SetIdleTimeout(uint32_t timeoutMs)
+    {
+        IdleTimeout = timeoutMs;
+        return *this;
+    }
+
+    /// @brief True while a notification connection is established
+    bool IsConnected()
+    {
+        return (State == HEADERS || State == EVENTS) && Connection != NULL && Connection->connected();
+    }
+
+private:
+    enum StateType { STOPPED, WAITING, HEADERS, EVENTS };
+
+    ESP32OTAPull &OTA;
+    StateType State = STOPPED;
+    String URL = "", Host = "", Path = "";
+    uint16_t Port = 0;
+    bool Secure = false;
+    std::unique_ptr<ESP32OTAPullSession> Session;
+    WiFiClient *Connection = NULL;
+
+    uint32_t MinBackoff = 1000, MaxBackoff = 300000, Backoff = 0;
+    uint32_t IdleTimeout = 120000;
+    static constexpr uint32_t LongPollHold = 10000; // shortest hold that counts as a real long poll
+    uint32_t NextAttempt = 0, LastActivity = 0, Connected = 0;
+
+    int Status = 0;
+    bool EventStream = false;
+    char Line[256];
+    size_t LineLength = 0;
+    bool LineTruncated = false;
+    String EventName = "", LastEventId = "", PendingId = "";
+    bool EventHasData = false;
+
+    void Connect()
+    {
+        Disconnect();
+        // Applies the root CA, client certificate, etc., and with EnableDNSCache already connects
+        // to the cached address; the notifier then uses that connection instead of making another
+        Session.reset(new ESP32OTAPullSession());
+        OTA.ConfigureHTTPClient(*Session, URL.c_str());
+        if (Secure)
+            Connection = &Session->SecureClient();
+        else
+            Connection = &Session->PlainClient();
+
+        if (!Connection->connected() && !Connection->connect(Host.c_str(), Port, OTA.Tuning().ConnectTimeoutMs))
+        {
+            if (OTA.Debugging())
+                Serial.printf("Notifier: cannot connect to %s:%u\n", Host.c_str(), Port);
+            Retry(false);
+            return;
+        }
+
+        // HTTP/1.0 so the body is never chunked
+        String request = String("GET ") + Path + " HTTP/1.0\r\nHost: " + Host +
+            "\r\nAccept: text/event-stream\r\nCache-Control: no-cache\r\n";
+        if (!LastEventId.isEmpty())
+            request += String("Last-Event-ID: ") + LastEventId + "\r\n";
+        request += "\r\n";
+        Connection->print(request);
+
+        Status = 0;
+        EventStream = false;
+        LineLength = 0;
+        LineTruncated = false;
+        EventName = "";
+        PendingId = "";
+        EventHasData = false;
+        Connected = LastActivity = millis();
+        State = HEADERS;
+    }
+
+    void Disconnect()
+    {
+        if (Connection != NULL)
+            Connection->stop();
+        Connection = NULL;
+        Session.reset();
+    }
+
+    // Wait before connecting again: immediately after a long poll the server held open, else with growing backoff
+    void Retry(bool immediately)
+    {
+        Disconnect();
+        if (immediately)
+            Backoff = 0;
+        else
+            Backoff = Backoff == 0 ? MinBackoff : min(Backoff * 2, MaxBackoff);
+        uint32_t wait = Backoff == 0 ? 0 : Backoff / 2 + (uint32_t)random(Backoff / 2 + 1);
+        NextAttempt = millis() + wait;
+        State = WAITING;
+        if (OTA.Debugging() && wait > 0)
+            Serial.printf("Notifier: reconnecting in %u ms\n", (unsigned)wait);
+    }
+
+    bool Receive()
+    {
+        bool notified = false;
+        while (State != WAITING && Connection->available() > 0)
+        {
+            int c = Connection->read();
+            if (c < 0)
+                break;
+            LastActivity = millis();
+            if (c == '\r')
+                continue;
+            if (c != '\n')
+            {
+                if (LineLength < sizeof(Line) - 1)
+                    Line[LineLength++] = (char)c;
+                else
+                    LineTruncated = true;
+                continue;
+            }
+            Line[LineLength] = '\0';
+            notified |= State == HEADERS ? HeaderLine() : EventLine();
+            LineLength = 0;
+            LineTruncated = false;
+        }
+
+        if (State == WAITING)
+            return notified;
+        if (!Connection->connected() && Connection->available() == 0)
+        {
+            // A stream that stayed up a while was healthy; start the backoff afresh
+            if (State == EVENTS && millis() - Connected > 60000)
+                Backoff = 0;
+            Retry(false);
+        }
+        else if (millis() - LastActivity > IdleTimeout)
+        {
+            // A long poll gets no headers until the server answers, so the same (long) limit applies to them;
+            // either way the connection was quiet for a long time, so it can be reopened at once
+            if (OTA.Debugging())
+                Serial.println("Notifier: idle timeout");
+            Retry(true);
+        }
+        return notified;
+    }
+
+    bool HeaderLine()
+    {
+        if (Status == 0)
+        {
+            // "HTTP/1.1 200 OK"
+            const char *space = strchr(Line, ' ');
+            Status = space == NULL ? -1 : atoi(space + 1);
+            return false;
+        }
+        if (LineLength > 0)
+        {
+            if (strncasecmp(Line, "Content-Type:", 13) == 0 && strstr(Line + 13, "text/event-stream") != NULL)
+                EventStream = true;
+            return false;
+        }
+
+        // End of headers
+        if (OTA.Debugging())
+            Serial.printf("Notifier: %d %s\n", Status, EventStream ? "(event stream)" : "(long poll)");
+        if (Status == 200 && EventStream)
+        {
+            State = EVENTS;
+            Backoff = 0;
+            return false;
+        }
+        if (Status == 200 || Status == 204 || Status == 304)
+        {
+            // A notification is followed by a check anyway, so there is no hurry to poll again; and
+            // a server that answers at once (one that does not hold long polls, say) is backed off from
+            Retry(Status != 200 && millis() - Connected >= LongPollHold);
+            return Status == 200;
+        }
+        Retry(false);
+        return false;
+    }
+
+    bool EventLine()
+    {
+        if (LineLength == 0)
+        {
+            // Blank line: dispatch the event
+            bool notify = EventHasData && (EventName.isEmpty() || EventName == "manifest");
+            if (EventHasData && !PendingId.isEmpty())
+                LastEventId = PendingId;
+            EventName = "";
+            EventHasData = false;
+            if (OTA.Debugging() && notify)
+                Serial.println("Notifier: manifest changed");
+            return notify;
+        }
+        if (Line[0] == ':' || (LineTruncated && strncmp(Line, "data", 4) != 0))
+            return false; // comment / keep-alive, or a field too long to be one we use
+
+        const char *value = strchr(Line, ':');
+        String field = value == NULL ? String(Line) : String(Line).substring(0, value - Line);
+        value = value == NULL ? "" : value[1] == ' ' ? value + 2 : value + 1;
+        if (field == "event")
+            EventName = value;
+        else if (field == "data")
+            EventHasData = true;
+        else if (field == "id")
+            PendingId = value;
+        return false;
+    }
+};
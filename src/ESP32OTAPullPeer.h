@@ -0,0 +1,140 @@
+/*
+ESP32-OTA-Pull - share installed images with peers on the LAN
+
+MIT License
+
+Copyright (c) 2022-3 Mikal Hart
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+After a device has installed an image whose SHA256 was verified, ESP32OTAPullPeerServer
+serves that image from its app partition over plain HTTP (with Range support) and
+advertises it via mDNS as _esp32otapeer._tcp, with the hash in a "sha256" TXT record.
+Devices that call EnablePeerDownload() look for such a peer before going to the origin
+URL, and check what they receive against the hash in the JSON, so a peer can never
+install anything the JSON does not vouch for.
+
+    ESP32OTAPullPeerServer peers;
+
+    void setup()
+    {
+        ... connect to WiFi ...
+        MDNS.begin("my-device");
+        peers.Begin();
+    }
+
+    void loop()
+    {
+        peers.Loop();
+    }
+*/
+
+#pragma once
+#include <WebServer.h>
+#include "ESP32OTAPull.h"
+#include "ESP32OTAPullRange.h"
+
+class ESP32OTAPullPeerServer
+{
+public:
+    ESP32OTAPullPeerServer(uint16_t port = 8266) : Server(port), Port(port)
+    {
+    }
+
+    /// @brief Start sharing the last verified image, if the partition still holds it intact.
+    ///        Hashes the whole image first, which takes a moment.  Call after MDNS.begin().
+    /// @return true if an image is being shared
+    bool Begin()
+    {
+        Partition = ESP32OTAPull::OpenSharedImage(Image);
+        if (Partition == NULL)
+            return false;
+
+        const char *collect[] = { "Range" };
+        Server.collectHeaders(collect, 1);
+        Server.onNotFound([this]() { HandleRequest(); });
+        Server.begin();
+        MDNS.addService("esp32otapeer", "tcp", Port);
+        MDNS.addServiceTxt("esp32otapeer", "tcp", "sha256", Image.SHA256);
+        Serving = true;
+        return true;
+    }
+
+    /// @brief Serve pending requests; call regularly from loop()
+    void Loop()
+    {
+        if (Serving)
+            Server.handleClient();
+    }
+
+    /// @brief Stop sharing, e.g. before installing another update into the shared partition
+    void End()
+    {
+        if (!Serving)
+            return;
+        MDNS.removeService("esp32otapeer", "tcp");
+        Server.stop();
+        Serving = false;
+    }
+
+private:
+    WebServer Server;
+    uint16_t Port;
+    bool Serving = false;
+    ESP32OTAPull::SharedImage Image;
+    const esp_partition_t *Partition = NULL;
+
+    void HandleRequest()
+    {
+        if (Server.uri() != String("/ota/") + Image.SHA256 || (Server.method() != HTTP_GET && Server.method() != HTTP_HEAD))
+        {
+            Server.send(404, "text/plain", "Not found");
+            return;
+        }
+
+        uint32_t first, last;
+        int status = ESP32OTAPullParseRange(Server.hasHeader("Range") ? Server.header("Range").c_str() : NULL, Image.Size, first, last);
+        if (status == 416)
+        {
+            Server.sendHeader("Content-Range", String("bytes */") + String(Image.Size));
+            Server.send(416, "text/plain", "");
+            return;
+        }
+        bool partial = status == 206;
+
+        Server.sendHeader("Accept-Ranges", "bytes");
+        if (partial)
+            Server.sendHeader("Content-Range", String("bytes ") + String(first) + "-" + String(last) + "/" + String(Image.Size));
+        Server.setContentLength(last - first + 1);
+        Server.send(partial ? 206 : 200, "application/octet-stream", "");
+        if (Server.method() == HTTP_HEAD)
+            return;
+
+        uint8_t buffer[1024];
+        for (uint32_t offset = first; offset <= last; offset += sizeof(buffer))
+        {
+            size_t length = min((uint32_t)sizeof(buffer), last + 1 - offset);
+            if (esp_partition_read(Partition, offset, buffer, length) != ESP_OK ||
+                Server.client().write(buffer, length) != length)
+                break;
+        }
+    }
+};
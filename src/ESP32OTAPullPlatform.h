@@ -0,0 +1,70 @@
+/*
+ESP32-OTA-Pull - Arduino or plain ESP-IDF
+
+MIT License
+
+Copyright (c) 2022-3 Mikal Hart
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+The one place that decides what the library is built on.  With the Arduino core
+(Arduino IDE, PlatformIO, or Arduino as an ESP-IDF component) ARDUINO is defined and
+the core's HTTPClient, Update, WiFi and ESPmDNS are used.  Built as a plain ESP-IDF
+component (see CMakeLists.txt and idf_component.yml), ESP32OTAPullIDFPlatform.h
+supplies the few Arduino names the library uses on top of ESP-IDF instead, and
+ESP32OTAPULL_ARDUINO is 0.
+
+The library is declared in namespace esp32otapull, which is where the ESP-IDF shim
+lives too; each header brings its public names into the global namespace with
+using-declarations, so the shim's String, Serial, HTTPClient etc. stay out of it.
+*/
+
+#pragma once
+
+// Peers and local mirrors are found over mDNS; define as 0 before including the library to build without it
+#ifndef ESP32OTAPULL_MDNS
+#define ESP32OTAPULL_MDNS 1
+#endif
+
+#if defined(ARDUINO)
+#define ESP32OTAPULL_ARDUINO 1
+#include <Arduino.h>
+#include <HTTPClient.h>
+#include <Update.h>
+#include <WiFi.h>    // for the examples; the library itself works over any network interface
+#include <WiFiClientSecure.h>
+#if ESP32OTAPULL_MDNS
+#include <ESPmDNS.h>
+#endif
+#else
+#define ESP32OTAPULL_ARDUINO 0
+#include "ESP32OTAPullIDFPlatform.h"
+#endif
+
+// "Board" in the JSON is matched against this; on plain ESP-IDF define ARDUINO_BOARD (e.g. in the component's
+// compile options) to the value of the equivalent Arduino build to share JSON files between the two
+#ifndef ESP32OTAPULL_BOARD
+#if defined(ARDUINO_BOARD)
+#define ESP32OTAPULL_BOARD ARDUINO_BOARD
+#else
+#define ESP32OTAPULL_BOARD CONFIG_IDF_TARGET
+#endif
+#endif
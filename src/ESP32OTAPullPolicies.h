@@ -0,0 +1,157 @@
+/*
+ESP32-OTA-Pull - compile-time feature selection for BasicOTAPull
+
+MIT License
+
+Copyright (c) 2022-3 Mikal Hart
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+/*
+BasicOTAPull<Transport, Sink, Verifier, Codec, Logger, Features> is the whole library; ESP32OTAPull
+is the instance with everything included.  Replacing a policy with one of the "No"/plain
+variants below removes that feature's code (and, for TLS, the mbedTLS client) from the
+build, because nothing references it any more:
+
+    typedef BasicOTAPull<ESP32OTAPullHTTPTransport, ESP32OTAPullDefaultSink, ESP32OTAPullNoVerify,
+                         ESP32OTAPullNoDecryption, ESP32OTAPullNoLog, ESP32OTAPullNoExtras> MyOTAPull;
+
+ESP32OTAPullMinimal, defined in ESP32OTAPull.h, is exactly that combination.  The add-ons
+(peer server, multicast, gateway, notifier) work with ESP32OTAPull only.
+
+Transport  ESP32OTAPullHTTPSTransport (http:// and https://), ESP32OTAPullHTTPTransport (http:// only),
+           or ESP32OTAPullIDFTransport (images via esp_http_client)
+Sink       where this ESP32's own firmware goes: ESP32OTAPullUpdateSink, or ESP32OTAPullIDFSink (esp_ota_*)
+Verifier   ESP32OTAPullSHA256, or ESP32OTAPullNoVerify (a "SHA256" is then ignored and HashVerified stays false)
+Codec      ESP32OTAPullDecryptor, or ESP32OTAPullNoDecryption (encrypted entries fail with DECRYPT_FAIL)
+Logger     ESP32OTAPullSerialLog (EnableSerialDebug() prints to Serial) or ESP32OTAPullNoLog
+Features   ESP32OTAPullAllFeatures, ESP32OTAPullNoExtras, or a struct of your own with the same members;
+           calling the Enable... function of a feature that is left out is a compile-time error
+
+mDNS (peers and local mirrors) also needs ESP32OTAPULL_MDNS, which is 1 unless defined as 0
+before the library is included; 0 keeps the mDNS library itself out of the build.
+
+Built without the Arduino core, the defaults are ESP32OTAPullIDFTransport and ESP32OTAPullIDFSink
+and ESP32OTAPullUpdateSink does not exist.
+*/
+
+#pragma once
+#include "ESP32OTAPullCrypto.h"
+
+namespace esp32otapull
+{
+
+struct ESP32OTAPullHTTPSTransport
+{
+    static constexpr bool Secure = true;
+    static constexpr bool Native = false;
+};
+
+// https:// URLs are requested without TLS and so fail to connect
+struct ESP32OTAPullHTTPTransport
+{
+    static constexpr bool Secure = false;
+    static constexpr bool Native = false;
+};
+
+// Images (over a single connection) are fetched with ESP-IDF's esp_http_client, which hands each block
+// of the body straight from its receive buffer to the sink.  The JSON still uses HTTPClient.
+struct ESP32OTAPullIDFTransport
+{
+    static constexpr bool Secure = true;
+    static constexpr bool Native = true;
+};
+
+#if ESP32OTAPULL_ARDUINO
+typedef ESP32OTAPullHTTPSTransport ESP32OTAPullDefaultTransport;
+#else
+typedef ESP32OTAPullIDFTransport ESP32OTAPullDefaultTransport;
+#endif
+
+struct ESP32OTAPullSerialLog
+{
+    static constexpr bool Enabled = true;
+};
+
+struct ESP32OTAPullNoLog
+{
+    static constexpr bool Enabled = false;
+};
+
+// The optional features, each tied to its Enable.../Set... call
+struct ESP32OTAPullAllFeatures
+{
+    static constexpr bool Statistics = true;        // EnableStatistics, EnableOutcomeReports (NVS)
+    static constexpr bool Rollback = true;          // EnableRollback
+    static constexpr bool RebootPolicies = true;    // SetRebootPolicy (esp_timer, reboot task)
+    static constexpr bool ParallelDownload = true;  // SetParallelDownload (Range requests)
+    static constexpr bool LocalNetwork = true;      // EnablePeerDownload, EnableLocalMirror (mDNS)
+    static constexpr bool DNSCache = true;          // EnableDNSCache, PreResolve
+};
+
+struct ESP32OTAPullNoExtras
+{
+    static constexpr bool Statistics = false;
+    static constexpr bool Rollback = false;
+    static constexpr bool RebootPolicies = false;
+    static constexpr bool ParallelDownload = false;
+    static constexpr bool LocalNetwork = false;
+    static constexpr bool DNSCache = false;
+};
+
+// Accepts every image, so that entries with a "SHA256" (as the gateway always writes) still install
+class ESP32OTAPullNoVerify
+{
+public:
+    static constexpr bool Checks = false;
+
+    void Begin() {}
+    void Add(const uint8_t *, size_t) {}
+    bool Matches(const char *) { return true; }
+};
+
+class ESP32OTAPullNoDecryption
+{
+public:
+    bool Begin(ESP32OTAPullDecryptor::Mode mode, const uint8_t *, const uint8_t *, size_t)
+    {
+        return mode == ESP32OTAPullDecryptor::NONE;
+    }
+    bool Process(uint8_t *, size_t &) { return true; }
+    bool Finish(const uint8_t *, uint8_t *, size_t &outLength)
+    {
+        outLength = 0;
+        return true;
+    }
+};
+
+} // namespace esp32otapull
+
+using esp32otapull::ESP32OTAPullHTTPSTransport;
+using esp32otapull::ESP32OTAPullHTTPTransport;
+using esp32otapull::ESP32OTAPullIDFTransport;
+using esp32otapull::ESP32OTAPullDefaultTransport;
+using esp32otapull::ESP32OTAPullSerialLog;
+using esp32otapull::ESP32OTAPullNoLog;
+using esp32otapull::ESP32OTAPullAllFeatures;
+using esp32otapull::ESP32OTAPullNoExtras;
+using esp32otapull::ESP32OTAPullNoVerify;
+using esp32otapull::ESP32OTAPullNoDecryption;
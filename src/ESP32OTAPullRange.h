@@ -0,0 +1,90 @@
+/*
+ESP32-OTA-Pull - the Range header, as served by the peer server and the gateway
+
+MIT License
+
+Copyright (c) 2022-3 Mikal Hart
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#pragma once
+#include <ctype.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace esp32otapull
+{
+
+/// @brief Work out which bytes of a resource a request's Range header asks for.  A single
+///        "bytes=first-[last]" or "bytes=-suffix" range is supported; a last byte at or past the
+///        end is clamped to the end (RFC 7233 2.1).  A header in another unit, with several ranges
+///        or that doesn't parse is ignored, as RFC 7233 allows.
+/// @param header The Range header, or NULL or empty if there is none
+/// @param size Size of the resource in bytes
+/// @param first Receives the first byte to send
+/// @param last Receives the last byte to send (meaningless if size is 0)
+/// @return 200 to send the whole resource, 206 to send first..last, 416 if the range lies past the end
+inline int ESP32OTAPullParseRange(const char *header, uint32_t size, uint32_t &first, uint32_t &last)
+{
+    first = 0;
+    last = size == 0 ? 0 : size - 1;
+    if (header == NULL || strncmp(header, "bytes=", 6) != 0 || strchr(header, ',') != NULL || size == 0)
+        return 200;
+
+    const char *p = header + 6;
+    char *end;
+    if (*p == '-')
+    {
+        if (!isdigit((unsigned char)p[1]))
+            return 200;
+        unsigned long suffix = strtoul(p + 1, &end, 10);
+        if (*end != '\0')
+            return 200;
+        if (suffix == 0)
+            return 416;
+        first = suffix >= size ? 0 : size - (uint32_t)suffix;
+        return 206;
+    }
+
+    if (!isdigit((unsigned char)*p))
+        return 200;
+    unsigned long from = strtoul(p, &end, 10), to = last;
+    if (*end != '-')
+        return 200;
+    p = end + 1;
+    if (*p != '\0')
+    {
+        if (!isdigit((unsigned char)*p))
+            return 200;
+        to = strtoul(p, &end, 10);
+        if (*end != '\0' || to < from)
+            return 200;
+    }
+    if (from >= size)
+        return 416;
+    first = (uint32_t)from;
+    last = to < last ? (uint32_t)to : last;
+    return 206;
+}
+
+} // namespace esp32otapull
+
+using esp32otapull::ESP32OTAPullParseRange;
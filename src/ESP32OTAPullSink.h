@@ -0,0 +1,140 @@
+/*
+ESP32-OTA-Pull - destinations for downloaded images
+
+MIT License
+
+Copyright (c) 2022-3 Mikal Hart
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+/*
+A sink receives a downloaded (and, if need be, decrypted) image.  By default images go
+to the ESP32's own OTA partition through Update, but an entry in the JSON with a
+"Target" field is written to the sink registered under that name with AddSink(), e.g.
+to reflash a companion microcontroller.
+
+Begin() is called once the download is known to be good, Write() for every chunk in
+order, and then either End() once the image has been verified, or Abort().
+*/
+
+#pragma once
+#include "ESP32OTAPullPlatform.h"
+#include <esp_ota_ops.h>
+
+namespace esp32otapull
+{
+
+class ESP32OTAPullSink
+{
+public:
+    virtual ~ESP32OTAPullSink() {}
+
+    /// @brief Prepare to receive an image
+    /// @param size The image size from the JSON's "Size", or 0 if not known
+    virtual bool Begin(size_t size) = 0;
+
+    /// @brief Accept the next part of the image
+    virtual bool Write(const uint8_t *data, size_t length) = 0;
+
+    /// @brief The whole image has been written and verified: make it live
+    virtual bool End() = 0;
+
+    /// @brief Discard whatever has been written
+    virtual void Abort() = 0;
+};
+
+#if ESP32OTAPULL_ARDUINO
+// The ESP32's own next OTA partition
+class ESP32OTAPullUpdateSink : public ESP32OTAPullSink
+{
+public:
+    bool Begin(size_t size) override
+    {
+        return Update.begin(size == 0 ? UPDATE_SIZE_UNKNOWN : size);
+    }
+
+    bool Write(const uint8_t *data, size_t length) override
+    {
+        return Update.write(const_cast<uint8_t *>(data), length) == length;
+    }
+
+    bool End() override
+    {
+        return Update.end(true);
+    }
+
+    void Abort() override
+    {
+        Update.abort();
+    }
+};
+#endif
+
+// The ESP32's own next OTA partition, written with the ESP-IDF esp_ota_* calls directly
+class ESP32OTAPullIDFSink : public ESP32OTAPullSink
+{
+public:
+    bool Begin(size_t size) override
+    {
+        Partition = esp_ota_get_next_update_partition(NULL);
+        // Sequential writes erase each sector just before it is written, rather than the whole partition up front
+        return Partition != NULL && esp_ota_begin(Partition, size == 0 ? OTA_WITH_SEQUENTIAL_WRITES : size, &Handle) == ESP_OK;
+    }
+
+    bool Write(const uint8_t *data, size_t length) override
+    {
+        return esp_ota_write(Handle, data, length) == ESP_OK;
+    }
+
+    bool End() override
+    {
+        esp_ota_handle_t handle = Handle;
+        Handle = 0;
+        return esp_ota_end(handle) == ESP_OK && esp_ota_set_boot_partition(Partition) == ESP_OK;
+    }
+
+    void Abort() override
+    {
+        if (Handle != 0)
+            esp_ota_abort(Handle);
+        Handle = 0;
+    }
+
+private:
+    const esp_partition_t *Partition = NULL;
+    esp_ota_handle_t Handle = 0;
+};
+
+// Where this ESP32's firmware goes unless told otherwise: Update with the Arduino core, esp_ota_* without it
+#if ESP32OTAPULL_ARDUINO
+typedef ESP32OTAPullUpdateSink ESP32OTAPullDefaultSink;
+#else
+typedef ESP32OTAPullIDFSink ESP32OTAPullDefaultSink;
+#endif
+
+} // namespace esp32otapull
+
+using esp32otapull::ESP32OTAPullSink;
+#if ESP32OTAPULL_ARDUINO
+using esp32otapull::ESP32OTAPullUpdateSink;
+#endif
+using esp32otapull::ESP32OTAPullIDFSink;
+using esp32otapull::ESP32OTAPullDefaultSink;
@@ -0,0 +1,302 @@
+/*
+ESP32-OTA-Pull - sinks that store images as files or in a data partition
+
+MIT License
+
+Copyright (c) 2022-3 Mikal Hart
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+/*
+For images that are not firmware, such as ML models or audio packs, that may be larger
+than the OTA partitions.  Give the entry a "Target" and register one of these sinks
+under that name; matching, decryption and SHA256 verification work as for firmware.
+Data is written in whole 4 KB sectors from a single sector buffer, so nothing larger
+than that is held in RAM.
+
+    // A file on an SD card: written to "<path>.tmp" and renamed over <path> only once verified.
+    // Where the filesystem can't rename over a file, the old one is moved to "<path>.old" first
+    // and removed last, so a power loss in between leaves it there (the next update restores it)
+    ESP32OTAPullFileSink model(SD, "/models/kws.tflite");
+
+    // A data partition, e.g. on external SPI-NOR registered with esp_partition_register_external().
+    // Its first 32 bytes are only written once the image has been verified, so after a failed or
+    // interrupted update they read as erased (0xFF) and the asset's own header shows it is incomplete
+    ESP32OTAPullPartitionSink audio(esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, "audio"));
+
+    ota.AddSink("model", model).AddSink("audio", audio);
+    ota.SetTarget("model").CheckForOTAUpdate(JSON_URL, modelVersion);
+*/
+
+#pragma once
+#include <memory>
+#include <esp_partition.h>
+#include "ESP32OTAPullSink.h"
+#if ESP32OTAPULL_ARDUINO
+#include <FS.h>
+#endif
+
+namespace esp32otapull
+{
+
+#if ESP32OTAPULL_ARDUINO
+/// @brief Rename from over to.  Where the filesystem can't rename over a file, the old one is moved to
+///        "<to>.old" first and removed last, so a power loss leaves either file in place or the old one
+///        at "<to>.old", from where ESP32OTAPullRestoreFile() puts it back.
+inline bool ESP32OTAPullReplaceFile(fs::FS &files, const String &from, const String &to)
+{
+    // LittleFS renames over an existing file in one step; FAT refuses to
+    if (files.rename(from, to))
+        return true;
+    String old = to + ".old";
+    files.remove(old);
+    if (!files.rename(to, old) || !files.rename(from, to))
+    {
+        if (!files.exists(to))
+            files.rename(old, to);
+        return false;
+    }
+    files.remove(old);
+    return true;
+}
+
+/// @brief Put back a file that a power loss in ESP32OTAPullReplaceFile() left at "<path>.old"
+inline void ESP32OTAPullRestoreFile(fs::FS &files, const String &path)
+{
+    String old = path + ".old";
+    if (!files.exists(path) && files.exists(old))
+        files.rename(old, path);
+}
+
+// Needs the Arduino core's fs::FS
+class ESP32OTAPullFileSink : public ESP32OTAPullSink
+{
+public:
+    /// @param fs The filesystem, e.g. SD, SD_MMC or LittleFS
+    /// @param path Where the verified image ends up; it is replaced only after a successful update
+    ESP32OTAPullFileSink(fs::FS &fs, const char *path) : Files(fs), Path(path), TempPath(String(path) + ".tmp")
+    {
+    }
+
+    bool Begin(size_t) override
+    {
+        ESP32OTAPullRestoreFile(Files, Path);
+        Buffer.reset(new (std::nothrow) uint8_t[SectorSize]);
+        Fill = 0;
+        File = Files.open(TempPath, FILE_WRITE);
+        return Buffer && File;
+    }
+
+    bool Write(const uint8_t *data, size_t length) override
+    {
+        while (length > 0)
+        {
+            // Whole sectors go straight through; the rest is gathered until a sector is full
+            if (Fill == 0 && length >= SectorSize)
+            {
+                size_t whole = length - length % SectorSize;
+                if (File.write(data, whole) != whole)
+                    return false;
+                data += whole;
+                length -= whole;
+                continue;
+            }
+            size_t n = min(length, SectorSize - Fill);
+            memcpy(Buffer.get() + Fill, data, n);
+            Fill += n;
+            data += n;
+            length -= n;
+            if (Fill == SectorSize && !Flush())
+                return false;
+        }
+        return true;
+    }
+
+    bool End() override
+    {
+        bool ok = Flush();
+        File.close();
+        Buffer.reset();
+        if (!ok)
+        {
+            Files.remove(TempPath);
+            return false;
+        }
+        if (ESP32OTAPullReplaceFile(Files, TempPath, Path))
+            return true;
+        Files.remove(TempPath);
+        return false;
+    }
+
+    void Abort() override
+    {
+        File.close();
+        Buffer.reset();
+        Files.remove(TempPath);
+    }
+
+private:
+    static constexpr size_t SectorSize = 4096;
+    fs::FS &Files;
+    String Path, TempPath;
+    fs::File File;
+    std::unique_ptr<uint8_t[]> Buffer;
+    size_t Fill = 0;
+
+    bool Flush()
+    {
+        bool ok = Fill == 0 || File.write(Buffer.get(), Fill) == Fill;
+        Fill = 0;
+        return ok;
+    }
+};
+#endif
+
+class ESP32OTAPullPartitionSink : public ESP32OTAPullSink
+{
+public:
+    /// @param partition The partition to overwrite from offset 0
+    /// @param eraseAhead Erase this many bytes at a time ahead of the writes (a multiple of 64 KB lets the
+    ///        flash use its faster block erase); 0 erases the whole image up front when "Size" is known
+    ESP32OTAPullPartitionSink(const esp_partition_t *partition, uint32_t eraseAhead = 65536)
+        : Partition(partition), EraseAhead(eraseAhead)
+    {
+    }
+
+    bool Begin(size_t size) override
+    {
+        if (Partition == NULL || size > Partition->size)
+            return false;
+        Buffer.reset(new (std::nothrow) uint8_t[SectorSize]);
+        Fill = 0;
+        Offset = 0;
+        Erased = 0;
+        HeadLength = 0;
+        Length = 0;
+        if (!Buffer)
+            return false;
+        if (EraseAhead == 0 && size > 0)
+            return EraseTo(size);
+        return true;
+    }
+
+    bool Write(const uint8_t *data, size_t length) override
+    {
+        while (length > 0)
+        {
+            size_t n = min(length, SectorSize - Fill);
+            memcpy(Buffer.get() + Fill, data, n);
+            Fill += n;
+            data += n;
+            length -= n;
+            if (Fill == SectorSize && !Flush())
+                return false;
+        }
+        return true;
+    }
+
+    bool End() override
+    {
+        bool ok = Flush() && (HeadLength == 0 || esp_partition_write(Partition, 0, Head, HeadLength) == ESP_OK);
+        Buffer.reset();
+        if (ok)
+            Length = Offset;
+        return ok;
+    }
+
+    // The head was never written, so the region stays marked as incomplete
+    void Abort() override
+    {
+        Buffer.reset();
+    }
+
+    /// @brief Has the last update completed?  A region whose first bytes are still erased has not.
+    bool IsComplete()
+    {
+        uint8_t head[HeadSize];
+        if (Partition == NULL || esp_partition_read(Partition, 0, head, sizeof(head)) != ESP_OK)
+            return false;
+        for (size_t i = 0; i < sizeof(head); ++i)
+            if (head[i] != 0xFF)
+                return true;
+        return false;
+    }
+
+    /// @brief The number of bytes written by the last successful update through this object,
+    ///        or 0 if none has completed since (a failed update overwrites part of the old one)
+    uint32_t Size()
+    {
+        return Length;
+    }
+
+private:
+    static constexpr size_t SectorSize = 4096;
+    static constexpr size_t HeadSize = 32;  // written by End(), as the validity marker
+    const esp_partition_t *Partition;
+    uint32_t EraseAhead;
+    std::unique_ptr<uint8_t[]> Buffer;
+    size_t Fill = 0;
+    uint32_t Offset = 0;                // partition offset of the sector in Buffer
+    uint32_t Erased = 0;                // everything below this offset has been erased
+    uint32_t Length = 0;                // size of the image End() completed, 0 once another Begin()s
+    uint8_t Head[HeadSize];
+    size_t HeadLength = 0;
+
+    bool EraseTo(uint32_t end)
+    {
+        if (end <= Erased)
+            return true;
+        uint32_t step = EraseAhead < SectorSize ? SectorSize : EraseAhead / SectorSize * SectorSize;
+        uint32_t limit = min((end + step - 1) / step * step, (uint32_t)Partition->size);
+        if (limit < end || esp_partition_erase_range(Partition, Erased, limit - Erased) != ESP_OK)
+            return false;
+        Erased = limit;
+        return true;
+    }
+
+    bool Flush()
+    {
+        if (Fill == 0)
+            return true;
+        if (Offset + Fill > Partition->size || !EraseTo(Offset + Fill))
+            return false;
+        size_t skip = 0;
+        if (Offset == 0)
+        {
+            HeadLength = skip = min(Fill, HeadSize);
+            memcpy(Head, Buffer.get(), HeadLength);
+        }
+        if (Fill > skip && esp_partition_write(Partition, Offset + skip, Buffer.get() + skip, Fill - skip) != ESP_OK)
+            return false;
+        Offset += Fill;
+        Fill = 0;
+        return true;
+    }
+};
+
+} // namespace esp32otapull
+
+#if ESP32OTAPULL_ARDUINO
+using esp32otapull::ESP32OTAPullReplaceFile;
+using esp32otapull::ESP32OTAPullRestoreFile;
+using esp32otapull::ESP32OTAPullFileSink;
+#endif
+using esp32otapull::ESP32OTAPullPartitionSink;
@@ -0,0 +1,169 @@
+/*
+ESP32-OTA-Pull - tracing hooks for the phases of an OTA check/update
+
+MIT License
+
+Copyright (c) 2022-3 Mikal Hart
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+Every phase of CheckForOTAUpdate/DoOTAUpdate is bracketed by
+ESP32OTAPULL_TRACE_BEGIN(phase) / ESP32OTAPULL_TRACE_END(phase).  By default
+these expand to nothing.  To route them somewhere, either
+
+  - define both macros yourself *before* including ESP32OTAPull.h, e.g. for
+    SEGGER SystemView:
+        #define ESP32OTAPULL_TRACE_BEGIN(phase) SEGGER_SYSVIEW_OnUserStart(phase)
+        #define ESP32OTAPULL_TRACE_END(phase)   SEGGER_SYSVIEW_OnUserStop(phase)
+
+  - or define ESP32OTAPULL_TRACE_RTC to record the events into a small ring
+    buffer in RTC memory (survives soft resets, including the one at the end
+    of an update) and dump it later with ESP32OTAPullTraceDump(Serial).  The
+    output is Chrome trace JSON: save it to a file and open it in
+    chrome://tracing or https://ui.perfetto.dev.
+*/
+
+#pragma once
+#include "ESP32OTAPullPlatform.h"
+
+namespace esp32otapull
+{
+
+enum OTATracePhase : uint8_t
+{
+    OTA_TRACE_DNS, OTA_TRACE_CONNECT, OTA_TRACE_TLS, OTA_TRACE_HEADERS, OTA_TRACE_PARSE,
+    OTA_TRACE_MATCH, OTA_TRACE_ERASE, OTA_TRACE_WRITE, OTA_TRACE_VERIFY, OTA_TRACE_REBOOT,
+    OTA_TRACE_PHASE_COUNT
+};
+
+inline const char *OTATracePhaseName(uint8_t phase)
+{
+    static const char *const names[OTA_TRACE_PHASE_COUNT] =
+        { "DNS", "Connect", "TLS", "Headers", "Parse", "Match", "Erase", "Write", "Verify", "Reboot" };
+    return phase < OTA_TRACE_PHASE_COUNT ? names[phase] : "?";
+}
+
+#if defined(ESP32OTAPULL_TRACE_RTC)
+
+#ifndef ESP32OTAPULL_TRACE_RTC_DEPTH
+#define ESP32OTAPULL_TRACE_RTC_DEPTH 64
+#endif
+
+struct OTATraceEvent
+{
+    uint32_t Micros;
+    uint8_t Boot;
+    uint8_t Phase;
+    uint8_t Begin;
+};
+
+struct OTATraceRing
+{
+    uint32_t Magic;
+    uint16_t Head;
+    uint16_t Count;
+    uint8_t Boot;
+    OTATraceEvent Events[ESP32OTAPULL_TRACE_RTC_DEPTH];
+};
+
+inline OTATraceRing &ESP32OTAPullTraceRing()
+{
+    static RTC_NOINIT_ATTR OTATraceRing ring;
+    static bool thisBoot = false;
+    if (ring.Magic != 0x4f544154 || ring.Head >= ESP32OTAPULL_TRACE_RTC_DEPTH || ring.Count > ESP32OTAPULL_TRACE_RTC_DEPTH)
+    {
+        memset(&ring, 0, sizeof(ring));
+        ring.Magic = 0x4f544154;
+    }
+    if (!thisBoot)
+    {
+        ++ring.Boot;
+        thisBoot = true;
+    }
+    return ring;
+}
+
+inline void ESP32OTAPullTraceRecord(uint8_t phase, bool begin)
+{
+    OTATraceRing &ring = ESP32OTAPullTraceRing();
+    OTATraceEvent &e = ring.Events[ring.Head];
+    e.Micros = micros();
+    e.Boot = ring.Boot;
+    e.Phase = phase;
+    e.Begin = begin;
+    ring.Head = (ring.Head + 1) % ESP32OTAPULL_TRACE_RTC_DEPTH;
+    if (ring.Count < ESP32OTAPULL_TRACE_RTC_DEPTH)
+        ++ring.Count;
+}
+
+/// @brief Write the recorded events as Chrome trace JSON (one "pid" per boot)
+/// @param out Where to print the JSON, typically Serial
+/// @param clear true to empty the ring buffer afterwards
+inline void ESP32OTAPullTraceDump(Print &out, bool clear = true)
+{
+    OTATraceRing &ring = ESP32OTAPullTraceRing();
+    uint16_t start = (ring.Head + ESP32OTAPULL_TRACE_RTC_DEPTH - ring.Count) % ESP32OTAPULL_TRACE_RTC_DEPTH;
+    out.print("{\"traceEvents\":[");
+    for (uint16_t i = 0; i < ring.Count; ++i)
+    {
+        const OTATraceEvent &e = ring.Events[(start + i) % ESP32OTAPULL_TRACE_RTC_DEPTH];
+        out.printf("%s{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%lu,\"pid\":%u,\"tid\":1}",
+            i == 0 ? "" : ",", OTATracePhaseName(e.Phase), e.Begin ? 'B' : 'E', (unsigned long)e.Micros, e.Boot);
+    }
+    out.println("]}");
+    if (clear)
+        ring.Head = ring.Count = 0;
+}
+
+#endif // ESP32OTAPULL_TRACE_RTC
+
+} // namespace esp32otapull
+
+using esp32otapull::OTATracePhase;
+using esp32otapull::OTA_TRACE_DNS;
+using esp32otapull::OTA_TRACE_CONNECT;
+using esp32otapull::OTA_TRACE_TLS;
+using esp32otapull::OTA_TRACE_HEADERS;
+using esp32otapull::OTA_TRACE_PARSE;
+using esp32otapull::OTA_TRACE_MATCH;
+using esp32otapull::OTA_TRACE_ERASE;
+using esp32otapull::OTA_TRACE_WRITE;
+using esp32otapull::OTA_TRACE_VERIFY;
+using esp32otapull::OTA_TRACE_REBOOT;
+using esp32otapull::OTA_TRACE_PHASE_COUNT;
+using esp32otapull::OTATracePhaseName;
+#if defined(ESP32OTAPULL_TRACE_RTC)
+using esp32otapull::OTATraceEvent;
+using esp32otapull::OTATraceRing;
+using esp32otapull::ESP32OTAPullTraceRing;
+using esp32otapull::ESP32OTAPullTraceRecord;
+using esp32otapull::ESP32OTAPullTraceDump;
+#endif
+
+#ifndef ESP32OTAPULL_TRACE_BEGIN
+#if defined(ESP32OTAPULL_TRACE_RTC)
+#define ESP32OTAPULL_TRACE_BEGIN(phase) ESP32OTAPullTraceRecord((phase), true)
+#define ESP32OTAPULL_TRACE_END(phase)   ESP32OTAPullTraceRecord((phase), false)
+#else
+#define ESP32OTAPULL_TRACE_BEGIN(phase) do { } while (0)
+#define ESP32OTAPULL_TRACE_END(phase)   do { } while (0)
+#endif
+#endif
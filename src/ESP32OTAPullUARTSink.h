@@ -0,0 +1,339 @@
+/*
+ESP32-OTA-Pull - a sink that streams images to a companion MCU's UART bootloader
+
+MIT License
+
+Copyright (c) 2022-3 Mikal Hart
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+
+/*
+ESP32OTAPullUARTSink sends an image to a bootloader on another microcontroller (an STM32,
+say) over a serial link, using a small sliding-window protocol so that the link stays
+busy while the other side writes to its flash.
+
+Every frame is
+
+    0x01  type  seq  length(2, LE)  payload(length)  crc(2, LE)
+
+with the CRC-16/CCITT-FALSE (poly 0x1021, init 0xFFFF) of type..payload.  The types are
+
+    'B'  begin    payload: image size (4, LE; 0 if unknown)
+    'D'  data     payload: offset (4, LE) followed by up to frameSize bytes of image
+    'E'  end      no payload; the bootloader checks and activates the image
+    'A'  abort    no payload, no answer expected
+
+The bootloader answers each frame it has accepted, in order, with 0x06 seq (ACK, which
+also acknowledges every earlier frame), or asks for everything from a frame onwards to
+be sent again with 0x15 seq (NAK), e.g. after a CRC error.  Up to "window" data frames
+may be unacknowledged at once; that window is also the flow control, since the sender
+stops until the bootloader catches up.  Hardware RTS/CTS can be added on the
+HardwareSerial if the bootloader's receive buffer is smaller than a window.
+
+    ESP32OTAPullUARTSink stm32(Serial2);
+
+    void enterBootloader() { digitalWrite(BOOT0, HIGH); ... reset the STM32 ... }
+
+    Serial2.begin(921600, SERIAL_8N1, RX2, TX2);
+    stm32.SetBootloaderCallback(enterBootloader);
+    ota.AddSink("stm32", stm32).SetTarget("stm32").CheckForOTAUpdate(JSON_URL, stm32Version);
+
+with an entry such as { "Target": "stm32", "Version": "2.1.0", "URL": "...", "SHA256": "..." }.
+*/
+
+#pragma once
+#include <memory>
+#include "ESP32OTAPullSink.h"
+
+namespace esp32otapull
+{
+
+#if ESP32OTAPULL_ARDUINO
+// Needs the Arduino core's Stream
+class ESP32OTAPullUARTSink : public ESP32OTAPullSink
+{
+public:
+    /// @param port The serial link to the bootloader, already begun
+    /// @param window How many data frames may await acknowledgement (1-16)
+    /// @param frameSize Image bytes per data frame
+    ESP32OTAPullUARTSink(Stream &port, uint8_t window = 4, uint16_t frameSize = 256)
+        : Port(port), Window(window < 1 ? 1 : window > 16 ? 16 : window), FrameSize(frameSize < 16 ? 16 : frameSize)
+    {
+    }
+
+    /// @brief Called at the start of every transfer to put the other MCU into its bootloader
+    ESP32OTAPullUARTSink &SetBootloaderCallback(void (*enterBootloader)())
+    {
+        EnterBootloader = enterBootloader;
+        return *this;
+    }
+
+    /// @brief How long to wait for an acknowledgement before resending (default 500 ms),
+    ///        and for the answer to 'E' while the bootloader checks the image (default 10 s)
+    ESP32OTAPullUARTSink &SetTimeouts(uint32_t ackMs, uint32_t endMs)
+    {
+        AckTimeout = ackMs;
+        EndTimeout = endMs;
+        return *this;
+    }
+
+    bool Begin(size_t size) override
+    {
+        Buffer.reset(new (std::nothrow) uint8_t[(size_t)Window * FrameSize]);
+        if (!Buffer)
+            return false;
+        if (EnterBootloader != NULL)
+            EnterBootloader();
+        while (Port.available() > 0)
+            Port.read();
+
+        Base = NextSeq = BaseSlot = Fill = 0;
+        Offset = 0;
+        Reply = -1;
+        uint8_t payload[4];
+        PutLE32(payload, size);
+        return Control('B', payload, sizeof(payload), AckTimeout);
+    }
+
+    bool Write(const uint8_t *data, size_t length) override
+    {
+        while (length > 0)
+        {
+            // A new frame needs a free slot in the window
+            if (Fill == 0 && !WaitForRoom(Window - 1))
+                return false;
+            size_t n = min(length, (size_t)(FrameSize - Fill));
+            memcpy(Slot(NextSeq) + Fill, data, n);
+            Fill += n;
+            data += n;
+            length -= n;
+            if (Fill == FrameSize && !Flush())
+                return false;
+        }
+        return true;
+    }
+
+    bool End() override
+    {
+        bool ok = (Fill == 0 || Flush()) && WaitForRoom(0) && Control('E', NULL, 0, EndTimeout);
+        Buffer.reset();
+        return ok;
+    }
+
+    void Abort() override
+    {
+        SendFrame('A', NextSeq, NULL, 0, NULL, 0);
+        Buffer.reset();
+    }
+
+private:
+    Stream &Port;
+    uint8_t Window;
+    uint16_t FrameSize;
+    void (*EnterBootloader)() = NULL;
+    uint32_t AckTimeout = 500, EndTimeout = 10000;
+    static constexpr int MaxRetries = 8;
+
+    std::unique_ptr<uint8_t[]> Buffer;  // Window slots of FrameSize bytes, used as a ring from BaseSlot
+    uint32_t SlotOffset[16];
+    uint16_t SlotLength[16];
+    uint8_t Base = 0;                   // oldest unacknowledged sequence number
+    uint8_t BaseSlot = 0;               // its slot
+    uint8_t NextSeq = 0;                // sequence number of the frame being filled
+    uint16_t Fill = 0;                  // bytes in that frame so far
+    uint32_t Offset = 0;                // image offset of that frame
+    int Reply = -1;                     // ACK/NAK byte awaiting its sequence number
+
+    // Sequence numbers wrap at 256, which need not be a multiple of Window, so slots
+    // follow the frame's position in the window rather than seq % Window
+    uint8_t SlotIndex(uint8_t seq)
+    {
+        return (uint8_t)((BaseSlot + (uint8_t)(seq - Base)) % Window);
+    }
+
+    uint8_t *Slot(uint8_t seq)
+    {
+        return Buffer.get() + (size_t)SlotIndex(seq) * FrameSize;
+    }
+
+    void Acknowledge(uint8_t base)
+    {
+        BaseSlot = (uint8_t)((BaseSlot + (uint8_t)(base - Base)) % Window);
+        Base = base;
+    }
+
+    uint8_t Outstanding()
+    {
+        return (uint8_t)(NextSeq - Base);
+    }
+
+    static void PutLE32(uint8_t *out, uint32_t value)
+    {
+        for (int i = 0; i < 4; ++i)
+            out[i] = (uint8_t)(value >> (8 * i));
+    }
+
+    static uint16_t CRC16(uint16_t crc, const uint8_t *data, size_t length)
+    {
+        while (length--)
+        {
+            crc ^= (uint16_t)*data++ << 8;
+            for (int i = 0; i < 8; ++i)
+                crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+        }
+        return crc;
+    }
+
+    void SendFrame(uint8_t type, uint8_t seq, const uint8_t *head, uint16_t headLength, const uint8_t *data, uint16_t dataLength)
+    {
+        uint16_t length = headLength + dataLength;
+        uint8_t header[5] = { 0x01, type, seq, (uint8_t)length, (uint8_t)(length >> 8) };
+        uint16_t crc = CRC16(0xFFFF, header + 1, 4);
+        crc = CRC16(crc, head, headLength);
+        crc = CRC16(crc, data, dataLength);
+        uint8_t trailer[2] = { (uint8_t)crc, (uint8_t)(crc >> 8) };
+        Port.write(header, sizeof(header));
+        if (headLength > 0)
+            Port.write(head, headLength);
+        if (dataLength > 0)
+            Port.write(data, dataLength);
+        Port.write(trailer, sizeof(trailer));
+    }
+
+    void SendData(uint8_t seq)
+    {
+        uint8_t offset[4];
+        PutLE32(offset, SlotOffset[SlotIndex(seq)]);
+        SendFrame('D', seq, offset, sizeof(offset), Slot(seq), SlotLength[SlotIndex(seq)]);
+    }
+
+    // Send the frame being filled and open the next one
+    bool Flush()
+    {
+        SlotOffset[SlotIndex(NextSeq)] = Offset;
+        SlotLength[SlotIndex(NextSeq)] = Fill;
+        SendData(NextSeq);
+        Offset += Fill;
+        Fill = 0;
+        ++NextSeq;
+        return true;
+    }
+
+    // Read the bootloader's answers; true once a complete ACK or NAK has arrived
+    bool Poll(uint8_t &seq, bool &nak)
+    {
+        while (Port.available() > 0)
+        {
+            int c = Port.read();
+            if (Reply < 0)
+            {
+                if (c == 0x06 || c == 0x15)
+                    Reply = c;
+                continue;
+            }
+            nak = Reply == 0x15;
+            Reply = -1;
+            seq = (uint8_t)c;
+            return true;
+        }
+        return false;
+    }
+
+    // Wait until no more than limit data frames are unacknowledged, resending on NAK or timeout
+    bool WaitForRoom(uint8_t limit)
+    {
+        uint32_t started = millis();
+        int retries = 0;
+        int resentFrom = -1; // a NAK for this frame is already being dealt with
+        while (Outstanding() > limit)
+        {
+            uint8_t seq;
+            bool nak;
+            if (Poll(seq, nak))
+            {
+                uint8_t position = (uint8_t)(seq - Base);
+                if (position >= Outstanding())
+                    continue; // stale or unknown
+                Acknowledge(nak ? seq : seq + 1); // everything before it is implicitly acknowledged
+                if (!nak || position > 0)
+                {
+                    retries = 0;
+                    resentFrom = -1;
+                }
+                if (nak && resentFrom != seq)
+                {
+                    if (++retries > MaxRetries)
+                        return false;
+                    for (uint8_t s = Base; s != NextSeq; ++s)
+                        SendData(s);
+                    resentFrom = seq;
+                }
+                started = millis();
+            }
+            else if (millis() - started > AckTimeout)
+            {
+                if (++retries > MaxRetries)
+                    return false;
+                for (uint8_t s = Base; s != NextSeq; ++s)
+                    SendData(s);
+                resentFrom = Base;
+                started = millis();
+            }
+            else
+                delay(1);
+        }
+        return true;
+    }
+
+    // Send a control frame with the next sequence number and wait for its ACK
+    bool Control(uint8_t type, const uint8_t *payload, uint16_t length, uint32_t timeoutMs)
+    {
+        for (int attempt = 0; attempt <= MaxRetries; ++attempt)
+        {
+            SendFrame(type, NextSeq, payload, length, NULL, 0);
+            uint32_t started = millis();
+            while (millis() - started < timeoutMs)
+            {
+                uint8_t seq;
+                bool nak;
+                if (!Poll(seq, nak))
+                {
+                    delay(1);
+                    continue;
+                }
+                if (seq != NextSeq)
+                    continue;
+                if (nak)
+                    break;
+                Acknowledge(++NextSeq);
+                return true;
+            }
+        }
+        return false;
+    }
+};
+#endif
+
+} // namespace esp32otapull
+
+#if ESP32OTAPULL_ARDUINO
+using esp32otapull::ESP32OTAPullUARTSink;
+#endif
@@ -0,0 +1,26 @@
+// A minimal test harness: CHECK() reports a failed condition and carries on; main() returns TestResult()
+#pragma once
+#include <stdio.h>
+
+inline int &TestFailures()
+{
+    static int failures = 0;
+    return failures;
+}
+
+#define CHECK(condition)                                                                   \
+    do                                                                                     \
+    {                                                                                      \
+        if (!(condition))                                                                  \
+        {                                                                                  \
+            printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition);           \
+            ++TestFailures();                                                              \
+        }                                                                                  \
+    } while (0)
+
+inline int TestResult()
+{
+    if (TestFailures() == 0)
+        printf("passed\n");
+    return TestFailures() == 0 ? 0 : 1;
+}
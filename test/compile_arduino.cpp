@@ -0,0 +1,31 @@
+// The library as built with the Arduino core, against the stubs in stubs/: the full-featured instance
+// with every add-on and sink, so that all of them have to compile without warnings.
+#include "ESP32OTAPull.h"
+#include "ESP32OTAPullPeer.h"
+#include "ESP32OTAPullMulticast.h"
+#include "ESP32OTAPullGateway.h"
+#include "ESP32OTAPullNotifier.h"
+#include "ESP32OTAPullUARTSink.h"
+#include "ESP32OTAPullStorageSink.h"
+
+template class esp32otapull::BasicOTAPull<>;
+template class esp32otapull::BasicOTAPull<esp32otapull::ESP32OTAPullIDFTransport, esp32otapull::ESP32OTAPullIDFSink>;
+template class esp32otapull::BasicOTAPull<esp32otapull::ESP32OTAPullHTTPTransport>;
+
+void CompileAddOns()
+{
+    ESP32OTAPull ota;
+    fs::FS files;
+    ESP32OTAPullPeerServer peer;
+    ESP32OTAPullMulticastSender sender;
+    ESP32OTAPullMulticastReceiver receiver(ota);
+    ESP32OTAPullGateway gateway(ota, files);
+    ESP32OTAPullNotifier notifier(ota);
+    ESP32OTAPullUARTSink uart(Serial);
+    ESP32OTAPullFileSink file(files, "/asset.bin");
+    ESP32OTAPullPartitionSink partition(esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, "spiffs"));
+    (void)peer; (void)sender; (void)receiver; (void)gateway; (void)notifier; (void)uart; (void)file; (void)partition;
+
+    ESP32OTAPullMinimal minimal;
+    minimal.CheckForOTAUpdate("http://example.com/ota.json", "1.0.0", ESP32OTAPullMinimal::DONT_DO_UPDATE);
+}
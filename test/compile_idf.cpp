@@ -0,0 +1,13 @@
+// The core as built on plain ESP-IDF (no ARDUINO), against the stubs in stubs/: every member of the
+// full-featured instance and of the HTTPClient-transport variant is instantiated, so the whole header
+// has to compile without warnings.  ESP32OTAPullMinimal leaves features out, so only its API is used.
+#include "ESP32OTAPull.h"
+
+template class esp32otapull::BasicOTAPull<>;
+template class esp32otapull::BasicOTAPull<esp32otapull::ESP32OTAPullHTTPSTransport>;
+
+int CompileMinimal()
+{
+    ESP32OTAPullMinimal ota;
+    return ota.CheckForOTAUpdate("http://example.com/ota.json", "1.0.0", ESP32OTAPullMinimal::DONT_DO_UPDATE);
+}
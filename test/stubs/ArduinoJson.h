@@ -0,0 +1,576 @@
+/*
+A small working subset of ArduinoJson 7 for the host tests: the calls the library makes, on a
+tree of shared nodes.  Numbers are doubles, object keys keep their insertion order, and a
+missing member reads as null until something is assigned to it, as in ArduinoJson.
+*/
+
+#pragma once
+#include <ctype.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace hostjson
+{
+
+struct Node
+{
+    enum Kind { Null, Bool, Number, Text, Object, Array } Type = Null;
+    bool Flag = false;
+    double Value = 0;
+    std::string String;
+    std::vector<std::pair<std::string, std::shared_ptr<Node>>> Members;
+    std::vector<std::shared_ptr<Node>> Elements;
+
+    std::shared_ptr<Node> Member(const std::string &key) const
+    {
+        for (const auto &m : Members)
+            if (m.first == key)
+                return m.second;
+        return nullptr;
+    }
+
+    std::shared_ptr<Node> Clone() const
+    {
+        auto copy = std::make_shared<Node>(*this);
+        for (auto &m : copy->Members)
+            m.second = m.second->Clone();
+        for (auto &e : copy->Elements)
+            e = e->Clone();
+        return copy;
+    }
+};
+
+inline void Write(const Node *n, std::string &out)
+{
+    if (n == nullptr || n->Type == Node::Null)
+        out += "null";
+    else if (n->Type == Node::Bool)
+        out += n->Flag ? "true" : "false";
+    else if (n->Type == Node::Number)
+    {
+        char text[32];
+        if (n->Value == floor(n->Value) && fabs(n->Value) < 1e15)
+            snprintf(text, sizeof(text), "%.0f", n->Value);
+        else
+            snprintf(text, sizeof(text), "%.9g", n->Value);
+        out += text;
+    }
+    else if (n->Type == Node::Text)
+    {
+        out += '"';
+        for (char c : n->String)
+        {
+            if (c == '"' || c == '\\')
+                out += '\\';
+            out += c;
+        }
+        out += '"';
+    }
+    else if (n->Type == Node::Object)
+    {
+        out += '{';
+        for (size_t i = 0; i < n->Members.size(); ++i)
+        {
+            if (i > 0)
+                out += ',';
+            Node key;
+            key.Type = Node::Text;
+            key.String = n->Members[i].first;
+            Write(&key, out);
+            out += ':';
+            Write(n->Members[i].second.get(), out);
+        }
+        out += '}';
+    }
+    else
+    {
+        out += '[';
+        for (size_t i = 0; i < n->Elements.size(); ++i)
+        {
+            if (i > 0)
+                out += ',';
+            Write(n->Elements[i].get(), out);
+        }
+        out += ']';
+    }
+}
+
+class Parser
+{
+public:
+    Parser(const char *text, size_t length) : At(text), End(text + length) {}
+
+    std::shared_ptr<Node> Parse()
+    {
+        auto n = Value();
+        Space();
+        return At == End ? n : nullptr;
+    }
+
+private:
+    const char *At, *End;
+
+    void Space()
+    {
+        while (At < End && isspace((unsigned char)*At))
+            ++At;
+    }
+
+    bool Literal(const char *word)
+    {
+        size_t length = strlen(word);
+        if ((size_t)(End - At) < length || strncmp(At, word, length) != 0)
+            return false;
+        At += length;
+        return true;
+    }
+
+    bool Quoted(std::string &out)
+    {
+        if (At == End || *At != '"')
+            return false;
+        for (++At; At < End && *At != '"'; ++At)
+        {
+            if (*At == '\\' && ++At == End)
+                return false;
+            out += *At == 'n' && At[-1] == '\\' ? '\n' : *At;
+        }
+        if (At == End)
+            return false;
+        ++At;
+        return true;
+    }
+
+    std::shared_ptr<Node> Value()
+    {
+        Space();
+        auto n = std::make_shared<Node>();
+        if (At == End)
+            return nullptr;
+        if (*At == '{')
+        {
+            n->Type = Node::Object;
+            ++At;
+            Space();
+            if (At < End && *At == '}')
+                return ++At, n;
+            for (;;)
+            {
+                std::string key;
+                Space();
+                if (!Quoted(key))
+                    return nullptr;
+                Space();
+                if (At == End || *At++ != ':')
+                    return nullptr;
+                auto v = Value();
+                if (v == nullptr)
+                    return nullptr;
+                n->Members.emplace_back(key, v);
+                Space();
+                if (At < End && *At == ',')
+                    ++At;
+                else if (At < End && *At == '}')
+                    return ++At, n;
+                else
+                    return nullptr;
+            }
+        }
+        if (*At == '[')
+        {
+            n->Type = Node::Array;
+            ++At;
+            Space();
+            if (At < End && *At == ']')
+                return ++At, n;
+            for (;;)
+            {
+                auto v = Value();
+                if (v == nullptr)
+                    return nullptr;
+                n->Elements.push_back(v);
+                Space();
+                if (At < End && *At == ',')
+                    ++At;
+                else if (At < End && *At == ']')
+                    return ++At, n;
+                else
+                    return nullptr;
+            }
+        }
+        if (*At == '"')
+        {
+            n->Type = Node::Text;
+            return Quoted(n->String) ? n : nullptr;
+        }
+        if (Literal("true") || Literal("false"))
+        {
+            n->Type = Node::Bool;
+            n->Flag = At[-1] == 'e' && At[-2] == 'u';
+            return n;
+        }
+        if (Literal("null"))
+            return n;
+        std::string number(At, End);
+        char *stop;
+        n->Value = strtod(number.c_str(), &stop);
+        if (stop == number.c_str())
+            return nullptr;
+        At += stop - number.c_str();
+        n->Type = Node::Number;
+        return n;
+    }
+};
+
+template <typename T, typename = void> struct HasCStr : std::false_type {};
+template <typename T> struct HasCStr<T, decltype((void)std::declval<const T &>().c_str())> : std::true_type {};
+
+} // namespace hostjson
+
+class JsonObject;
+class JsonArray;
+class JsonVariant;
+
+class JsonString
+{
+public:
+    JsonString(const std::string &text = "") : Text(text) {}
+    const char *c_str() const { return Text.c_str(); }
+
+private:
+    std::string Text;
+};
+
+// A value in a document, or the place where a member or element would be
+class JsonVariant
+{
+public:
+    JsonVariant() {}
+    JsonVariant(const JsonVariant &) = default;
+    JsonVariant(std::shared_ptr<hostjson::Node> node) : NodePtr(node) {}
+    JsonVariant(std::shared_ptr<hostjson::Node> parent, const std::string &key) : Parent(parent), Key(key)
+    {
+        if (parent != nullptr && parent->Type == hostjson::Node::Object)
+            NodePtr = parent->Member(key);
+    }
+
+    bool isNull() const { return NodePtr == nullptr || NodePtr->Type == hostjson::Node::Null; }
+
+    template <typename T> bool is() const;
+    template <typename T> T as() const;
+    template <typename T> T to();
+
+    JsonVariant operator[](const char *key) const { return JsonVariant(NodePtr, key); }
+    JsonVariant operator[](const JsonString &key) const { return JsonVariant(NodePtr, key.c_str()); }
+    template <typename S, typename = std::enable_if_t<hostjson::HasCStr<S>::value>>
+    JsonVariant operator[](const S &key) const { return JsonVariant(NodePtr, key.c_str()); }
+    JsonVariant operator[](int index) const
+    {
+        if (NodePtr == nullptr || NodePtr->Type != hostjson::Node::Array || index < 0 || (size_t)index >= NodePtr->Elements.size())
+            return JsonVariant();
+        return JsonVariant(NodePtr->Elements[index]);
+    }
+
+    template <typename T> JsonVariant &operator=(const T &value)
+    {
+        Set(value);
+        return *this;
+    }
+    JsonVariant &operator=(const JsonVariant &value)
+    {
+        Set(value);
+        return *this;
+    }
+
+    template <typename T> T add();
+    template <typename T> bool add(const T &value);
+
+    operator const char *() const
+    {
+        return NodePtr != nullptr && NodePtr->Type == hostjson::Node::Text ? NodePtr->String.c_str() : nullptr;
+    }
+
+    operator JsonObject() const;
+    operator JsonArray() const;
+
+    std::shared_ptr<hostjson::Node> node() const { return NodePtr; }
+
+protected:
+    std::shared_ptr<hostjson::Node> NodePtr;
+    std::shared_ptr<hostjson::Node> Parent;
+    std::string Key;
+
+    // The node this refers to, created in its parent if it doesn't exist yet
+    hostjson::Node &Make()
+    {
+        if (NodePtr == nullptr)
+        {
+            NodePtr = std::make_shared<hostjson::Node>();
+            if (Parent != nullptr)
+            {
+                if (Parent->Type == hostjson::Node::Null)
+                    Parent->Type = hostjson::Node::Object;
+                Parent->Members.emplace_back(Key, NodePtr);
+            }
+        }
+        return *NodePtr;
+    }
+
+    template <typename T> void Set(const T &value)
+    {
+        hostjson::Node &n = Make();
+        n.Members.clear();
+        n.Elements.clear();
+        if constexpr (std::is_same<T, bool>::value)
+        {
+            n.Type = hostjson::Node::Bool;
+            n.Flag = value;
+        }
+        else if constexpr (std::is_arithmetic<T>::value)
+        {
+            n.Type = hostjson::Node::Number;
+            n.Value = (double)value;
+        }
+        else if constexpr (std::is_base_of<JsonVariant, T>::value)
+        {
+            auto copy = value.node() == nullptr ? std::make_shared<hostjson::Node>() : value.node()->Clone();
+            n = *copy;
+        }
+        else if constexpr (hostjson::HasCStr<T>::value)
+        {
+            n.Type = hostjson::Node::Text;
+            n.String = value.c_str();
+        }
+        else
+        {
+            const char *text = value;
+            n.Type = text == nullptr ? hostjson::Node::Null : hostjson::Node::Text;
+            n.String = text == nullptr ? "" : text;
+        }
+    }
+};
+
+class JsonPair
+{
+public:
+    JsonPair(const std::string &key, std::shared_ptr<hostjson::Node> value) : Key(key), Value(value) {}
+    JsonString key() const { return Key; }
+    JsonVariant value() const { return JsonVariant(Value); }
+
+private:
+    std::string Key;
+    std::shared_ptr<hostjson::Node> Value;
+};
+
+class JsonObject : public JsonVariant
+{
+public:
+    JsonObject() {}
+    JsonObject(std::shared_ptr<hostjson::Node> node) : JsonVariant(node && node->Type == hostjson::Node::Object ? node : nullptr) {}
+
+    class iterator
+    {
+    public:
+        iterator(const hostjson::Node *n, size_t i) : N(n), I(i) {}
+        JsonPair operator*() const { return JsonPair(N->Members[I].first, N->Members[I].second); }
+        iterator &operator++() { ++I; return *this; }
+        bool operator!=(const iterator &other) const { return I != other.I; }
+
+    private:
+        const hostjson::Node *N;
+        size_t I;
+    };
+
+    iterator begin() const { return iterator(NodePtr.get(), 0); }
+    iterator end() const { return iterator(NodePtr.get(), NodePtr == nullptr ? 0 : NodePtr->Members.size()); }
+    explicit operator bool() const { return NodePtr != nullptr; }
+};
+
+class JsonArray : public JsonVariant
+{
+public:
+    JsonArray() {}
+    JsonArray(std::shared_ptr<hostjson::Node> node) : JsonVariant(node && node->Type == hostjson::Node::Array ? node : nullptr) {}
+
+    class iterator
+    {
+    public:
+        iterator(const hostjson::Node *n, size_t i) : N(n), I(i) {}
+        JsonVariant operator*() const { return JsonVariant(N->Elements[I]); }
+        iterator &operator++() { ++I; return *this; }
+        bool operator!=(const iterator &other) const { return I != other.I; }
+
+    private:
+        const hostjson::Node *N;
+        size_t I;
+    };
+
+    iterator begin() const { return iterator(NodePtr.get(), 0); }
+    iterator end() const { return iterator(NodePtr.get(), NodePtr == nullptr ? 0 : NodePtr->Elements.size()); }
+    size_t size() const { return NodePtr == nullptr ? 0 : NodePtr->Elements.size(); }
+};
+
+inline JsonVariant::operator JsonObject() const { return JsonObject(NodePtr); }
+inline JsonVariant::operator JsonArray() const { return JsonArray(NodePtr); }
+
+template <typename T> bool JsonVariant::is() const
+{
+    if (NodePtr == nullptr)
+        return false;
+    if constexpr (std::is_same<T, JsonObject>::value)
+        return NodePtr->Type == hostjson::Node::Object;
+    else if constexpr (std::is_same<T, JsonArray>::value)
+        return NodePtr->Type == hostjson::Node::Array;
+    else if constexpr (std::is_same<T, bool>::value)
+        return NodePtr->Type == hostjson::Node::Bool;
+    else if constexpr (std::is_arithmetic<T>::value)
+        return NodePtr->Type == hostjson::Node::Number;
+    else
+        return NodePtr->Type == hostjson::Node::Text;
+}
+
+template <typename T> T JsonVariant::as() const
+{
+    if constexpr (std::is_same<T, JsonObject>::value || std::is_same<T, JsonArray>::value)
+        return T(NodePtr);
+    else if constexpr (std::is_same<T, bool>::value)
+        return NodePtr != nullptr && NodePtr->Type == hostjson::Node::Bool && NodePtr->Flag;
+    else if constexpr (std::is_arithmetic<T>::value)
+        return NodePtr != nullptr && NodePtr->Type == hostjson::Node::Number ? (T)NodePtr->Value : T();
+    else
+        return T((const char *)*this);
+}
+
+template <typename T> T JsonVariant::to()
+{
+    hostjson::Node &n = Make();
+    n = hostjson::Node();
+    n.Type = std::is_same<T, JsonArray>::value ? hostjson::Node::Array : hostjson::Node::Object;
+    return T(NodePtr);
+}
+
+template <typename T> T JsonVariant::add()
+{
+    hostjson::Node &n = Make();
+    if (n.Type != hostjson::Node::Array)
+        n = hostjson::Node(), n.Type = hostjson::Node::Array;
+    auto element = std::make_shared<hostjson::Node>();
+    element->Type = std::is_same<T, JsonArray>::value ? hostjson::Node::Array : hostjson::Node::Object;
+    n.Elements.push_back(element);
+    return T(element);
+}
+
+template <typename T> bool JsonVariant::add(const T &value)
+{
+    hostjson::Node &n = Make();
+    if (n.Type != hostjson::Node::Array)
+        n = hostjson::Node(), n.Type = hostjson::Node::Array;
+    auto element = std::make_shared<hostjson::Node>();
+    n.Elements.push_back(element);
+    JsonVariant target(element);
+    target = value;
+    return true;
+}
+
+class JsonDocument : public JsonVariant
+{
+public:
+    JsonDocument() : JsonVariant(std::make_shared<hostjson::Node>()) {}
+    JsonDocument(const JsonDocument &other) : JsonVariant(other.NodePtr->Clone()) {}
+    JsonDocument &operator=(const JsonDocument &other)
+    {
+        NodePtr = other.NodePtr->Clone();
+        return *this;
+    }
+
+    void clear() { *NodePtr = hostjson::Node(); }
+    using JsonVariant::operator[];
+};
+
+class DeserializationError
+{
+public:
+    enum Code { Ok, InvalidInput, EmptyInput };
+    DeserializationError(Code code = Ok) : Value(code) {}
+    explicit operator bool() const { return Value != Ok; }
+    const char *c_str() const { return Value == Ok ? "Ok" : Value == EmptyInput ? "EmptyInput" : "InvalidInput"; }
+    const char *f_str() const { return c_str(); }
+    Code code() const { return Value; }
+
+private:
+    Code Value;
+};
+
+inline DeserializationError deserializeJson(JsonDocument &doc, const char *text, size_t length)
+{
+    doc.clear();
+    if (length == 0)
+        return DeserializationError::EmptyInput;
+    auto n = hostjson::Parser(text, length).Parse();
+    if (n == nullptr)
+        return DeserializationError::InvalidInput;
+    *doc.node() = *n;
+    return DeserializationError::Ok;
+}
+
+inline DeserializationError deserializeJson(JsonDocument &doc, const uint8_t *text, size_t length)
+{
+    return deserializeJson(doc, (const char *)text, length);
+}
+
+inline DeserializationError deserializeJson(JsonDocument &doc, const char *text)
+{
+    return deserializeJson(doc, text, strlen(text));
+}
+
+// Anything with read() returning -1 at the end, e.g. a Stream
+template <typename Reader, typename = decltype(std::declval<Reader &>().read())>
+DeserializationError deserializeJson(JsonDocument &doc, Reader &reader)
+{
+    std::string text;
+    for (int c = reader.read(); c >= 0; c = reader.read())
+        text += (char)c;
+    return deserializeJson(doc, text.c_str(), text.length());
+}
+
+inline size_t measureJson(const JsonVariant &value)
+{
+    std::string text;
+    hostjson::Write(value.node().get(), text);
+    return text.length();
+}
+
+inline size_t serializeJson(const JsonVariant &value, std::string &out)
+{
+    out.clear();
+    hostjson::Write(value.node().get(), out);
+    return out.length();
+}
+
+inline size_t serializeJson(const JsonVariant &value, char *out, size_t size)
+{
+    std::string text;
+    hostjson::Write(value.node().get(), text);
+    if (size == 0)
+        return 0;
+    size_t n = text.length() < size - 1 ? text.length() : size - 1;
+    memcpy(out, text.data(), n);
+    out[n] = '\0';
+    return n;
+}
+
+// Anything with write(const uint8_t *, size_t), e.g. Print or File
+template <typename Writer, typename = decltype(std::declval<Writer &>().write((const uint8_t *)nullptr, (size_t)0))>
+size_t serializeJson(const JsonVariant &value, Writer &writer)
+{
+    std::string text;
+    hostjson::Write(value.node().get(), text);
+    return writer.write((const uint8_t *)text.data(), text.length());
+}
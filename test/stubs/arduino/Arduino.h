@@ -0,0 +1,280 @@
+/*
+Just enough of the Arduino core for ESP32 for the library and its add-ons to compile on the host and
+for the host tests to run them.  The clock is the ESP-IDF stub's (hosttest::Now): delay() advances
+it, so code that waits on millis() runs instantly.  Serial writes to stdout.  None of this is part of
+the library.
+*/
+
+#pragma once
+#include "../idf/host_idf.h"
+#include <ctype.h>
+#include <stdarg.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+using std::min;
+using std::max;
+
+typedef uint8_t byte;
+#define HEX 16
+#define DEC 10
+
+inline unsigned long millis() { return (unsigned long)(hosttest::Now / 1000); }
+inline unsigned long micros() { return (unsigned long)hosttest::Now; }
+inline void delay(uint32_t ms) { hosttest::Now += (int64_t)ms * 1000; }
+inline void yield() {}
+
+namespace hosttest
+{
+inline uint32_t RandomState = 12345;
+}
+
+// Deterministic, so a test run is repeatable
+inline long random(long howBig)
+{
+    hosttest::RandomState = hosttest::RandomState * 1103515245 + 12345;
+    return howBig <= 0 ? 0 : (long)((hosttest::RandomState >> 8) % (uint32_t)howBig);
+}
+inline long random(long howSmall, long howBig) { return howSmall + random(howBig - howSmall); }
+
+class String
+{
+public:
+    String(const char *text = "") : Text(text == NULL ? "" : text) {}
+    String(const std::string &text) : Text(text) {}
+    explicit String(char c) : Text(1, c) {}
+    explicit String(int value, unsigned char base = 10) : Text(Number((long)value, base)) {}
+    explicit String(unsigned int value, unsigned char base = 10) : Text(Number((unsigned long)value, base)) {}
+    explicit String(long value, unsigned char base = 10) : Text(Number(value, base)) {}
+    explicit String(unsigned long value, unsigned char base = 10) : Text(Number(value, base)) {}
+    explicit String(double value, unsigned int decimals = 2)
+    {
+        char text[40];
+        snprintf(text, sizeof(text), "%.*f", decimals, value);
+        Text = text;
+    }
+
+    const char *c_str() const { return Text.c_str(); }
+    unsigned int length() const { return Text.length(); }
+    bool isEmpty() const { return Text.empty(); }
+    bool reserve(unsigned int size) { Text.reserve(size); return true; }
+    char operator[](unsigned int index) const { return index < Text.length() ? Text[index] : '\0'; }
+    char charAt(unsigned int index) const { return (*this)[index]; }
+
+    String &operator+=(const String &other) { Text += other.Text; return *this; }
+    String &operator+=(const char *other) { Text += other; return *this; }
+    String &operator+=(char c) { Text += c; return *this; }
+    String &operator+=(int value) { Text += std::to_string(value); return *this; }
+    String &operator+=(unsigned int value) { Text += std::to_string(value); return *this; }
+    String &operator+=(long value) { Text += std::to_string(value); return *this; }
+    String &operator+=(unsigned long value) { Text += std::to_string(value); return *this; }
+    bool concat(const String &other) { Text += other.Text; return true; }
+    friend String operator+(String a, const String &b) { return a += b; }
+    friend String operator+(String a, const char *b) { return a += b; }
+    friend String operator+(String a, char b) { return a += b; }
+    friend String operator+(String a, int b) { return a += b; }
+    friend String operator+(String a, unsigned int b) { return a += b; }
+    friend String operator+(String a, long b) { return a += b; }
+    friend String operator+(String a, unsigned long b) { return a += b; }
+
+    friend bool operator==(const String &a, const String &b) { return a.Text == b.Text; }
+    friend bool operator!=(const String &a, const String &b) { return a.Text != b.Text; }
+    friend bool operator==(const String &a, const char *b) { return a.Text == b; }
+    friend bool operator!=(const String &a, const char *b) { return a.Text != b; }
+    friend bool operator<(const String &a, const String &b) { return a.Text < b.Text; }
+    friend bool operator>(const String &a, const String &b) { return a.Text > b.Text; }
+    bool equals(const String &other) const { return Text == other.Text; }
+    bool equalsIgnoreCase(const String &other) const { return strcasecmp(c_str(), other.c_str()) == 0; }
+    bool startsWith(const String &prefix) const { return Text.compare(0, prefix.Text.length(), prefix.Text) == 0; }
+    bool endsWith(const String &suffix) const
+    {
+        return Text.length() >= suffix.Text.length() && Text.compare(Text.length() - suffix.Text.length(), suffix.Text.length(), suffix.Text) == 0;
+    }
+
+    int indexOf(char c, unsigned int from = 0) const { return Find(Text.find(c, from)); }
+    int indexOf(const String &s, unsigned int from = 0) const { return Find(Text.find(s.Text, from)); }
+    int lastIndexOf(char c) const { return Find(Text.rfind(c)); }
+    int lastIndexOf(const String &s) const { return Find(Text.rfind(s.Text)); }
+
+    String substring(unsigned int from, unsigned int to = (unsigned int)-1) const
+    {
+        if (from > to)
+            std::swap(from, to);
+        if (from >= Text.length())
+            return String();
+        return String(Text.substr(from, to - from));
+    }
+
+    void replace(const String &find, const String &with)
+    {
+        if (find.isEmpty())
+            return;
+        for (size_t at = Text.find(find.Text); at != std::string::npos; at = Text.find(find.Text, at + with.Text.length()))
+            Text.replace(at, find.Text.length(), with.Text);
+    }
+
+    void remove(unsigned int index, unsigned int count = (unsigned int)-1)
+    {
+        if (index < Text.length())
+            Text.erase(index, count);
+    }
+
+    void toLowerCase() { for (char &c : Text) c = tolower((unsigned char)c); }
+    void toUpperCase() { for (char &c : Text) c = toupper((unsigned char)c); }
+
+    void trim()
+    {
+        size_t first = Text.find_first_not_of(" \t\r\n");
+        size_t last = Text.find_last_not_of(" \t\r\n");
+        Text = first == std::string::npos ? "" : Text.substr(first, last - first + 1);
+    }
+
+    long toInt() const { return atol(Text.c_str()); }
+
+private:
+    std::string Text;
+
+    static int Find(size_t at) { return at == std::string::npos ? -1 : (int)at; }
+
+    static std::string Number(unsigned long value, unsigned char base)
+    {
+        if (value == 0)
+            return "0";
+        std::string digits;
+        for (; value > 0; value /= base)
+            digits.insert(digits.begin(), "0123456789abcdefghijklmnopqrstuvwxyz"[value % base]);
+        return digits;
+    }
+
+    static std::string Number(long value, unsigned char base)
+    {
+        return value < 0 ? "-" + Number((unsigned long)-value, base) : Number((unsigned long)value, base);
+    }
+};
+
+class Print
+{
+public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t c) { return write(&c, 1); }
+    virtual size_t write(const uint8_t *data, size_t length) = 0;
+    size_t write(const char *text) { return write((const uint8_t *)text, strlen(text)); }
+
+    size_t print(const char *text) { return write((const uint8_t *)text, strlen(text)); }
+    size_t print(const String &text) { return print(text.c_str()); }
+    size_t print(char c) { return write((const uint8_t *)&c, 1); }
+    size_t print(long value, int base = 10) { return print(String(value, (unsigned char)base)); }
+    size_t print(int value, int base = 10) { return print((long)value, base); }
+    size_t print(unsigned long value, int base = 10) { return print(String(value, (unsigned char)base)); }
+    size_t print(unsigned int value, int base = 10) { return print((unsigned long)value, base); }
+    size_t print(double value, int decimals = 2) { return print(String(value, decimals)); }
+
+    size_t println() { return print("\r\n"); }
+    template <typename T> size_t println(const T &value) { return print(value) + println(); }
+    template <typename T> size_t println(const T &value, int base) { return print(value, base) + println(); }
+
+    __attribute__((format(printf, 2, 3))) size_t printf(const char *format, ...)
+    {
+        va_list args;
+        va_start(args, format);
+        int length = vsnprintf(NULL, 0, format, args);
+        va_end(args);
+        if (length < 0)
+            return 0;
+        std::vector<char> text(length + 1);
+        va_start(args, format);
+        vsnprintf(text.data(), text.size(), format, args);
+        va_end(args);
+        return write((const uint8_t *)text.data(), length);
+    }
+};
+
+class Stream : public Print
+{
+public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() { return -1; }
+    virtual void flush() {}
+    void setTimeout(unsigned long ms) { Timeout = ms; }
+
+    // Like the core's, waits up to the timeout for each byte
+    virtual size_t readBytes(uint8_t *buffer, size_t length)
+    {
+        size_t done = 0;
+        unsigned long started = millis();
+        while (done < length && millis() - started < Timeout)
+        {
+            int c = read();
+            if (c < 0)
+            {
+                delay(1);
+                continue;
+            }
+            buffer[done++] = (uint8_t)c;
+            started = millis();
+        }
+        return done;
+    }
+    size_t readBytes(char *buffer, size_t length) { return readBytes((uint8_t *)buffer, length); }
+
+protected:
+    unsigned long Timeout = 1000;
+};
+
+class HardwareSerial : public Stream
+{
+public:
+    using Print::write;
+    size_t write(const uint8_t *data, size_t length) override
+    {
+        return Quiet ? length : fwrite(data, 1, length, stdout);
+    }
+    int available() override { return 0; }
+    int read() override { return -1; }
+    void begin(unsigned long) {}
+
+    bool Quiet = false;             // set by a test to keep debug output out of its log
+};
+
+inline HardwareSerial Serial;
+
+struct EspClass
+{
+    void restart() { esp_restart(); }
+    uint32_t getFreeHeap() { return esp_get_free_heap_size(); }
+};
+
+inline EspClass ESP;
+
+// An IPv4 address, stored as lwIP does (first octet in the lowest byte)
+class IPAddress
+{
+public:
+    IPAddress(uint32_t address = 0) : Address(address) {}
+    IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) : Address(a | b << 8 | c << 16 | (uint32_t)d << 24) {}
+    operator uint32_t() const { return Address; }
+    uint8_t operator[](int index) const { return (uint8_t)(Address >> (8 * index)); }
+    bool operator==(const IPAddress &other) const { return Address == other.Address; }
+    bool operator!=(const IPAddress &other) const { return Address != other.Address; }
+
+    String toString() const
+    {
+        char text[16];
+        snprintf(text, sizeof(text), "%u.%u.%u.%u", (*this)[0], (*this)[1], (*this)[2], (*this)[3]);
+        return text;
+    }
+
+    bool fromString(const char *text)
+    {
+        unsigned a, b, c, d;
+        if (sscanf(text, "%u.%u.%u.%u", &a, &b, &c, &d) != 4 || a > 255 || b > 255 || c > 255 || d > 255)
+            return false;
+        *this = IPAddress(a, b, c, d);
+        return true;
+    }
+
+private:
+    uint32_t Address;
+};
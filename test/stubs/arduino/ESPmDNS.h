@@ -0,0 +1,19 @@
+// MDNS: nothing is ever found
+#pragma once
+#include "Arduino.h"
+
+class MDNSResponder
+{
+public:
+    bool begin(const char *) { return true; }
+    void end() {}
+    int queryService(const char *, const char *) { return 0; }
+    IPAddress IP(int) { return IPAddress(); }
+    uint16_t port(int) { return 0; }
+    String txt(int, const char *) { return String(); }
+    bool addService(const char *, const char *, uint16_t) { return true; }
+    bool addServiceTxt(const char *, const char *, const char *, const String &) { return true; }
+    bool removeService(const char *, const char *) { return true; }
+};
+
+inline MDNSResponder MDNS;
@@ -0,0 +1,126 @@
+// fs::FS and fs::File over an in-memory map of paths to contents; directories are implied by the paths
+#pragma once
+#include "Arduino.h"
+#include <map>
+#include <memory>
+
+#define FILE_READ   "r"
+#define FILE_WRITE  "w"
+#define FILE_APPEND "a"
+
+namespace fs
+{
+
+typedef std::map<std::string, std::shared_ptr<std::vector<uint8_t>>> Files;
+
+class File : public Stream
+{
+public:
+    File() {}
+    File(Files *files, const std::string &path, std::shared_ptr<std::vector<uint8_t>> data)
+        : Owner(files), Path(path), Data(data) {}
+
+    explicit operator bool() const { return Owner != NULL; }
+    bool isDirectory() const { return Owner != NULL && Data == nullptr; }
+    const char *name() const { size_t slash = Path.rfind('/'); return Path.c_str() + (slash == std::string::npos ? 0 : slash + 1); }
+    const char *path() const { return Path.c_str(); }
+    size_t size() const { return Data == nullptr ? 0 : Data->size(); }
+    size_t position() const { return At; }
+    bool seek(uint32_t position) { At = position; return Data != nullptr && position <= Data->size(); }
+    void close() { Owner = NULL; Data = nullptr; }
+
+    int available() override { return Data == nullptr ? 0 : (int)(Data->size() - min(At, Data->size())); }
+    int read() override { uint8_t c; return read(&c, 1) == 1 ? c : -1; }
+    size_t read(uint8_t *buffer, size_t length)
+    {
+        size_t n = min(length, (size_t)available());
+        if (n > 0)
+            memcpy(buffer, Data->data() + At, n);
+        At += n;
+        return n;
+    }
+
+    using Print::write;
+    size_t write(const uint8_t *data, size_t length) override
+    {
+        if (Data == nullptr)
+            return 0;
+        if (Data->size() < At + length)
+            Data->resize(At + length);
+        memcpy(Data->data() + At, data, length);
+        At += length;
+        return length;
+    }
+
+    // A directory lists the files directly inside it
+    File openNextFile()
+    {
+        std::string prefix = Path == "/" ? "/" : Path + "/";
+        for (auto entry = Owner->upper_bound(Last.empty() ? prefix : Last); entry != Owner->end(); ++entry)
+        {
+            if (entry->first.compare(0, prefix.size(), prefix) != 0)
+                break;
+            if (entry->first.find('/', prefix.size()) != std::string::npos)
+                continue;
+            Last = entry->first;
+            return File(Owner, entry->first, entry->second);
+        }
+        return File();
+    }
+
+private:
+    Files *Owner = NULL;
+    std::string Path, Last;
+    std::shared_ptr<std::vector<uint8_t>> Data; // null for a directory
+    size_t At = 0;
+};
+
+class FS
+{
+public:
+    File open(const String &path, const char *mode = FILE_READ)
+    {
+        std::string p = path.c_str();
+        auto found = Contents.find(p);
+        if (strcmp(mode, FILE_READ) == 0)
+        {
+            if (found != Contents.end())
+                return File(&Contents, p, found->second);
+            return IsDirectory(p) ? File(&Contents, p, nullptr) : File();
+        }
+        if (found == Contents.end() || strcmp(mode, FILE_WRITE) == 0)
+            found = Contents.insert_or_assign(p, std::make_shared<std::vector<uint8_t>>()).first;
+        File file(&Contents, p, found->second);
+        file.seek(found->second->size());
+        return file;
+    }
+
+    bool exists(const String &path) { return Contents.count(path.c_str()) > 0 || IsDirectory(path.c_str()); }
+    bool remove(const String &path) { return Contents.erase(path.c_str()) > 0; }
+    bool mkdir(const String &) { return true; }
+
+    // Like LittleFS: fails if the destination exists
+    bool rename(const String &from, const String &to)
+    {
+        auto found = Contents.find(from.c_str());
+        if (found == Contents.end() || Contents.count(to.c_str()) > 0)
+            return false;
+        Contents[to.c_str()] = found->second;
+        Contents.erase(found);
+        return true;
+    }
+
+    Files Contents;
+
+private:
+    bool IsDirectory(const std::string &path)
+    {
+        std::string prefix = path == "/" ? "/" : path + "/";
+        auto next = Contents.lower_bound(prefix);
+        return next != Contents.end() && next->first.compare(0, prefix.size(), prefix) == 0;
+    }
+};
+
+} // namespace fs
+
+using fs::File;
@@ -0,0 +1,130 @@
+/*
+HTTPClient: each request goes to the test's hosttest::Serve, which sees the method, URL and headers
+and answers with a status, headers and a body.  The body is then read from the WiFiClient passed to
+begin(), as with the real class.  Without a handler every request fails to connect.
+*/
+
+#pragma once
+#include "WiFi.h"
+#include <map>
+
+#define HTTPC_ERROR_CONNECTION_REFUSED  (-1)
+#define HTTPC_ERROR_SEND_HEADER_FAILED  (-2)
+#define HTTPC_ERROR_SEND_PAYLOAD_FAILED (-3)
+#define HTTPC_ERROR_NOT_CONNECTED       (-4)
+#define HTTPC_ERROR_CONNECTION_LOST     (-5)
+#define HTTPC_ERROR_NO_STREAM           (-6)
+#define HTTPC_ERROR_NO_HTTP_SERVER      (-7)
+#define HTTPC_ERROR_TOO_LESS_RAM        (-8)
+#define HTTPC_ERROR_ENCODING            (-9)
+#define HTTPC_ERROR_STREAM_WRITE        (-10)
+#define HTTPC_ERROR_READ_TIMEOUT        (-11)
+
+namespace hosttest
+{
+struct Request
+{
+    std::string Method, URL, Body;
+    std::map<std::string, std::string> Headers;
+};
+
+struct Response
+{
+    int Status = HTTPC_ERROR_CONNECTION_REFUSED;
+    std::map<std::string, std::string> Headers;
+    std::string Body;
+    int Size = -2;                  // Content-Length to report; -2 for the body's length, -1 for none
+};
+
+inline std::function<void(const Request &request, Response &response)> Serve;
+
+// Every request made, in order
+inline std::vector<Request> Requests;
+}
+
+class HTTPClient
+{
+public:
+    HTTPClient() {}
+    HTTPClient(const HTTPClient &) = delete;
+    HTTPClient &operator=(const HTTPClient &) = delete;
+    ~HTTPClient() { end(); }
+
+    bool begin(WiFiClient &client, const String &url)
+    {
+        Client = &client;
+        Req = hosttest::Request();
+        Req.URL = url.c_str();
+        return true;
+    }
+
+    void end()
+    {
+        if (Client != NULL && !Reuse)
+            Client->stop();
+        Client = NULL;
+        Status = 0;
+    }
+
+    void setReuse(bool reuse) { Reuse = reuse; }
+    void useHTTP10(bool) {}
+    void setConnectTimeout(int32_t) {}
+    void setTimeout(uint16_t) {}
+    void setFollowRedirects(int) {}
+
+    void addHeader(const String &name, const String &value) { Req.Headers[name.c_str()] = value.c_str(); }
+
+    void collectHeaders(const char *names[], size_t count)
+    {
+        Collect.assign(names, names + count);
+    }
+
+    String header(const char *name)
+    {
+        for (const auto &h : Answer.Headers)
+            if (strcasecmp(h.first.c_str(), name) == 0)
+                return h.second;
+        return String();
+    }
+
+    int GET() { return Send("GET", ""); }
+    int POST(const String &body) { return Send("POST", body.c_str()); }
+
+    int getSize() { return Answer.Size == -2 ? (int)Answer.Body.size() : Answer.Size; }
+    WiFiClient &getStream() { return *Client; }
+    WiFiClient *getStreamPtr() { return Client; }
+    bool connected() { return Client != NULL && Client->connected(); }
+
+    String getString()
+    {
+        std::string body;
+        for (int c = Client->read(); c >= 0; c = Client->read())
+            body += (char)c;
+        return body;
+    }
+
+private:
+    WiFiClient *Client = NULL;
+    bool Reuse = false;
+    int Status = 0;
+    hosttest::Request Req;
+    hosttest::Response Answer;
+    std::vector<std::string> Collect;
+
+    int Send(const char *method, const char *body)
+    {
+        if (Client == NULL)
+            return HTTPC_ERROR_NOT_CONNECTED;
+        Req.Method = method;
+        Req.Body = body;
+        hosttest::Requests.push_back(Req);
+        Answer = hosttest::Response();
+        if (hosttest::Serve)
+            hosttest::Serve(Req, Answer);
+        if (Answer.Status < 0)
+            return Answer.Status;
+        Client->Respond(Answer.Body);
+        Req.Headers.clear();
+        return Status = Answer.Status;
+    }
+};
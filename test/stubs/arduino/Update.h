@@ -0,0 +1,25 @@
+// Update: collects what is written, in hosttest::Updated
+#pragma once
+#include "Arduino.h"
+
+#define UPDATE_SIZE_UNKNOWN 0xFFFFFFFF
+#define U_FLASH 0
+
+namespace hosttest
+{
+inline std::vector<uint8_t> Updated;
+}
+
+class UpdateClass
+{
+public:
+    bool begin(size_t = UPDATE_SIZE_UNKNOWN, int = U_FLASH) { hosttest::Updated.clear(); return true; }
+    size_t write(uint8_t *data, size_t length) { hosttest::Updated.insert(hosttest::Updated.end(), data, data + length); return length; }
+    bool end(bool = false) { return true; }
+    void abort() {}
+    bool hasError() { return false; }
+    uint8_t getError() { return 0; }
+    const char *errorString() { return "No Error"; }
+};
+
+inline UpdateClass Update;
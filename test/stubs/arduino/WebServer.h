@@ -0,0 +1,79 @@
+// WebServer: requests are handed in by the test with Handle(); responses are kept in Responses
+#pragma once
+#include "WiFi.h"
+#include <functional>
+#include <map>
+
+typedef enum { HTTP_ANY, HTTP_GET, HTTP_HEAD, HTTP_POST, HTTP_PUT } HTTPMethod;
+
+class WebServer
+{
+public:
+    struct Reply
+    {
+        int Status;
+        std::map<std::string, std::string> Headers;
+        std::string Body;
+    };
+
+    WebServer(int port = 80) : Port(port) {}
+
+    void begin() { Running = true; }
+    void stop() { Running = false; }
+    void handleClient() {}
+    void onNotFound(std::function<void()> handler) { NotFound = handler; }
+    void collectHeaders(const char *[], size_t) {}
+
+    String uri() { return URI.c_str(); }
+    HTTPMethod method() { return Method; }
+    bool hasHeader(const String &name) { return RequestHeaders.count(name.c_str()) > 0; }
+    String header(const String &name) { return hasHeader(name) ? RequestHeaders[name.c_str()].c_str() : ""; }
+
+    void sendHeader(const String &name, const String &value) { Pending[name.c_str()] = value.c_str(); }
+    void setContentLength(size_t length) { Pending["Content-Length"] = std::to_string(length); }
+    void send(int status, const char *contentType, const String &body)
+    {
+        Pending["Content-Type"] = contentType;
+        Responses.push_back({ status, Pending, body.c_str() });
+        Pending.clear();
+    }
+
+    // The response body written directly to the connection goes into the last response
+    class Connection : public Print
+    {
+    public:
+        Connection(WebServer &server) : Server(server) {}
+        using Print::write;
+        size_t write(const uint8_t *data, size_t length) override
+        {
+            Server.Responses.back().Body.append((const char *)data, length);
+            return length;
+        }
+
+    private:
+        WebServer &Server;
+    };
+
+    Connection &client() { return Client; }
+
+    // For the test: run the server's handler on one request
+    void Handle(HTTPMethod method, const std::string &uri, const std::map<std::string, std::string> &headers = {})
+    {
+        Method = method;
+        URI = uri;
+        RequestHeaders = headers;
+        if (NotFound)
+            NotFound();
+    }
+
+    std::vector<Reply> Responses;
+    bool Running = false;
+
+private:
+    int Port;
+    std::function<void()> NotFound;
+    HTTPMethod Method = HTTP_GET;
+    std::string URI;
+    std::map<std::string, std::string> RequestHeaders, Pending;
+    Connection Client{ *this };
+};
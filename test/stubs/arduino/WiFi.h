@@ -0,0 +1,155 @@
+/*
+WiFi, WiFiClient: there is no network.  A connection succeeds only if the test's hosttest::Accept
+says so, and then carries whatever the test scripts onto it with Deliver() and CloseAfter(), each
+byte becoming readable at the scripted time on the stub clock.  Everything the device sends is kept
+in hosttest::Connections.
+*/
+
+#pragma once
+#include "Arduino.h"
+#include <deque>
+#include <functional>
+
+class WiFiClient;
+
+namespace hosttest
+{
+struct Connection
+{
+    std::string Host;
+    uint16_t Port;
+    int64_t At;                     // stub clock, microseconds
+    std::string Sent;
+};
+
+// Every connection made, in order
+inline std::vector<Connection> Connections;
+
+// Decides whether a connection to host:port succeeds, and scripts what the server sends on it
+inline std::function<bool(WiFiClient &client, const char *host, uint16_t port)> Accept;
+}
+
+class WiFiClient : public Stream
+{
+public:
+    WiFiClient() {}
+    WiFiClient(const WiFiClient &) = delete;
+    WiFiClient &operator=(const WiFiClient &) = delete;
+    virtual ~WiFiClient() {}
+
+    virtual int connect(const char *host, uint16_t port, int32_t timeoutMs = 3000)
+    {
+        (void)timeoutMs;
+        stop();
+        Index = hosttest::Connections.size();
+        hosttest::Connections.push_back({ host, port, hosttest::Now, "" });
+        Opened = hosttest::Now;
+        Open = hosttest::Accept && hosttest::Accept(*this, host, port);
+        return Open;
+    }
+
+    virtual int connect(IPAddress ip, uint16_t port, int32_t timeoutMs = 3000)
+    {
+        return connect(ip.toString().c_str(), port, timeoutMs);
+    }
+
+    uint8_t connected()
+    {
+        return Open && !(Closes >= 0 && hosttest::Now >= Closes && Due() == 0);
+    }
+
+    int available() override
+    {
+        return Open ? (int)Due() : 0;
+    }
+
+    int read() override
+    {
+        uint8_t c;
+        return read(&c, 1) == 1 ? c : -1;
+    }
+
+    int read(uint8_t *buffer, size_t length)
+    {
+        size_t n = min(length, Due());
+        for (size_t i = 0; i < n; ++i)
+        {
+            buffer[i] = Incoming.front().second;
+            Incoming.pop_front();
+        }
+        return n;
+    }
+
+    int peek() override
+    {
+        return Due() > 0 ? Incoming.front().second : -1;
+    }
+
+    using Print::write;
+    size_t write(const uint8_t *data, size_t length) override
+    {
+        if (!Open)
+            return 0;
+        hosttest::Connections[Index].Sent.append((const char *)data, length);
+        return length;
+    }
+
+    void stop()
+    {
+        Open = false;
+        Incoming.clear();
+        Closes = -1;
+    }
+
+    void setNoDelay(bool) {}
+
+    // For HTTPClient: a response that is already complete
+    void Respond(const std::string &body)
+    {
+        stop();
+        Open = true;
+        Opened = hosttest::Now;
+        Deliver(0, body);
+        CloseAfter(0);
+    }
+
+    // For the test: the server sends data delayMs after the connection was made
+    void Deliver(uint32_t delayMs, const std::string &data)
+    {
+        for (char c : data)
+            Incoming.emplace_back(Opened + (int64_t)delayMs * 1000, (uint8_t)c);
+    }
+
+    // For the test: the server closes the connection delayMs after it was made
+    void CloseAfter(uint32_t delayMs)
+    {
+        Closes = Opened + (int64_t)delayMs * 1000;
+    }
+
+protected:
+    bool Open = false;
+
+private:
+    size_t Index = 0;
+    int64_t Opened = 0, Closes = -1;
+    std::deque<std::pair<int64_t, uint8_t>> Incoming;
+
+    size_t Due() const
+    {
+        size_t n = 0;
+        while (n < Incoming.size() && Incoming[n].first <= hosttest::Now)
+            ++n;
+        return n;
+    }
+};
+
+typedef enum { WL_IDLE_STATUS = 0, WL_CONNECTED = 3, WL_DISCONNECTED = 6 } wl_status_t;
+
+struct WiFiClass
+{
+    wl_status_t status() { return WL_CONNECTED; }
+    IPAddress localIP() { return IPAddress(192, 168, 1, 50); }
+    String macAddress() { return "24:63:28:AD:FF:04"; }
+};
+
+inline WiFiClass WiFi;
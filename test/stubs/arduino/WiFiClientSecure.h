@@ -0,0 +1,32 @@
+// WiFiClientSecure: a WiFiClient (see WiFi.h) that remembers its TLS settings
+#pragma once
+#include "WiFi.h"
+
+class WiFiClientSecure : public WiFiClient
+{
+public:
+    void setInsecure() { Insecure = true; }
+    void setCACert(const char *rootCA) { CACert = rootCA; }
+    void setCertificate(const char *cert) { Certificate = cert; }
+    void setPrivateKey(const char *key) { PrivateKey = key; }
+    void setHandshakeTimeout(unsigned long) {}
+    int lastError(char *message, size_t size)
+    {
+        if (size > 0)
+            message[0] = '\0';
+        return 0;
+    }
+
+    using WiFiClient::connect;
+    int connect(IPAddress ip, uint16_t port, const char *host, const char *rootCA, const char *cert, const char *key)
+    {
+        (void)ip;
+        CACert = rootCA;
+        Certificate = cert;
+        PrivateKey = key;
+        return WiFiClient::connect(host, port);
+    }
+
+    bool Insecure = false;
+    const char *CACert = NULL, *Certificate = NULL, *PrivateKey = NULL;
+};
@@ -0,0 +1,46 @@
+/*
+WiFiUDP: packets sent by any WiFiUDP go to hosttest::Sent; a receiving WiFiUDP takes them from
+hosttest::Inbox, in order.
+*/
+
+#pragma once
+#include "WiFi.h"
+
+namespace hosttest
+{
+inline std::deque<std::vector<uint8_t>> Inbox;
+inline std::vector<std::vector<uint8_t>> Sent;
+}
+
+class WiFiUDP
+{
+public:
+    uint8_t begin(uint16_t port) { Port = port; return 1; }
+    uint8_t beginMulticast(IPAddress, uint16_t port) { Port = port; return 1; }
+    void stop() { Port = 0; }
+
+    int beginPacket(IPAddress, uint16_t) { Outgoing.clear(); return 1; }
+    size_t write(const uint8_t *data, size_t length) { Outgoing.insert(Outgoing.end(), data, data + length); return length; }
+    int endPacket() { hosttest::Sent.push_back(Outgoing); return 1; }
+
+    int parsePacket()
+    {
+        if (Port == 0 || hosttest::Inbox.empty())
+            return 0;
+        Incoming = hosttest::Inbox.front();
+        hosttest::Inbox.pop_front();
+        return Incoming.size();
+    }
+
+    int read(uint8_t *buffer, size_t length)
+    {
+        size_t n = min(length, Incoming.size());
+        memcpy(buffer, Incoming.data(), n);
+        Incoming.erase(Incoming.begin(), Incoming.begin() + n);
+        return n;
+    }
+
+private:
+    uint16_t Port = 0;
+    std::vector<uint8_t> Outgoing, Incoming;
+};
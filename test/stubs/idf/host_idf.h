@@ -0,0 +1,383 @@
+/*
+Just enough of ESP-IDF, FreeRTOS and mbedTLS for the library's headers to compile on the host,
+and for the host tests to run them.  Everything is inline; the few things a test wants to
+control or inspect (the clock, the partitions, NVS) are plain variables in namespace hosttest.
+None of this is part of the library.
+*/
+
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/time.h>
+#include <map>
+#include <string>
+#include <vector>
+
+#define CONFIG_IDF_TARGET "esp32"
+#define ESP_PLATFORM_HOST 1
+
+#if defined(__GLIBC__) && (__GLIBC__ == 2 && __GLIBC_MINOR__ < 38)
+inline size_t strlcpy(char *dst, const char *src, size_t size)
+{
+    size_t length = strlen(src);
+    if (size > 0)
+    {
+        size_t n = length < size - 1 ? length : size - 1;
+        memcpy(dst, src, n);
+        dst[n] = '\0';
+    }
+    return length;
+}
+#endif
+
+// ---- esp_err.h
+
+typedef int esp_err_t;
+#define ESP_OK                      0
+#define ESP_FAIL                    -1
+#define ESP_ERR_NO_MEM              0x101
+#define ESP_ERR_INVALID_ARG         0x102
+#define ESP_ERR_INVALID_STATE       0x103
+#define ESP_ERR_NOT_FOUND           0x105
+#define ESP_ERR_TIMEOUT             0x107
+#define ESP_ERR_NVS_NOT_FOUND       0x1102
+#define ESP_ERR_HTTP_BASE           0x7000
+#define ESP_ERR_HTTP_MAX_REDIRECT   (ESP_ERR_HTTP_BASE + 1)
+#define ESP_ERR_HTTP_CONNECT        (ESP_ERR_HTTP_BASE + 2)
+#define ESP_ERR_HTTP_WRITE_DATA     (ESP_ERR_HTTP_BASE + 3)
+#define ESP_ERR_HTTP_FETCH_HEADER   (ESP_ERR_HTTP_BASE + 4)
+#define ESP_ERR_HTTP_EAGAIN         (ESP_ERR_HTTP_BASE + 7)
+
+namespace hosttest
+{
+// Microseconds since boot; delay() and vTaskDelay() advance it
+inline int64_t Now = 0;
+
+struct Partition;
+}
+
+// ---- esp_attr.h
+
+#define RTC_DATA_ATTR
+#define RTC_NOINIT_ATTR
+#define IRAM_ATTR
+
+// ---- esp_timer.h
+
+inline int64_t esp_timer_get_time() { return hosttest::Now; }
+
+typedef struct esp_timer *esp_timer_handle_t;
+typedef void (*esp_timer_cb_t)(void *arg);
+typedef struct
+{
+    esp_timer_cb_t callback;
+    void *arg;
+    int dispatch_method;
+    const char *name;
+    bool skip_unhandled_events;
+} esp_timer_create_args_t;
+
+inline esp_err_t esp_timer_create(const esp_timer_create_args_t *, esp_timer_handle_t *out) { *out = NULL; return ESP_FAIL; }
+inline esp_err_t esp_timer_start_once(esp_timer_handle_t, uint64_t) { return ESP_FAIL; }
+inline esp_err_t esp_timer_stop(esp_timer_handle_t) { return ESP_OK; }
+inline esp_err_t esp_timer_delete(esp_timer_handle_t) { return ESP_OK; }
+
+// ---- FreeRTOS
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+typedef void *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *);
+typedef int portMUX_TYPE;
+#define pdPASS                          1
+#define pdFAIL                          0
+#define pdTRUE                          1
+#define pdFALSE                         0
+#define portMAX_DELAY                   0xffffffffu
+#define portTICK_PERIOD_MS              1
+#define pdMS_TO_TICKS(ms)               ((TickType_t)(ms))
+#define tskIDLE_PRIORITY                0
+#define portMUX_INITIALIZER_UNLOCKED    0
+#define taskENTER_CRITICAL(mux)         ((void)(mux))
+#define taskEXIT_CRITICAL(mux)          ((void)(mux))
+
+// No tasks on the host: creating one fails, so callers take their synchronous fallback
+inline BaseType_t xTaskCreate(TaskFunction_t, const char *, uint32_t, void *, UBaseType_t, TaskHandle_t *) { return pdFAIL; }
+inline void vTaskDelete(TaskHandle_t) {}
+inline void vTaskDelay(TickType_t ticks) { hosttest::Now += (int64_t)ticks * 1000; }
+inline UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t) { return 4096; }
+
+// ---- esp_system.h, esp_heap_caps.h, esp_mac.h
+
+namespace hosttest
+{
+inline int Restarts = 0;
+}
+inline void esp_restart() { ++hosttest::Restarts; }
+inline uint32_t esp_get_free_heap_size() { return 200000; }
+#define MALLOC_CAP_8BIT (1 << 2)
+inline size_t heap_caps_get_free_size(uint32_t) { return 200000; }
+inline size_t heap_caps_get_largest_free_block(uint32_t) { return 100000; }
+inline esp_err_t esp_efuse_mac_get_default(uint8_t *mac)
+{
+    static const uint8_t fixed[6] = { 0x24, 0x63, 0x28, 0xAD, 0xFF, 0x04 };
+    memcpy(mac, fixed, 6);
+    return ESP_OK;
+}
+
+// ---- esp_netif.h
+
+typedef struct esp_netif_obj esp_netif_t;
+typedef struct { uint32_t addr; } esp_ip4_addr_t;
+typedef struct { esp_ip4_addr_t ip, netmask, gw; } esp_netif_ip_info_t;
+#define ESP_IPADDR_TYPE_V4 0
+inline esp_netif_t *esp_netif_get_default_netif() { return NULL; }
+inline const char *esp_netif_get_ifkey(esp_netif_t *) { return NULL; }
+inline esp_err_t esp_netif_get_ip_info(esp_netif_t *, esp_netif_ip_info_t *) { return ESP_FAIL; }
+
+// ---- esp_partition.h: partitions are RAM buffers, flash semantics (erase to 0xFF, writes only clear bits)
+
+typedef enum { ESP_PARTITION_TYPE_APP = 0, ESP_PARTITION_TYPE_DATA = 1, ESP_PARTITION_TYPE_ANY = 0xff } esp_partition_type_t;
+typedef enum { ESP_PARTITION_SUBTYPE_ANY = 0xff } esp_partition_subtype_t;
+
+typedef struct
+{
+    void *flash_chip;
+    esp_partition_type_t type;
+    int subtype;
+    uint32_t address;
+    uint32_t size;
+    uint32_t erase_size;
+    char label[17];
+    bool encrypted;
+    bool readonly;
+} esp_partition_t;
+
+namespace hosttest
+{
+inline std::map<const esp_partition_t *, std::vector<uint8_t>> Flash;
+
+inline const esp_partition_t *MakePartition(const char *label, uint32_t size, esp_partition_type_t type = ESP_PARTITION_TYPE_APP)
+{
+    esp_partition_t *p = new esp_partition_t();
+    p->type = type;
+    p->size = size;
+    p->erase_size = 4096;
+    strlcpy(p->label, label, sizeof(p->label));
+    Flash[p].assign(size, 0xFF);
+    return p;
+}
+}
+
+inline esp_err_t esp_partition_read(const esp_partition_t *p, size_t offset, void *dst, size_t size)
+{
+    std::vector<uint8_t> &flash = hosttest::Flash[p];
+    if (offset + size > flash.size())
+        return ESP_ERR_INVALID_ARG;
+    memcpy(dst, flash.data() + offset, size);
+    return ESP_OK;
+}
+
+inline esp_err_t esp_partition_write(const esp_partition_t *p, size_t offset, const void *src, size_t size)
+{
+    std::vector<uint8_t> &flash = hosttest::Flash[p];
+    if (offset + size > flash.size())
+        return ESP_ERR_INVALID_ARG;
+    for (size_t i = 0; i < size; ++i)
+        flash[offset + i] &= ((const uint8_t *)src)[i];
+    return ESP_OK;
+}
+
+inline esp_err_t esp_partition_erase_range(const esp_partition_t *p, size_t offset, size_t size)
+{
+    std::vector<uint8_t> &flash = hosttest::Flash[p];
+    if (offset % 4096 != 0 || size % 4096 != 0 || offset + size > flash.size())
+        return ESP_ERR_INVALID_ARG;
+    memset(flash.data() + offset, 0xFF, size);
+    return ESP_OK;
+}
+
+inline const esp_partition_t *esp_partition_find_first(esp_partition_type_t type, int, const char *label)
+{
+    for (auto &entry : hosttest::Flash)
+        if (entry.first->type == type && (label == NULL || strcmp(entry.first->label, label) == 0))
+            return entry.first;
+    return NULL;
+}
+
+// ---- esp_ota_ops.h
+
+typedef uint32_t esp_ota_handle_t;
+typedef enum
+{
+    ESP_OTA_IMG_NEW = 0,
+    ESP_OTA_IMG_PENDING_VERIFY = 1,
+    ESP_OTA_IMG_VALID = 2,
+    ESP_OTA_IMG_INVALID = 3,
+    ESP_OTA_IMG_ABORTED = 4,
+    ESP_OTA_IMG_UNDEFINED = -1,
+} esp_ota_img_states_t;
+#define OTA_SIZE_UNKNOWN            0xffffffff
+#define OTA_WITH_SEQUENTIAL_WRITES  0xfffffffe
+
+namespace hosttest
+{
+inline const esp_partition_t *Running = NULL;
+inline const esp_partition_t *NextUpdate = NULL;
+inline const esp_partition_t *Boot = NULL;
+inline const esp_partition_t *LastInvalid = NULL;
+inline esp_ota_img_states_t RunningState = ESP_OTA_IMG_VALID;
+}
+
+inline const esp_partition_t *esp_ota_get_running_partition() { return hosttest::Running; }
+inline const esp_partition_t *esp_ota_get_boot_partition() { return hosttest::Boot != NULL ? hosttest::Boot : hosttest::Running; }
+inline const esp_partition_t *esp_ota_get_next_update_partition(const esp_partition_t *) { return hosttest::NextUpdate; }
+inline const esp_partition_t *esp_ota_get_last_invalid_partition() { return hosttest::LastInvalid; }
+inline esp_err_t esp_ota_set_boot_partition(const esp_partition_t *p) { hosttest::Boot = p; return ESP_OK; }
+inline esp_err_t esp_ota_get_state_partition(const esp_partition_t *p, esp_ota_img_states_t *state)
+{
+    if (p == NULL || p != hosttest::Running)
+        return ESP_ERR_NOT_FOUND;
+    *state = hosttest::RunningState;
+    return ESP_OK;
+}
+inline esp_err_t esp_ota_mark_app_valid_cancel_rollback() { hosttest::RunningState = ESP_OTA_IMG_VALID; return ESP_OK; }
+inline esp_err_t esp_ota_mark_app_invalid_rollback_and_reboot() { return ESP_FAIL; }
+inline esp_err_t esp_ota_begin(const esp_partition_t *, size_t, esp_ota_handle_t *out) { *out = 1; return ESP_OK; }
+inline esp_err_t esp_ota_write(esp_ota_handle_t, const void *, size_t) { return ESP_OK; }
+inline esp_err_t esp_ota_end(esp_ota_handle_t) { return ESP_OK; }
+inline esp_err_t esp_ota_abort(esp_ota_handle_t) { return ESP_OK; }
+
+// ---- nvs.h: one in-memory store shared by every handle
+
+typedef uint32_t nvs_handle_t;
+typedef enum { NVS_READONLY, NVS_READWRITE } nvs_open_mode_t;
+
+namespace hosttest
+{
+inline std::map<std::string, std::vector<uint8_t>> NVS;
+}
+
+inline esp_err_t nvs_open(const char *, nvs_open_mode_t, nvs_handle_t *out) { *out = 1; return ESP_OK; }
+inline void nvs_close(nvs_handle_t) {}
+inline esp_err_t nvs_commit(nvs_handle_t) { return ESP_OK; }
+inline esp_err_t nvs_erase_key(nvs_handle_t, const char *key)
+{
+    return hosttest::NVS.erase(key) > 0 ? ESP_OK : ESP_ERR_NVS_NOT_FOUND;
+}
+inline esp_err_t nvs_set_blob(nvs_handle_t, const char *key, const void *value, size_t length)
+{
+    hosttest::NVS[key].assign((const uint8_t *)value, (const uint8_t *)value + length);
+    return ESP_OK;
+}
+inline esp_err_t nvs_get_blob(nvs_handle_t, const char *key, void *value, size_t *length)
+{
+    auto found = hosttest::NVS.find(key);
+    if (found == hosttest::NVS.end())
+        return ESP_ERR_NVS_NOT_FOUND;
+    if (value != NULL)
+        memcpy(value, found->second.data(), found->second.size() < *length ? found->second.size() : *length);
+    *length = found->second.size();
+    return ESP_OK;
+}
+inline esp_err_t nvs_set_str(nvs_handle_t handle, const char *key, const char *value)
+{
+    return nvs_set_blob(handle, key, value, strlen(value) + 1);
+}
+inline esp_err_t nvs_get_str(nvs_handle_t handle, const char *key, char *value, size_t *length)
+{
+    return nvs_get_blob(handle, key, value, length);
+}
+
+// ---- esp_http_client.h: there is no network; every connection fails
+
+typedef struct esp_http_client *esp_http_client_handle_t;
+typedef enum { HTTP_METHOD_GET = 0, HTTP_METHOD_POST, HTTP_METHOD_HEAD } esp_http_client_method_t;
+typedef enum
+{
+    HTTP_EVENT_ERROR = 0,
+    HTTP_EVENT_ON_CONNECTED,
+    HTTP_EVENT_HEADERS_SENT,
+    HTTP_EVENT_ON_HEADER,
+    HTTP_EVENT_ON_DATA,
+    HTTP_EVENT_ON_FINISH,
+    HTTP_EVENT_DISCONNECTED,
+} esp_http_client_event_id_t;
+
+typedef struct esp_http_client_event
+{
+    esp_http_client_event_id_t event_id;
+    esp_http_client_handle_t client;
+    void *data;
+    int data_len;
+    void *user_data;
+    char *header_key;
+    char *header_value;
+} esp_http_client_event_t;
+
+typedef esp_err_t (*http_event_handle_cb)(esp_http_client_event_t *evt);
+
+typedef struct
+{
+    const char *url;
+    const char *cert_pem;
+    const char *client_cert_pem;
+    const char *client_key_pem;
+    esp_http_client_method_t method;
+    int timeout_ms;
+    bool disable_auto_redirect;
+    http_event_handle_cb event_handler;
+    void *user_data;
+    int buffer_size;
+    esp_err_t (*crt_bundle_attach)(void *conf);
+} esp_http_client_config_t;
+
+inline esp_http_client_handle_t esp_http_client_init(const esp_http_client_config_t *) { return NULL; }
+inline esp_err_t esp_http_client_perform(esp_http_client_handle_t) { return ESP_ERR_HTTP_CONNECT; }
+inline esp_err_t esp_http_client_set_url(esp_http_client_handle_t, const char *) { return ESP_OK; }
+inline esp_err_t esp_http_client_set_method(esp_http_client_handle_t, esp_http_client_method_t) { return ESP_OK; }
+inline esp_err_t esp_http_client_set_header(esp_http_client_handle_t, const char *, const char *) { return ESP_OK; }
+inline esp_err_t esp_http_client_delete_header(esp_http_client_handle_t, const char *) { return ESP_OK; }
+inline esp_err_t esp_http_client_open(esp_http_client_handle_t, int) { return ESP_ERR_HTTP_CONNECT; }
+inline int esp_http_client_write(esp_http_client_handle_t, const char *, int) { return -1; }
+inline int64_t esp_http_client_fetch_headers(esp_http_client_handle_t) { return -1; }
+inline bool esp_http_client_is_chunked_response(esp_http_client_handle_t) { return false; }
+inline int esp_http_client_read(esp_http_client_handle_t, char *, int) { return -1; }
+inline int esp_http_client_get_status_code(esp_http_client_handle_t) { return -1; }
+inline int64_t esp_http_client_get_content_length(esp_http_client_handle_t) { return -1; }
+inline esp_err_t esp_http_client_close(esp_http_client_handle_t) { return ESP_OK; }
+inline esp_err_t esp_http_client_cleanup(esp_http_client_handle_t) { return ESP_OK; }
+inline esp_err_t esp_http_client_get_and_clear_last_tls_error(esp_http_client_handle_t, int *code, int *flags) { *code = *flags = 0; return ESP_OK; }
+
+// ---- mdns.h: nothing is ever found
+
+typedef struct { uint32_t addr; } esp_ip4_addr_struct_t;
+typedef struct
+{
+    union { esp_ip4_addr_struct_t ip4; } u_addr;
+    uint8_t type;
+} esp_ip_addr_t;
+typedef struct mdns_ip_addr_s
+{
+    esp_ip_addr_t addr;
+    struct mdns_ip_addr_s *next;
+} mdns_ip_addr_t;
+typedef struct { const char *key; const char *value; } mdns_txt_item_t;
+typedef struct mdns_result_s
+{
+    struct mdns_result_s *next;
+    uint16_t port;
+    mdns_txt_item_t *txt;
+    size_t txt_count;
+    mdns_ip_addr_t *addr;
+} mdns_result_t;
+
+inline esp_err_t mdns_init() { return ESP_OK; }
+inline esp_err_t mdns_hostname_set(const char *) { return ESP_OK; }
+inline esp_err_t mdns_query_ptr(const char *, const char *, uint32_t, size_t, mdns_result_t **results) { *results = NULL; return ESP_OK; }
+inline void mdns_query_results_free(mdns_result_t *) {}
@@ -0,0 +1,330 @@
+/*
+The mbedTLS calls the library makes, for the host tests.  SHA-256 is the real algorithm.  AES is a
+stand-in block function (not AES), but CTR and GCM around it follow mbedTLS's calling conventions
+exactly, including the difference the decryptor cares about: mbedTLS 2.x's mbedtls_gcm_update()
+rejects a further call after a partial block, while 3.x may hold back up to 15 bytes of output until
+the next call or mbedtls_gcm_finish().  Define MBEDTLS_VERSION_NUMBER before including to pick one.
+*/
+
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+#ifndef MBEDTLS_VERSION_NUMBER
+#define MBEDTLS_VERSION_NUMBER 0x03060000
+#endif
+
+#define MBEDTLS_ERR_GCM_AUTH_FAILED -0x0012
+#define MBEDTLS_ERR_GCM_BAD_INPUT   -0x0014
+#define MBEDTLS_ERR_GCM_BUFFER_TOO_SMALL -0x0016
+#define MBEDTLS_GCM_ENCRYPT 1
+#define MBEDTLS_GCM_DECRYPT 0
+
+typedef enum { MBEDTLS_CIPHER_ID_NONE = 0, MBEDTLS_CIPHER_ID_AES = 2 } mbedtls_cipher_id_t;
+
+// ---- SHA-256 (FIPS 180-4)
+
+typedef struct
+{
+    uint32_t state[8];
+    uint64_t total;
+    uint8_t buffer[64];
+} mbedtls_sha256_context;
+
+namespace hosttest
+{
+inline void SHA256Block(uint32_t state[8], const uint8_t block[64])
+{
+    static const uint32_t k[64] = {
+        0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+        0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+        0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+        0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+        0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+        0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+        0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+        0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2 };
+    auto rotr = [](uint32_t x, int n) { return (x >> n) | (x << (32 - n)); };
+    uint32_t w[64];
+    for (int i = 0; i < 16; ++i)
+        w[i] = (uint32_t)block[4 * i] << 24 | (uint32_t)block[4 * i + 1] << 16 | (uint32_t)block[4 * i + 2] << 8 | block[4 * i + 3];
+    for (int i = 16; i < 64; ++i)
+        w[i] = w[i - 16] + (rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3)) + w[i - 7] +
+               (rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10));
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3], e = state[4], f = state[5], g = state[6], h = state[7];
+    for (int i = 0; i < 64; ++i)
+    {
+        uint32_t t1 = h + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + k[i] + w[i];
+        uint32_t t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+        h = g; g = f; f = e; e = d + t1; d = c; c = b; b = a; a = t1 + t2;
+    }
+    state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+    state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+}
+}
+
+inline void mbedtls_sha256_init(mbedtls_sha256_context *ctx) { memset(ctx, 0, sizeof(*ctx)); }
+inline void mbedtls_sha256_free(mbedtls_sha256_context *) {}
+
+inline int mbedtls_sha256_starts(mbedtls_sha256_context *ctx, int)
+{
+    static const uint32_t initial[8] = { 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 };
+    memcpy(ctx->state, initial, sizeof(initial));
+    ctx->total = 0;
+    return 0;
+}
+
+inline int mbedtls_sha256_update(mbedtls_sha256_context *ctx, const unsigned char *input, size_t length)
+{
+    for (size_t i = 0; i < length; ++i)
+    {
+        ctx->buffer[ctx->total++ % 64] = input[i];
+        if (ctx->total % 64 == 0)
+            hosttest::SHA256Block(ctx->state, ctx->buffer);
+    }
+    return 0;
+}
+
+inline int mbedtls_sha256_finish(mbedtls_sha256_context *ctx, unsigned char output[32])
+{
+    uint64_t bits = ctx->total * 8;
+    uint8_t pad = 0x80;
+    mbedtls_sha256_update(ctx, &pad, 1);
+    pad = 0;
+    while (ctx->total % 64 != 56)
+        mbedtls_sha256_update(ctx, &pad, 1);
+    uint8_t length[8];
+    for (int i = 0; i < 8; ++i)
+        length[i] = (uint8_t)(bits >> (56 - 8 * i));
+    mbedtls_sha256_update(ctx, length, 8);
+    for (int i = 0; i < 32; ++i)
+        output[i] = (uint8_t)(ctx->state[i / 4] >> (24 - 8 * (i % 4)));
+    return 0;
+}
+
+inline int mbedtls_sha256_starts_ret(mbedtls_sha256_context *ctx, int is224) { return mbedtls_sha256_starts(ctx, is224); }
+inline int mbedtls_sha256_update_ret(mbedtls_sha256_context *ctx, const unsigned char *input, size_t length) { return mbedtls_sha256_update(ctx, input, length); }
+inline int mbedtls_sha256_finish_ret(mbedtls_sha256_context *ctx, unsigned char output[32]) { return mbedtls_sha256_finish(ctx, output); }
+
+// ---- the block function and CTR
+
+typedef struct
+{
+    uint8_t key[32];
+} mbedtls_aes_context;
+
+inline void mbedtls_aes_init(mbedtls_aes_context *ctx) { memset(ctx, 0, sizeof(*ctx)); }
+inline void mbedtls_aes_free(mbedtls_aes_context *) {}
+
+inline int mbedtls_aes_setkey_enc(mbedtls_aes_context *ctx, const unsigned char *key, unsigned int bits)
+{
+    if (bits != 256)
+        return -0x0020;
+    memcpy(ctx->key, key, 32);
+    return 0;
+}
+
+namespace hosttest
+{
+// SHA-256(key || block), truncated: deterministic and key-dependent, which is all the tests need
+inline void EncryptBlock(const uint8_t key[32], const uint8_t in[16], uint8_t out[16])
+{
+    mbedtls_sha256_context sha;
+    uint8_t digest[32];
+    mbedtls_sha256_starts(&sha, 0);
+    mbedtls_sha256_update(&sha, key, 32);
+    mbedtls_sha256_update(&sha, in, 16);
+    mbedtls_sha256_finish(&sha, digest);
+    memcpy(out, digest, 16);
+}
+
+inline void Increment(uint8_t counter[16], int from = 15)
+{
+    for (int i = from; i >= 0 && ++counter[i] == 0; --i)
+        ;
+}
+}
+
+inline int mbedtls_aes_crypt_ctr(mbedtls_aes_context *ctx, size_t length, size_t *nc_off, unsigned char nonce_counter[16],
+                                 unsigned char stream_block[16], const unsigned char *input, unsigned char *output)
+{
+    size_t n = *nc_off;
+    if (n > 15)
+        return -0x0021;
+    for (size_t i = 0; i < length; ++i)
+    {
+        if (n == 0)
+        {
+            hosttest::EncryptBlock(ctx->key, nonce_counter, stream_block);
+            hosttest::Increment(nonce_counter);
+        }
+        output[i] = input[i] ^ stream_block[n];
+        n = (n + 1) % 16;
+    }
+    *nc_off = n;
+    return 0;
+}
+
+// ---- GCM: CTR from a 12-byte nonce || counter 2, and a tag over key, nonce and ciphertext
+
+typedef struct
+{
+    uint8_t key[32];
+    uint8_t counter[16];
+    uint8_t stream[16];
+    size_t used;                    // bytes of stream consumed
+    int mode;
+    bool partial;                   // 2.x: a partial block has been processed
+    uint8_t held[16];               // 3.x: input not yet output
+    size_t held_length;
+    mbedtls_sha256_context tag;
+} mbedtls_gcm_context;
+
+inline void mbedtls_gcm_init(mbedtls_gcm_context *ctx) { memset(ctx, 0, sizeof(*ctx)); }
+inline void mbedtls_gcm_free(mbedtls_gcm_context *) {}
+
+inline int mbedtls_gcm_setkey(mbedtls_gcm_context *ctx, mbedtls_cipher_id_t cipher, const unsigned char *key, unsigned int bits)
+{
+    if (cipher != MBEDTLS_CIPHER_ID_AES || bits != 256)
+        return MBEDTLS_ERR_GCM_BAD_INPUT;
+    memcpy(ctx->key, key, 32);
+    return 0;
+}
+
+namespace hosttest
+{
+inline int GcmStart(mbedtls_gcm_context *ctx, int mode, const unsigned char *iv, size_t iv_len)
+{
+    if (iv_len != 12)
+        return MBEDTLS_ERR_GCM_BAD_INPUT;
+    ctx->mode = mode;
+    memset(ctx->counter, 0, sizeof(ctx->counter));
+    memcpy(ctx->counter, iv, 12);
+    ctx->counter[15] = 2;
+    ctx->used = 16;
+    ctx->partial = false;
+    ctx->held_length = 0;
+    mbedtls_sha256_starts(&ctx->tag, 0);
+    mbedtls_sha256_update(&ctx->tag, ctx->key, 32);
+    mbedtls_sha256_update(&ctx->tag, iv, 12);
+    return 0;
+}
+
+inline void GcmCrypt(mbedtls_gcm_context *ctx, const uint8_t *input, size_t length, uint8_t *output)
+{
+    for (size_t i = 0; i < length; ++i)
+    {
+        if (ctx->used == 16)
+        {
+            EncryptBlock(ctx->key, ctx->counter, ctx->stream);
+            Increment(ctx->counter, 15);
+            ctx->used = 0;
+        }
+        uint8_t in = input[i];
+        output[i] = in ^ ctx->stream[ctx->used++];
+        uint8_t ciphertext = ctx->mode == MBEDTLS_GCM_DECRYPT ? in : output[i];
+        mbedtls_sha256_update(&ctx->tag, &ciphertext, 1);
+    }
+}
+
+inline void GcmTag(mbedtls_gcm_context *ctx, unsigned char *tag, size_t tag_len)
+{
+    uint8_t digest[32];
+    mbedtls_sha256_finish(&ctx->tag, digest);
+    memcpy(tag, digest, tag_len < 16 ? tag_len : 16);
+}
+}
+
+#if MBEDTLS_VERSION_NUMBER < 0x03000000
+
+inline int mbedtls_gcm_starts(mbedtls_gcm_context *ctx, int mode, const unsigned char *iv, size_t iv_len,
+                              const unsigned char *add, size_t add_len)
+{
+    (void)add;
+    return add_len != 0 ? MBEDTLS_ERR_GCM_BAD_INPUT : hosttest::GcmStart(ctx, mode, iv, iv_len);
+}
+
+// As in mbedTLS 2.x: every call but the last must be a whole number of blocks
+inline int mbedtls_gcm_update(mbedtls_gcm_context *ctx, size_t length, const unsigned char *input, unsigned char *output)
+{
+    if (ctx->partial && length > 0)
+        return MBEDTLS_ERR_GCM_BAD_INPUT;
+    if (length % 16 != 0)
+        ctx->partial = true;
+    hosttest::GcmCrypt(ctx, input, length, output);
+    return 0;
+}
+
+inline int mbedtls_gcm_finish(mbedtls_gcm_context *ctx, unsigned char *tag, size_t tag_len)
+{
+    hosttest::GcmTag(ctx, tag, tag_len);
+    return 0;
+}
+
+#else
+
+inline int mbedtls_gcm_starts(mbedtls_gcm_context *ctx, int mode, const unsigned char *iv, size_t iv_len)
+{
+    return hosttest::GcmStart(ctx, mode, iv, iv_len);
+}
+
+// As the mbedTLS 3.x contract allows: output only whole blocks, holding back the rest of the input
+inline int mbedtls_gcm_update(mbedtls_gcm_context *ctx, const unsigned char *input, size_t input_length,
+                              unsigned char *output, size_t output_size, size_t *output_length)
+{
+    size_t total = ctx->held_length + input_length;
+    size_t whole = total - total % 16;
+    *output_length = 0;
+    if (output_size < whole)
+        return MBEDTLS_ERR_GCM_BUFFER_TOO_SMALL;
+    // Input and output may overlap, and the output runs ahead of the input by the held bytes
+    std::vector<uint8_t> joined(ctx->held, ctx->held + ctx->held_length);
+    joined.insert(joined.end(), input, input + input_length);
+    hosttest::GcmCrypt(ctx, joined.data(), whole, output);
+    ctx->held_length = total - whole;
+    memcpy(ctx->held, joined.data() + whole, ctx->held_length);
+    *output_length = whole;
+    return 0;
+}
+
+inline int mbedtls_gcm_finish(mbedtls_gcm_context *ctx, unsigned char *output, size_t output_size, size_t *output_length,
+                              unsigned char *tag, size_t tag_len)
+{
+    *output_length = 0;
+    if (output_size < ctx->held_length)
+        return MBEDTLS_ERR_GCM_BUFFER_TOO_SMALL;
+    hosttest::GcmCrypt(ctx, ctx->held, ctx->held_length, output);
+    *output_length = ctx->held_length;
+    ctx->held_length = 0;
+    hosttest::GcmTag(ctx, tag, tag_len);
+    return 0;
+}
+
+#endif
+
+namespace hosttest
+{
+/// @brief Encrypt with the stand-in GCM in one go, for building test images
+inline void GcmEncrypt(const uint8_t key[32], const uint8_t iv[12], const uint8_t *plain, size_t length, uint8_t *cipher, uint8_t tag[16])
+{
+    mbedtls_gcm_context ctx;
+    mbedtls_gcm_init(&ctx);
+    mbedtls_gcm_setkey(&ctx, MBEDTLS_CIPHER_ID_AES, key, 256);
+    GcmStart(&ctx, MBEDTLS_GCM_ENCRYPT, iv, 12);
+    GcmCrypt(&ctx, plain, length, cipher);
+    GcmTag(&ctx, tag, 16);
+}
+
+/// @brief Encrypt with the stand-in CTR in one go
+inline void CtrEncrypt(const uint8_t key[32], const uint8_t iv[16], const uint8_t *plain, size_t length, uint8_t *cipher)
+{
+    mbedtls_aes_context ctx;
+    mbedtls_aes_setkey_enc(&ctx, key, 256);
+    uint8_t counter[16], stream[16];
+    memcpy(counter, iv, 16);
+    size_t offset = 0;
+    mbedtls_aes_crypt_ctr(&ctx, length, &offset, counter, stream, plain, cipher);
+}
+}
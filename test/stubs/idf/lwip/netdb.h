@@ -0,0 +1,4 @@
+#pragma once
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
@@ -0,0 +1,143 @@
+// ESP32OTAPullHexToBytes, the SHA-256 wrapper and ESP32OTAPullDecryptor, fed in pieces of awkward sizes.
+// Built twice: as is (mbedTLS 3.x conventions) and with MBEDTLS_VERSION_NUMBER set to a 2.x version.
+#include "ESP32OTAPullCrypto.h"
+#include "check.h"
+#include <vector>
+
+static const size_t Pieces[] = { 1, 15, 16, 17, 5, 100, 31, 3, 64, 2, 47 };
+
+static void TestHexToBytes()
+{
+    uint8_t bytes[4];
+    CHECK(ESP32OTAPullHexToBytes("00fF1a", bytes, sizeof(bytes)) == 3);
+    CHECK(bytes[0] == 0x00 && bytes[1] == 0xff && bytes[2] == 0x1a);
+    CHECK(ESP32OTAPullHexToBytes("", bytes, sizeof(bytes)) == 0);
+    CHECK(ESP32OTAPullHexToBytes("abc", bytes, sizeof(bytes)) == 0);        // odd length
+    CHECK(ESP32OTAPullHexToBytes("0011223344", bytes, sizeof(bytes)) == 0); // too long
+    CHECK(ESP32OTAPullHexToBytes("00zz", bytes, sizeof(bytes)) == 0);
+    CHECK(ESP32OTAPullHexToBytes("0x11", bytes, sizeof(bytes)) == 0);
+    CHECK(ESP32OTAPullHexToBytes(" f00", bytes, sizeof(bytes)) == 0);
+    CHECK(ESP32OTAPullHexToBytes("-1", bytes, sizeof(bytes)) == 0);
+    CHECK(ESP32OTAPullHexToBytes("+f", bytes, sizeof(bytes)) == 0);
+}
+
+static void TestSHA256()
+{
+    ESP32OTAPullSHA256 sha;
+    sha.Begin();
+    sha.Add((const uint8_t *)"ab", 2);
+    sha.Add((const uint8_t *)"c", 1);
+    char hex[65];
+    sha.Finish(hex);
+    CHECK(strcmp(hex, "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad") == 0);
+
+    sha.Begin();
+    sha.Add((const uint8_t *)"abc", 3);
+    CHECK(sha.Matches("BA7816BF8F01CFEA414140DE5DAE2223B00361A396177A9CB410FF61F20015AD"));
+    sha.Begin();
+    sha.Add((const uint8_t *)"abd", 3);
+    CHECK(!sha.Matches("ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad"));
+    sha.Begin();
+    CHECK(!sha.Matches("ba7816bf"));
+}
+
+// Decrypt cipher in Pieces, each in a buffer with the 15 spare bytes Process() may need
+static bool Decrypt(ESP32OTAPullDecryptor &decryptor, const std::vector<uint8_t> &cipher, const uint8_t *tag, std::vector<uint8_t> &plain)
+{
+    plain.clear();
+    size_t at = 0;
+    for (size_t i = 0; at < cipher.size(); ++i)
+    {
+        size_t length = std::min(Pieces[i % (sizeof(Pieces) / sizeof(Pieces[0]))], cipher.size() - at);
+        std::vector<uint8_t> buffer(length + 15, 0xAA);
+        memcpy(buffer.data(), cipher.data() + at, length);
+        at += length;
+        if (!decryptor.Process(buffer.data(), length))
+            return false;
+        CHECK(length <= buffer.size());
+        plain.insert(plain.end(), buffer.begin(), buffer.begin() + length);
+    }
+    uint8_t tail[15];
+    size_t tailLength = 0;
+    bool authentic = decryptor.Finish(tag, tail, tailLength);
+    CHECK(tailLength <= sizeof(tail));
+    plain.insert(plain.end(), tail, tail + tailLength);
+    return authentic;
+}
+
+static void TestCTR()
+{
+    uint8_t key[32], iv[16];
+    for (int i = 0; i < 32; ++i)
+        key[i] = i * 7;
+    for (int i = 0; i < 16; ++i)
+        iv[i] = 0xF0 + i; // the counter carries out of the low bytes
+    std::vector<uint8_t> image(1000), cipher(image.size());
+    for (size_t i = 0; i < image.size(); ++i)
+        image[i] = (uint8_t)(i * 31 + 5);
+    hosttest::CtrEncrypt(key, iv, image.data(), image.size(), cipher.data());
+    CHECK(cipher != image);
+
+    ESP32OTAPullDecryptor decryptor;
+    CHECK(decryptor.Begin(ESP32OTAPullDecryptor::AES256_CTR, key, iv, 16));
+    std::vector<uint8_t> plain;
+    CHECK(Decrypt(decryptor, cipher, NULL, plain));
+    CHECK(plain == image);
+
+    CHECK(!decryptor.Begin(ESP32OTAPullDecryptor::AES256_CTR, key, iv, 12));
+}
+
+static void TestGCM()
+{
+    uint8_t key[32], iv[12], tag[16];
+    for (int i = 0; i < 32; ++i)
+        key[i] = 0x80 ^ i;
+    for (int i = 0; i < 12; ++i)
+        iv[i] = i;
+
+    for (size_t size : { (size_t)0, (size_t)7, (size_t)16, (size_t)1000, (size_t)1024 })
+    {
+        std::vector<uint8_t> image(size), cipher(size);
+        for (size_t i = 0; i < size; ++i)
+            image[i] = (uint8_t)(i ^ (i >> 3));
+        hosttest::GcmEncrypt(key, iv, image.data(), size, cipher.data(), tag);
+
+        ESP32OTAPullDecryptor decryptor;
+        std::vector<uint8_t> plain;
+        CHECK(decryptor.Begin(ESP32OTAPullDecryptor::AES256_GCM, key, iv, 12));
+        CHECK(Decrypt(decryptor, cipher, tag, plain));
+        CHECK(plain == image);
+
+        uint8_t forged[16];
+        memcpy(forged, tag, 16);
+        forged[15] ^= 1;
+        CHECK(decryptor.Begin(ESP32OTAPullDecryptor::AES256_GCM, key, iv, 12));
+        CHECK(!Decrypt(decryptor, cipher, forged, plain));
+
+        if (size > 0)
+        {
+            cipher[size / 2] ^= 0x40;
+            CHECK(decryptor.Begin(ESP32OTAPullDecryptor::AES256_GCM, key, iv, 12));
+            CHECK(!Decrypt(decryptor, cipher, tag, plain));
+        }
+    }
+}
+
+static void TestNone()
+{
+    ESP32OTAPullDecryptor decryptor;
+    CHECK(decryptor.Begin(ESP32OTAPullDecryptor::NONE, NULL, NULL, 0));
+    std::vector<uint8_t> image = { 1, 2, 3 }, plain;
+    CHECK(Decrypt(decryptor, image, NULL, plain));
+    CHECK(plain == image);
+}
+
+int main()
+{
+    TestHexToBytes();
+    TestSHA256();
+    TestCTR();
+    TestGCM();
+    TestNone();
+    return TestResult();
+}
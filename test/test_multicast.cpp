@@ -0,0 +1,259 @@
+// Multicast distribution: the sender's packets and parity, the receiver rebuilding a lost block of a
+// group from the parity block and flash, and falling back to an HTTP Range request when it can't
+#include "ESP32OTAPullMulticast.h"
+#include "check.h"
+#include <set>
+
+static const uint32_t BLOCK = ESP32OTAPullMulticastHeader::BLOCK_SIZE;
+static const uint32_t SIZE = 10 * BLOCK + BLOCK / 2;  // 11 blocks, the last one short
+static const uint8_t GROUP = 4;                       // groups of blocks 0-3, 4-7 and 8-10
+
+static ESP32OTAPull OTA;
+static std::vector<uint8_t> Image;
+static char SHA256[65];
+static const esp_partition_t *Source, *Target;
+static std::vector<std::vector<uint8_t>> Packets;      // one round from the sender
+
+static ESP32OTAPullMulticastHeader Header(const std::vector<uint8_t> &packet)
+{
+    ESP32OTAPullMulticastHeader header;
+    memcpy(&header, packet.data(), sizeof(header));
+    return header;
+}
+
+// The running image, shared as ESP32OTAPull records it after installing and verifying it
+static void Setup()
+{
+    uint32_t seed = 1;
+    Image.resize(SIZE);
+    for (auto &b : Image)
+        b = (uint8_t)((seed = seed * 1103515245 + 12345) >> 16);
+    ESP32OTAPullSHA256 hash;
+    hash.Begin();
+    hash.Add(Image.data(), Image.size());
+    hash.Finish(SHA256);
+
+    Source = hosttest::MakePartition("ota_0", 64 * 1024);
+    Target = hosttest::MakePartition("ota_1", 64 * 1024);
+    hosttest::Running = Source;
+    hosttest::NextUpdate = Target;
+    std::copy(Image.begin(), Image.end(), hosttest::Flash[Source].begin());
+
+    ESP32OTAPull::SharedImage shared = {};
+    strlcpy(shared.SHA256, SHA256, sizeof(shared.SHA256));
+    shared.Size = SIZE;
+    strlcpy(shared.Partition, "ota_0", sizeof(shared.Partition));
+    nvs_handle_t handle;
+    nvs_open("esp32otapull", NVS_READWRITE, &handle);
+    nvs_set_blob(handle, "shared", &shared, sizeof(shared));
+    nvs_close(handle);
+}
+
+static void TestSender()
+{
+    ESP32OTAPullMulticastSender sender;
+    hosttest::Sent.clear();
+    CHECK(sender.Begin(IPAddress(239, 0, 79, 84), 5007, 1, GROUP, 1000));
+    int64_t started = hosttest::Now;
+    while (sender.Loop())
+        delay(1);
+    CHECK(hosttest::Now - started >= 14 * 1000 && hosttest::Now - started < 20 * 1000); // at the given rate
+    Packets = hosttest::Sent;
+
+    // D0 D1 D2 D3 P0 D4 D5 D6 D7 P1 D8 D9 D10 P2
+    CHECK(Packets.size() == 14);
+    if (Packets.size() != 14)
+        return;
+    uint32_t block = 0, group = 0;
+    for (const auto &packet : Packets)
+    {
+        ESP32OTAPullMulticastHeader header = Header(packet);
+        CHECK(header.Magic == ESP32OTAPullMulticastHeader::MAGIC);
+        CHECK(header.Session == ESP32OTAPullMulticastSession(SHA256));
+        CHECK(header.Size == SIZE && header.GroupSize == GROUP);
+        CHECK(packet.size() == sizeof(header) + header.Length);
+        const uint8_t *payload = packet.data() + sizeof(header);
+        if (header.Parity)
+        {
+            // The XOR of the group's blocks, the short last block taken as zero-padded
+            CHECK(header.Index == group && header.Length == BLOCK);
+            std::vector<uint8_t> parity(BLOCK, 0);
+            for (uint32_t b = group * GROUP; b < min((group + 1) * GROUP, 11u); ++b)
+                for (uint32_t i = 0; i < BLOCK && b * BLOCK + i < SIZE; ++i)
+                    parity[i] ^= Image[b * BLOCK + i];
+            CHECK(memcmp(payload, parity.data(), BLOCK) == 0);
+            ++group;
+        }
+        else
+        {
+            CHECK(header.Index == block);
+            CHECK(header.Length == (block == 10 ? BLOCK / 2 : BLOCK));
+            CHECK(memcmp(payload, Image.data() + block * BLOCK, header.Length) == 0);
+            ++block;
+        }
+    }
+    CHECK(block == 11 && group == 3);
+
+    // No intact shared image, nothing to send
+    hosttest::Flash[Source][100] ^= 1;
+    CHECK(!sender.Begin(IPAddress(239, 0, 79, 84), 5007));
+    hosttest::Flash[Source][100] ^= 1;
+}
+
+// Queue the round for the receiver without the given data blocks
+static void Deliver(const std::set<uint32_t> &dropped)
+{
+    hosttest::Inbox.clear();
+    for (const auto &packet : Packets)
+    {
+        ESP32OTAPullMulticastHeader header = Header(packet);
+        if (header.Parity || dropped.count(header.Index) == 0)
+            hosttest::Inbox.push_back(packet);
+    }
+}
+
+static ESP32OTAPull::OTAConfiguration Configuration()
+{
+    ESP32OTAPull::OTAConfiguration config = {};
+    strlcpy(config.URL, "http://example.com/image.bin", sizeof(config.URL));
+    strlcpy(config.Version, "2.0", sizeof(config.Version));
+    strlcpy(config.SHA256, SHA256, sizeof(config.SHA256));
+    config.Size = SIZE;
+    return config;
+}
+
+static int Receive()
+{
+    hosttest::Boot = NULL;
+    hosttest::Requests.clear();
+    std::fill(hosttest::Flash[Target].begin(), hosttest::Flash[Target].end(), 0x5A);
+    ESP32OTAPullMulticastReceiver receiver(OTA);
+    return receiver.Receive(Configuration(), IPAddress(239, 0, 79, 84), 5007, 60000, ESP32OTAPull::UPDATE_BUT_NO_BOOT);
+}
+
+static bool Installed()
+{
+    return std::equal(Image.begin(), Image.end(), hosttest::Flash[Target].begin());
+}
+
+// Answer a Range request for the image, or with the given status and body
+static void ServeRange(int status = 206, bool corrupt = false)
+{
+    hosttest::Serve = [=](const hosttest::Request &request, hosttest::Response &response)
+    {
+        unsigned from, to;
+        auto range = request.Headers.find("Range");
+        if (request.URL != "http://example.com/image.bin" || range == request.Headers.end() ||
+            sscanf(range->second.c_str(), "bytes=%u-%u", &from, &to) != 2 || to >= SIZE || from > to)
+        {
+            response.Status = 416;
+            return;
+        }
+        response.Status = status;
+        response.Body.assign(Image.begin() + from, Image.begin() + to + 1);
+        if (corrupt)
+            response.Body[0] ^= 1;
+    };
+}
+
+static void TestComplete()
+{
+    hosttest::Serve = nullptr;
+    Deliver({});
+    CHECK(Receive() == ESP32OTAPull::UPDATE_OK);
+    CHECK(Installed());
+    CHECK(OTA.GetResult().HashVerified);
+    CHECK(hosttest::Boot == Target);
+    CHECK(hosttest::Requests.empty());
+}
+
+static void TestRepair()
+{
+    // One block lost from every group, including the short last block: all rebuilt from parity
+    hosttest::Serve = nullptr;
+    for (const std::set<uint32_t> &dropped : { std::set<uint32_t> { 0, 7, 10 }, std::set<uint32_t> { 3, 5, 8 } })
+    {
+        Deliver(dropped);
+        CHECK(Receive() == ESP32OTAPull::UPDATE_OK);
+        CHECK(Installed());
+        CHECK(OTA.GetResult().HashVerified);
+        CHECK(hosttest::Boot == Target);
+        CHECK(hosttest::Requests.empty());
+        CHECK(hosttest::Inbox.empty());
+    }
+}
+
+static void TestRangeFallback()
+{
+    // Two blocks lost from the second group: parity can't rebuild them, so they are fetched in one Range request;
+    // the lone lost block of the last group is still rebuilt
+    ServeRange();
+    Deliver({ 5, 6, 9 });
+    CHECK(Receive() == ESP32OTAPull::UPDATE_OK);
+    CHECK(Installed());
+    CHECK(hosttest::Boot == Target);
+    CHECK(hosttest::Requests.size() == 1);
+    if (hosttest::Requests.size() == 1)
+        CHECK(hosttest::Requests[0].Headers["Range"] == "bytes=5120-7167");
+
+    // Two separate runs of lost blocks, one reaching the end of the image
+    Deliver({ 0, 1, 9, 10 });
+    CHECK(Receive() == ESP32OTAPull::UPDATE_OK);
+    CHECK(Installed());
+    CHECK(hosttest::Requests.size() == 2);
+    if (hosttest::Requests.size() == 2)
+    {
+        CHECK(hosttest::Requests[0].Headers["Range"] == "bytes=0-2047");
+        CHECK(hosttest::Requests[1].Headers["Range"] == "bytes=9216-10751");
+    }
+
+    // A server that ignores Range, and one that sends the wrong bytes
+    ServeRange(200);
+    Deliver({ 5, 6 });
+    CHECK(Receive() == 200);
+    CHECK(hosttest::Boot == NULL);
+    ServeRange(206, true);
+    Deliver({ 5, 6 });
+    CHECK(Receive() == ESP32OTAPull::VERIFY_FAIL);
+    CHECK(!OTA.GetResult().HashVerified);
+    CHECK(hosttest::Boot == NULL);
+    hosttest::Serve = nullptr;
+}
+
+static void TestDryRun()
+{
+    hosttest::Serve = nullptr;
+    OTA.SetDryRun(true);
+    Deliver({ 1, 4, 10 });
+    CHECK(Receive() == ESP32OTAPull::UPDATE_OK);
+    CHECK(std::all_of(hosttest::Flash[Target].begin(), hosttest::Flash[Target].end(), [](uint8_t b) { return b == 0x5A; }));
+    CHECK(hosttest::Boot == NULL);
+
+    // Still fails when a block is neither received nor rebuildable nor fetchable
+    Deliver({ 1, 2 });
+    CHECK(Receive() != ESP32OTAPull::UPDATE_OK);
+    OTA.SetDryRun(false);
+}
+
+static void TestUnusableConfiguration()
+{
+    ESP32OTAPullMulticastReceiver receiver(OTA);
+    ESP32OTAPull::OTAConfiguration config = Configuration();
+    config.SHA256[0] = '\0';
+    CHECK(receiver.Receive(config, IPAddress(239, 0, 79, 84), 5007, 1000) == ESP32OTAPull::OTA_UPDATE_FAIL);
+    config = Configuration();
+    config.Size = 0;
+    CHECK(receiver.Receive(config, IPAddress(239, 0, 79, 84), 5007, 1000) == ESP32OTAPull::OTA_UPDATE_FAIL);
+}
+
+int main()
+{
+    Setup();
+    TestSender();
+    TestComplete();
+    TestRepair();
+    TestRangeFallback();
+    TestDryRun();
+    TestUnusableConfiguration();
+    return TestResult();
+}
@@ -0,0 +1,191 @@
+// ESP32OTAPullNotifier against scripted servers: long polls held or answered at once, a silent
+// server, and a server-sent event stream with keep-alives, named and unnamed events and ids
+#include "ESP32OTAPullNotifier.h"
+#include "check.h"
+
+static ESP32OTAPull OTA;
+
+// Call Loop() once a millisecond for ms milliseconds; returns the number of notifications
+static int Run(ESP32OTAPullNotifier &notifier, uint32_t ms)
+{
+    int notifications = 0;
+    for (uint32_t i = 0; i < ms; ++i)
+    {
+        notifications += notifier.Loop();
+        delay(1);
+    }
+    return notifications;
+}
+
+// Milliseconds between the starts of connections a and b
+static int64_t Between(size_t a, size_t b)
+{
+    return (hosttest::Connections[b].At - hosttest::Connections[a].At) / 1000;
+}
+
+// Every connection gets the same answer after delayMs, and is then closed
+static void Answer(uint32_t delayMs, const std::string &response)
+{
+    hosttest::Connections.clear();
+    hosttest::Accept = [=](WiFiClient &client, const char *, uint16_t)
+    {
+        client.Deliver(delayMs, response);
+        client.CloseAfter(delayMs);
+        return true;
+    };
+}
+
+static void TestRequest()
+{
+    Answer(100, "HTTP/1.1 204 No Content\r\n\r\n");
+    ESP32OTAPullNotifier notifier(OTA);
+    CHECK(notifier.Begin("http://example.com:8080/events?device=1"));
+    Run(notifier, 50);
+    CHECK(notifier.IsConnected());
+    CHECK(hosttest::Connections.size() == 1);
+    CHECK(hosttest::Connections[0].Host == "example.com" && hosttest::Connections[0].Port == 8080);
+    const std::string &sent = hosttest::Connections[0].Sent;
+    CHECK(sent.rfind("GET /events?device=1 HTTP/1.0\r\nHost: example.com\r\n", 0) == 0);
+    CHECK(sent.find("Accept: text/event-stream\r\n") != std::string::npos);
+    CHECK(sent.find("Last-Event-ID") == std::string::npos);
+    CHECK(sent.size() >= 4 && sent.compare(sent.size() - 4, 4, "\r\n\r\n") == 0);
+    notifier.End();
+    CHECK(!notifier.IsConnected());
+    CHECK(Run(notifier, 5000) == 0 && hosttest::Connections.size() == 1);
+
+    ESP32OTAPullNotifier bad(OTA);
+    CHECK(!bad.Begin("example.com/events"));
+    CHECK(!bad.Begin("http:///events"));
+}
+
+static void TestHeldLongPoll()
+{
+    // The server holds each poll for 30 s and answers 204: reconnect at once, and never time out first
+    Answer(30000, "HTTP/1.1 204 No Content\r\nContent-Length: 0\r\n\r\n");
+    ESP32OTAPullNotifier notifier(OTA);
+    notifier.Begin("http://example.com/poll");
+    CHECK(Run(notifier, 100000) == 0);
+    CHECK(hosttest::Connections.size() == 4);
+    for (size_t i = 1; i < hosttest::Connections.size(); ++i)
+        CHECK(Between(i - 1, i) >= 30000 && Between(i - 1, i) <= 30002);
+
+    // The same for 304
+    Answer(20000, "HTTP/1.1 304 Not Modified\r\n\r\n");
+    notifier.Begin("http://example.com/poll");
+    CHECK(Run(notifier, 50000) == 0);
+    CHECK(hosttest::Connections.size() == 3);
+    CHECK(Between(0, 1) >= 20000 && Between(0, 1) <= 20002);
+}
+
+static void TestQuickLongPoll()
+{
+    // A server that answers 304 straight away is backed off from, more each time
+    Answer(100, "HTTP/1.1 304 Not Modified\r\n\r\n");
+    ESP32OTAPullNotifier notifier(OTA);
+    notifier.SetBackoff(1000, 4000);
+    notifier.Begin("http://example.com/poll");
+    CHECK(Run(notifier, 20000) == 0);
+    CHECK(hosttest::Connections.size() >= 5);
+    CHECK(Between(0, 1) >= 100 + 500 && Between(0, 1) <= 100 + 1000 + 2);
+    CHECK(Between(1, 2) >= 100 + 1000 && Between(1, 2) <= 100 + 2000 + 2);
+    CHECK(Between(2, 3) >= 100 + 2000 && Between(2, 3) <= 100 + 4000 + 2);
+    CHECK(Between(3, 4) >= 100 + 2000 && Between(3, 4) <= 100 + 4000 + 2); // the maximum
+}
+
+static void TestNotifyingLongPoll()
+{
+    // A 200 is a notification, once, and is followed by a pause rather than an immediate poll
+    Answer(15000, "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\n\r\n{}");
+    ESP32OTAPullNotifier notifier(OTA);
+    notifier.Begin("http://example.com/poll");
+    CHECK(Run(notifier, 15100) == 1);
+    CHECK(hosttest::Connections.size() == 1);
+    CHECK(Run(notifier, 1000) == 0);
+    CHECK(hosttest::Connections.size() == 2);
+    CHECK(Between(0, 1) >= 15000 + 500);
+}
+
+static void TestErrors()
+{
+    // An error status, and a refused connection, are both retried with backoff
+    Answer(10, "HTTP/1.1 503 Service Unavailable\r\n\r\n");
+    ESP32OTAPullNotifier notifier(OTA);
+    notifier.Begin("http://example.com/poll");
+    CHECK(Run(notifier, 1100) == 0);
+    CHECK(hosttest::Connections.size() == 2);
+    CHECK(Between(0, 1) >= 10 + 500);
+
+    hosttest::Connections.clear();
+    hosttest::Accept = nullptr;
+    notifier.Begin("http://example.com/poll");
+    CHECK(Run(notifier, 1100) == 0);
+    CHECK(hosttest::Connections.size() == 2);
+    CHECK(Between(0, 1) >= 500);
+    CHECK(!notifier.IsConnected());
+}
+
+static void TestSilentServer()
+{
+    // Nothing at all arrives: reconnect when the idle timeout expires, and not before
+    hosttest::Connections.clear();
+    hosttest::Accept = [](WiFiClient &, const char *, uint16_t) { return true; };
+    ESP32OTAPullNotifier notifier(OTA);
+    notifier.SetIdleTimeout(5000);
+    notifier.Begin("http://example.com/poll");
+    CHECK(Run(notifier, 4900) == 0);
+    CHECK(hosttest::Connections.size() == 1 && notifier.IsConnected());
+    CHECK(Run(notifier, 300) == 0);
+    CHECK(hosttest::Connections.size() == 2);
+    CHECK(Between(0, 1) > 5000 && Between(0, 1) <= 5002);
+}
+
+static void TestEventStream()
+{
+    hosttest::Connections.clear();
+    hosttest::Accept = [](WiFiClient &client, const char *, uint16_t)
+    {
+        if (hosttest::Connections.size() > 1)
+            return true; // the reconnection: silent
+        client.Deliver(10, "HTTP/1.1 200 OK\r\nContent-Type: text/event-stream; charset=utf-8\r\n\r\n");
+        // Only the keep-alives bridge the 130 s to the first event
+        client.Deliver(60000, ": ping\r\n\r\n");
+        client.Deliver(120000, ":\n");
+        client.Deliver(130000, "event: manifest\ndata: {\"Version\":\"2.0\"}\nid: 7\n\n");
+        client.Deliver(180000, "event: other\ndata: x\nid: 8\n\n");
+        client.Deliver(230000, "data: first\ndata: second\n\n");
+        client.Deliver(280000, ": " + std::string(300, '-') + "\n");
+        client.Deliver(280000, "data: " + std::string(300, 'x') + "\nevent: manifest\n\n");
+        client.Deliver(290000, "id: 9\n\n");
+        client.CloseAfter(300000);
+        return true;
+    };
+    ESP32OTAPullNotifier notifier(OTA);
+    notifier.Begin("http://example.com/events");
+
+    CHECK(Run(notifier, 129000) == 0);
+    CHECK(hosttest::Connections.size() == 1 && notifier.IsConnected());
+    CHECK(Run(notifier, 2000) == 1);        // "manifest"
+    CHECK(Run(notifier, 50000) == 0);       // "other"
+    CHECK(Run(notifier, 50000) == 1);       // unnamed, with data on two lines
+    CHECK(Run(notifier, 50000) == 1);       // an over-long data line still counts; the comment does not
+    CHECK(Run(notifier, 18000) == 0);       // id only: no data, so nothing to dispatch
+    CHECK(hosttest::Connections.size() == 1);
+
+    // The server closes the stream; reconnect and resume from the last id an event with data carried
+    CHECK(Run(notifier, 3000) == 0);
+    CHECK(hosttest::Connections.size() == 2);
+    CHECK(Between(0, 1) >= 300000 + 500 && Between(0, 1) <= 300000 + 1000 + 2);
+    CHECK(hosttest::Connections[1].Sent.find("\r\nLast-Event-ID: 8\r\n") != std::string::npos);
+}
+
+int main()
+{
+    TestRequest();
+    TestHeldLongPoll();
+    TestQuickLongPoll();
+    TestNotifyingLongPoll();
+    TestErrors();
+    TestSilentServer();
+    TestEventStream();
+    return TestResult();
+}
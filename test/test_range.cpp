@@ -0,0 +1,45 @@
+// ESP32OTAPullParseRange, which both the peer server and the gateway answer Range requests with
+#include "ESP32OTAPullRange.h"
+#include "check.h"
+
+static bool Range(const char *header, uint32_t size, int status, uint32_t first, uint32_t last)
+{
+    uint32_t f = 12345, l = 12345;
+    int result = ESP32OTAPullParseRange(header, size, f, l);
+    if (result != status)
+        printf("  \"%s\" of %u: %d, expected %d\n", header ? header : "(none)", (unsigned)size, result, status);
+    return result == status && (status != 206 || (f == first && l == last));
+}
+
+int main()
+{
+    // No usable header: the whole resource
+    CHECK(Range(NULL, 1000, 200, 0, 999));
+    CHECK(Range("", 1000, 200, 0, 999));
+    CHECK(Range("items=0-9", 1000, 200, 0, 999));
+    CHECK(Range("bytes=0-9,20-29", 1000, 200, 0, 999));
+    CHECK(Range("bytes=abc", 1000, 200, 0, 999));
+    CHECK(Range("bytes=9-0", 1000, 200, 0, 999));
+    CHECK(Range("bytes=-", 1000, 200, 0, 999));
+    CHECK(Range("bytes=1-2x", 1000, 200, 0, 999));
+    CHECK(Range("bytes= 1-2", 1000, 200, 0, 999));
+    CHECK(Range("bytes=0-9", 0, 200, 0, 0));
+
+    // first-last, first-, clamped to the end
+    CHECK(Range("bytes=0-9", 1000, 206, 0, 9));
+    CHECK(Range("bytes=500-", 1000, 206, 500, 999));
+    CHECK(Range("bytes=990-1999", 1000, 206, 990, 999));
+    CHECK(Range("bytes=999-999", 1000, 206, 999, 999));
+    CHECK(Range("bytes=0-4294967295", 1000, 206, 0, 999));
+
+    // Suffixes
+    CHECK(Range("bytes=-100", 1000, 206, 900, 999));
+    CHECK(Range("bytes=-5000", 1000, 206, 0, 999));
+
+    // Unsatisfiable
+    CHECK(Range("bytes=1000-", 1000, 416, 0, 0));
+    CHECK(Range("bytes=1000-1100", 1000, 416, 0, 0));
+    CHECK(Range("bytes=-0", 1000, 416, 0, 0));
+
+    return TestResult();
+}
@@ -0,0 +1,298 @@
+// ESP32OTAPullUARTSink against a simulated bootloader on a lossy serial link: the window, NAKs, lost
+// acknowledgements, timeouts and sequence numbers wrapping past 255
+#include "ESP32OTAPullUARTSink.h"
+#include "check.h"
+#include <deque>
+
+// The other MCU's bootloader as the protocol in ESP32OTAPullUARTSink.h describes it (a go-back-N
+// receiver), behind a link that loses or corrupts frames and loses answers at the given rates
+class Bootloader : public Stream
+{
+public:
+    uint32_t LatencyMs = 3;         // time to take in a frame and answer it
+    int DropFrames = 0;             // per thousand frames that vanish
+    int CorruptFrames = 0;          // per thousand frames that arrive with a flipped bit
+    int DropAnswers = 0;            // per thousand ACKs/NAKs that vanish
+    int AnswerLimit = -1;           // stop answering after this many frames (-1: never)
+    bool NakData = false;           // answer every data frame with a NAK
+
+    std::vector<uint8_t> Image;
+    uint32_t DeclaredSize = 0;
+    bool Begun = false, Ended = false, Aborted = false, OffsetError = false;
+    int Frames = 0;                 // frames that arrived intact
+    int MaxInFlight = 0;            // most data frames sent ahead of the last acknowledgement the sink read
+
+    explicit Bootloader(uint32_t seed) : Seed(seed) {}
+
+    static uint16_t CRC16(const uint8_t *data, size_t length)
+    {
+        uint16_t crc = 0xFFFF;
+        while (length--)
+        {
+            crc ^= (uint16_t)*data++ << 8;
+            for (int i = 0; i < 8; ++i)
+                crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+        }
+        return crc;
+    }
+
+    using Print::write;
+    size_t write(const uint8_t *data, size_t length) override
+    {
+        In.insert(In.end(), data, data + length);
+        while (In.size() >= 5)
+        {
+            if (In[0] != 0x01)
+            {
+                In.erase(In.begin());
+                continue;
+            }
+            size_t length = In[3] | In[4] << 8;
+            if (In.size() < 5 + length + 2)
+                break;
+            std::vector<uint8_t> frame(In.begin(), In.begin() + 5 + length + 2);
+            In.erase(In.begin(), In.begin() + frame.size());
+            Arrived(frame);
+        }
+        return length;
+    }
+
+    int available() override
+    {
+        int n = 0;
+        for (const auto &a : Out)
+            if (a.first <= hosttest::Now)
+                ++n;
+        return n;
+    }
+
+    int read() override
+    {
+        if (available() == 0)
+            return -1;
+        uint8_t c = Out.front().second;
+        Out.pop_front();
+        // Track what the sink now knows has arrived
+        if (Answer >= 0)
+        {
+            uint8_t upTo = Answer == 0x15 ? c : (uint8_t)(c + 1);
+            if ((uint8_t)(upTo - AckedUpTo) < 128)
+                AckedUpTo = upTo; // a repeated, older answer acknowledges nothing new
+            Answer = -1;
+        }
+        else if (c == 0x06 || c == 0x15)
+            Answer = c;
+        return c;
+    }
+
+private:
+    uint32_t Seed;
+    std::vector<uint8_t> In;
+    std::deque<std::pair<int64_t, uint8_t>> Out;
+    uint8_t Expected = 0;
+    bool Nakked = false;            // a NAK for Expected is outstanding
+    int Answer = -1;
+    uint8_t AckedUpTo = 0, HighestSent = 0;
+
+    bool Chance(int perThousand)
+    {
+        Seed = Seed * 1103515245 + 12345;
+        return (int)((Seed >> 8) % 1000) < perThousand;
+    }
+
+    void Reply(uint8_t code, uint8_t seq)
+    {
+        if (AnswerLimit >= 0 && Frames > AnswerLimit)
+            return;
+        if (Chance(DropAnswers))
+            return;
+        int64_t at = hosttest::Now + (int64_t)LatencyMs * 1000;
+        if (!Out.empty() && Out.back().first > at)
+            at = Out.back().first;
+        if (Chance(100))
+            Out.emplace_back(at, 0x00); // line noise between answers
+        Out.emplace_back(at, code);
+        Out.emplace_back(at, seq);
+    }
+
+    void Arrived(std::vector<uint8_t> frame)
+    {
+        if (Chance(DropFrames))
+            return;
+        if (Chance(CorruptFrames))
+            frame[5 + (frame.size() - 7) / 2] ^= 0x10; // in the payload, or in the CRC of an empty frame
+        uint8_t type = frame[1], seq = frame[2];
+        size_t length = frame.size() - 7;
+        const uint8_t *payload = frame.data() + 5;
+        uint16_t crc = frame[5 + length] | frame[6 + length] << 8;
+        if (crc != CRC16(frame.data() + 1, 4 + length))
+        {
+            if (!Nakked)
+                Reply(0x15, Expected);
+            Nakked = true;
+            return;
+        }
+        ++Frames;
+
+        if (type == 'D' && (uint8_t)(seq - HighestSent - 1) < 127)
+        {
+            // A data frame sent for the first time: how far ahead of the acknowledgements has the sink got?
+            HighestSent = seq;
+            MaxInFlight = max(MaxInFlight, (int)(uint8_t)(seq - AckedUpTo) + 1);
+        }
+
+        if (type == 'A')
+        {
+            Aborted = true;
+            return;
+        }
+        if (type == 'B')
+        {
+            Begun = true;
+            Image.clear();
+            DeclaredSize = payload[0] | payload[1] << 8 | payload[2] << 16 | (uint32_t)payload[3] << 24;
+            Expected = AckedUpTo = (uint8_t)(seq + 1);
+            HighestSent = seq;
+            Nakked = false;
+            Reply(0x06, seq);
+            return;
+        }
+        if (seq != Expected)
+        {
+            if ((uint8_t)(seq - Expected) < 128)
+            {
+                // A frame went missing before this one
+                if (!Nakked)
+                    Reply(0x15, Expected);
+                Nakked = true;
+            }
+            else
+                Reply(0x06, (uint8_t)(Expected - 1)); // a repeat of one already taken
+            return;
+        }
+        if (type == 'D')
+        {
+            if (NakData)
+            {
+                Reply(0x15, seq);
+                return;
+            }
+            uint32_t offset = payload[0] | payload[1] << 8 | payload[2] << 16 | (uint32_t)payload[3] << 24;
+            if (offset != Image.size())
+                OffsetError = true;
+            Image.insert(Image.end(), payload + 4, payload + length);
+        }
+        else if (type == 'E')
+            Ended = true;
+        ++Expected;
+        Nakked = false;
+        Reply(0x06, seq);
+    }
+};
+
+static std::vector<uint8_t> MakeImage(size_t size, uint32_t seed)
+{
+    std::vector<uint8_t> image(size);
+    for (auto &b : image)
+        b = (uint8_t)((seed = seed * 1103515245 + 12345) >> 16);
+    return image;
+}
+
+// Send image through sink in pieces of up to chunk bytes
+static bool Send(ESP32OTAPullUARTSink &sink, const std::vector<uint8_t> &image, size_t chunk)
+{
+    if (!sink.Begin(image.size()))
+        return false;
+    for (size_t at = 0; at < image.size(); at += chunk)
+        if (!sink.Write(image.data() + at, min(chunk, image.size() - at)))
+            return false;
+    return sink.End();
+}
+
+static void TestCRC()
+{
+    CHECK(Bootloader::CRC16((const uint8_t *)"123456789", 9) == 0x29B1); // CRC-16/CCITT-FALSE check value
+}
+
+static void TestCleanLink()
+{
+    Bootloader link(1);
+    ESP32OTAPullUARTSink sink(link, 4, 64);
+    std::vector<uint8_t> image = MakeImage(3000, 7);
+    CHECK(Send(sink, image, 100));
+    CHECK(link.Begun && link.Ended && !link.OffsetError && !link.Aborted);
+    CHECK(link.DeclaredSize == image.size());
+    CHECK(link.Image == image);
+    CHECK(link.MaxInFlight == 4);                       // the window is used, and not exceeded
+    CHECK(link.Frames == 1 + (3000 + 63) / 64 + 1);     // nothing sent twice
+}
+
+static void TestLossyLink()
+{
+    for (uint8_t window : { 1, 4, 16 })
+        for (uint32_t seed = 1; seed <= 5; ++seed)
+        {
+            Bootloader link(seed);
+            link.DropFrames = 50;
+            link.CorruptFrames = 50;
+            link.DropAnswers = 50;
+            ESP32OTAPullUARTSink sink(link, window, 16);
+            sink.SetTimeouts(50, 500);
+            std::vector<uint8_t> image = MakeImage(6000, seed); // 375 frames: the sequence numbers wrap
+            bool ok = Send(sink, image, 333);
+            CHECK(ok);
+            CHECK(link.Ended && !link.OffsetError);
+            CHECK(link.Image == image);
+            CHECK(link.MaxInFlight <= window);
+            if (!ok)
+                printf("  window %u, seed %u: %u of %u bytes\n", window, (unsigned)seed, (unsigned)link.Image.size(), (unsigned)image.size());
+        }
+}
+
+static void TestNoBootloader()
+{
+    Bootloader link(1);
+    link.AnswerLimit = 0;
+    ESP32OTAPullUARTSink sink(link, 4, 64);
+    sink.SetTimeouts(100, 1000);
+    int64_t started = hosttest::Now;
+    CHECK(!sink.Begin(1000));
+    // Nine attempts at 100 ms each, then it gives up
+    CHECK(hosttest::Now - started >= 900 * 1000 && hosttest::Now - started < 1000 * 1000);
+}
+
+static void TestBootloaderStops()
+{
+    Bootloader link(1);
+    link.AnswerLimit = 10;
+    ESP32OTAPullUARTSink sink(link, 4, 64);
+    sink.SetTimeouts(100, 1000);
+    std::vector<uint8_t> image = MakeImage(3000, 3);
+    int64_t started = hosttest::Now;
+    CHECK(!Send(sink, image, 64));
+    CHECK(hosttest::Now - started < 2000 * 1000); // gives up after its retries rather than hanging
+    sink.Abort();
+    CHECK(link.Aborted);
+}
+
+static void TestRejected()
+{
+    Bootloader link(1);
+    link.NakData = true;
+    ESP32OTAPullUARTSink sink(link, 4, 64);
+    sink.SetTimeouts(100, 1000);
+    std::vector<uint8_t> image = MakeImage(1000, 3);
+    CHECK(!Send(sink, image, 64));
+    CHECK(!link.Ended);
+}
+
+int main()
+{
+    TestCRC();
+    TestCleanLink();
+    TestLossyLink();
+    TestNoBootloader();
+    TestBootloaderStops();
+    TestRejected();
+    return TestResult();
+}